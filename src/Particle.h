@@ -4,17 +4,16 @@
 #include "mesh.h"
 
 
+// Plain data, the solver draws every particle with one shared instanced sphere mesh
 struct Particle {
-    std::shared_ptr<ShaderProgram> shaderProgram;
-    glm::vec3 position;
-    glm::vec3 velocity;
-    glm::vec3 acceleration;
-    float density;
-    float pressure;
-    float mass;
-    int id;
-    float radius;
-    Mesh mesh;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    glm::vec3 acceleration = glm::vec3(0.0f, -9.8f, 0.0f);
+    float density = 0.0f;
+    float pressure = 0.0f;
+    float mass = 1.0f;
+    int id = -1;
+    float radius = 0.1f;
     int gridIndex = -1;
     bool paused = false;
 
@@ -22,18 +21,12 @@ struct Particle {
         return 0.1f;
     }
 
-    Particle(std::shared_ptr<ShaderProgram> shaderProgram, glm::vec3 position, float radius, int id) : 
-        shaderProgram(shaderProgram),
+    Particle() {}
+
+    Particle(glm::vec3 position, float radius, int id) :
         position(position),
-        velocity(glm::vec3(0.0f)),
-        acceleration(glm::vec3(0.0f, -9.8f, 0.0f)),
-        density(0.0f),
-        pressure(0.0f),
         radius(radius),
-        id(id),
-        mesh(SPHERE, shaderProgram) {
-            this->mesh.makeSphere(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), radius, 36, 18);
-        }
+        id(id) {}
 
     void setGridIndex(int gridIndex) {
         this->gridIndex = gridIndex;
@@ -43,15 +36,6 @@ struct Particle {
         return this->gridIndex;
     }
 
-    void render(float dt){
-        this->mesh.updateModelMatrix(this->position);
-        this->mesh.render();
-        if (paused) {
-            return;
-        }
-        this->update(dt);
-    }
-
     void update(float dt){
         this->velocity += this->acceleration * dt;
         this->position += this->velocity * dt;
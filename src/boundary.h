@@ -0,0 +1,86 @@
+#ifndef BOUNDARY_H
+#define BOUNDARY_H
+
+#include <memory_resource>
+#include <vector>
+
+#include "grid.h"
+#include "kernels.h"
+
+// Boundary samples (Akinci et al. 2012), sorted by the fluid grid's cells so fluid particles look them up in the
+// same 27 cells as their fluid neighbours. The walls are built once; samples of rigid bodies move and are
+// sorted into a small set of their own every step.
+struct BoundaryParticles {
+    std::vector<glm::vec3> positions;
+    std::vector<float> volumes;         // 1 / sum of the kernel over the neighbouring samples, psi = rho0 * volume
+    std::vector<glm::vec3> velocities;  // of the surface the sample belongs to
+    std::vector<int> owners;            // rigid body of the sample, -1 for the static walls
+    std::vector<int> cellOffsets;       // samples of cell c: [cellOffsets[c], cellOffsets[c + 1])
+
+    // Static samples, volumeScale multiplies every volume, it calibrates the layer against the fluid's own sampling
+    void build(const std::vector<glm::vec3> &samples, Grid &grid, float smoothingLength, float volumeScale = 1.0f) {
+        assign(grid, std::pmr::vector<glm::vec3>(samples.begin(), samples.end()), std::pmr::vector<float>(samples.size(), 0.0f),
+               std::pmr::vector<glm::vec3>(samples.size(), glm::vec3(0.0f)), std::pmr::vector<int>(samples.size(), -1));
+
+        // denser sampling (edges, corners) gets smaller volumes so a wall contributes the same density everywhere
+        int cellCount = grid.grid.size();
+        for (int c = 0; c < cellCount; c++) {
+            for (int b = cellOffsets[c]; b < cellOffsets[c + 1]; b++) {
+                float kernelSum = 0.0f;
+                forEachNear(grid, c, [&](int other) {
+                    glm::vec3 offset = grid.separation(positions[b], positions[other]);
+                    kernelSum += poly6(glm::dot(offset, offset), smoothingLength);
+                });
+                volumes[b] = volumeScale / kernelSum;
+            }
+        }
+    }
+
+    // Sorts samples whose volumes are already known into the grid's cells, the temporaries come from scratch
+    void assign(Grid &grid, const std::pmr::vector<glm::vec3> &samples, const std::pmr::vector<float> &sampleVolumes,
+                const std::pmr::vector<glm::vec3> &sampleVelocities, const std::pmr::vector<int> &sampleOwners,
+                std::pmr::memory_resource *scratch = std::pmr::get_default_resource()) {
+        int cellCount = grid.grid.size();
+        std::pmr::vector<int> cells(samples.size(), scratch);
+        cellOffsets.assign(cellCount + 1, 0);
+        for (size_t b = 0; b < samples.size(); b++) {
+            cells[b] = grid.cellIndexOf(samples[b]);
+            cellOffsets[cells[b] + 1]++;
+        }
+        for (int c = 0; c < cellCount; c++) {
+            cellOffsets[c + 1] += cellOffsets[c];
+        }
+        positions.resize(samples.size());
+        volumes.resize(samples.size());
+        velocities.resize(samples.size());
+        owners.resize(samples.size());
+        std::pmr::vector<int> next(cellOffsets.begin(), cellOffsets.end() - 1, scratch);
+        for (size_t b = 0; b < samples.size(); b++) {
+            int slot = next[cells[b]]++;
+            positions[slot] = samples[b];
+            volumes[slot] = sampleVolumes[b];
+            velocities[slot] = sampleVelocities[b];
+            owners[slot] = sampleOwners[b];
+        }
+    }
+
+    // Calls f(sampleIndex) for every sample in the cell and its 26 neighbours
+    template <typename F>
+    void forEachNear(const Grid &grid, int cell, F &&f) const {
+        for (int b = cellOffsets[cell]; b < cellOffsets[cell + 1]; b++) {
+            f(b);
+        }
+        for (int neighbour : grid.neighbours[cell]) {
+            if (neighbour == -1) {
+                continue;
+            }
+            for (int b = cellOffsets[neighbour]; b < cellOffsets[neighbour + 1]; b++) {
+                f(b);
+            }
+        }
+    }
+
+    bool empty() const { return positions.empty(); }
+};
+
+#endif // BOUNDARY_H
@@ -0,0 +1,86 @@
+#ifndef COLLIDER_GRID_H
+#define COLLIDER_GRID_H
+
+#include <algorithm>
+#include <memory_resource>
+#include <vector>
+
+#include "grid.h"
+
+// Coarse buckets over the fluid grid, blockSize fluid cells per axis. Every collider is listed in the blocks its
+// world bounds overlap, so a particle only tests the colliders of its own block instead of all of them.
+// Rebuilt whenever a collider moves.
+struct ColliderGrid {
+    int blockSize = 8;
+    int blocksX = 0;
+    int blocksY = 0;
+    int blocksZ = 0;
+    std::vector<int> blockOffsets;          // colliders of block b: colliderIds[blockOffsets[b], blockOffsets[b + 1])
+    std::vector<int> colliderIds;
+    std::vector<unsigned char> blockMoving; // a moving collider overlaps the block
+
+    // lows and highs are the colliders' world bounds, already grown by the contact distance. The buckets are
+    // gathered in scratch.
+    void build(const Grid &grid, const std::pmr::vector<glm::vec3> &lows, const std::pmr::vector<glm::vec3> &highs,
+               const std::pmr::vector<bool> &moving, std::pmr::memory_resource *scratch) {
+        blocksX = (grid.num_cells_x + blockSize - 1) / blockSize;
+        blocksY = (grid.num_cells_y + blockSize - 1) / blockSize;
+        blocksZ = (grid.num_cells_z + blockSize - 1) / blockSize;
+        int blockCount = blocksX * blocksY * blocksZ;
+        std::pmr::vector<std::pmr::vector<int>> buckets(blockCount, scratch);
+        blockMoving.assign(blockCount, 0);
+        for (size_t c = 0; c < lows.size(); c++) {
+            glm::ivec3 first = blockCoordinates(grid, lows[c]);
+            glm::ivec3 last = blockCoordinates(grid, highs[c]);
+            for (int k = first.z; k <= last.z; k++) {
+                for (int j = first.y; j <= last.y; j++) {
+                    for (int i = first.x; i <= last.x; i++) {
+                        int block = i + blocksX * (j + blocksY * k);
+                        buckets[block].push_back(c);
+                        blockMoving[block] |= moving[c];
+                    }
+                }
+            }
+        }
+        blockOffsets.assign(blockCount + 1, 0);
+        colliderIds.clear();
+        for (int b = 0; b < blockCount; b++) {
+            colliderIds.insert(colliderIds.end(), buckets[b].begin(), buckets[b].end());
+            blockOffsets[b + 1] = colliderIds.size();
+        }
+    }
+
+    // Block of a fluid grid cell
+    int blockOf(const Grid &grid, int cell) const {
+        int i = cell % grid.num_cells_x;
+        int j = (cell / grid.num_cells_x) % grid.num_cells_y;
+        int k = cell / (grid.num_cells_x * grid.num_cells_y);
+        return i / blockSize + blocksX * (j / blockSize + blocksY * (k / blockSize));
+    }
+
+    // Calls f(colliderIndex) for every collider listed in the block of a fluid grid cell
+    template <typename F>
+    void forEachCollider(const Grid &grid, int cell, F &&f) const {
+        if (blockOffsets.empty()) {
+            return;
+        }
+        int block = blockOf(grid, cell);
+        for (int c = blockOffsets[block]; c < blockOffsets[block + 1]; c++) {
+            f(colliderIds[c]);
+        }
+    }
+
+    bool isMoving(const Grid &grid, int cell) const { return !blockMoving.empty() && blockMoving[blockOf(grid, cell)]; }
+
+private:
+    // clamped like Grid::cellIndexOf, so bounds outside the domain land in the border blocks
+    glm::ivec3 blockCoordinates(const Grid &grid, const glm::vec3 &position) const {
+        glm::vec3 local = (position - grid.origin) / grid.size;
+        glm::ivec3 cell(std::clamp((int) std::floor(local.x), 0, grid.num_cells_x - 1),
+                        std::clamp((int) std::floor(local.y), 0, grid.num_cells_y - 1),
+                        std::clamp((int) std::floor(local.z), 0, grid.num_cells_z - 1));
+        return cell / blockSize;
+    }
+};
+
+#endif // COLLIDER_GRID_H
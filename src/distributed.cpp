@@ -0,0 +1,308 @@
+#include "distributed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "domainDecomposition.h"
+#include "sphSolver.h"
+#include "timestepController.h"
+#include "utils/HeadlessContext.h"
+#include "utils/ThreadPool.h"
+#include "utils/Transport.h"
+
+namespace {
+    const size_t ringCapacity = 4 << 20;
+
+    const char *transportName(TransportKind kind) {
+        switch (kind) {
+        case TRANSPORT_UNIX:
+            return "Unix sockets";
+        case TRANSPORT_TCP:
+            return "TCP";
+        default:
+            return "shared memory";
+        }
+    }
+
+    // The parts of a scene the ranks can't share. Emitted particles would land after the halo copies at the tail
+    // of a rank's particles, and a particle cap would have to be counted over all the ranks.
+    bool supported(const HeadlessOptions &options) {
+        if (!options.bodies.empty()) {
+            std::cout << "Rigid bodies aren't supported in distributed runs" << std::endl;
+            return false;
+        }
+        if (!options.emitters.empty() || options.maxParticles > 0) {
+            std::cout << "Inflow emitters and a particle cap aren't supported in distributed runs" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    int runRank(const HeadlessOptions &options, const DistributedOptions &distributed, Transport &transport, DistributedStats &stats) {
+        HeadlessContext context;
+        if (!context.init()) {
+            return 1;
+        }
+        if (transport.rank() != 0) {
+            // the ranks would all write the same cache files at once
+            ShaderProgram::setBinaryCacheDirectory("");
+        }
+        std::shared_ptr<ShaderProgram> shaderProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/vertexShader.glsl", "../src/shaders/fragmentShader.glsl");
+        std::shared_ptr<std::vector<Particle>> particles = std::make_shared<std::vector<Particle>>();
+        SPHSolver sphSolver(particles, shaderProgram);
+        sphSolver.setSleepingEnabled(options.sleeping);
+        sphSolver.setSolverMode(options.solver);
+        std::string parameterError;
+        if (!sphSolver.setParameters(options.parameters, parameterError)) {
+            std::cout << "Could not set the solver parameters: " << parameterError << std::endl;
+            return 1;
+        }
+        sphSolver.setPeriodicAxes(options.periodic);
+        for (const ParticleSink &sink : options.sinks) {
+            sphSolver.addSink(sink);
+        }
+        for (const ObstacleOptions &obstacle : options.obstacles) {
+            if (!sphSolver.addCollider(obstacle.path, obstacle.motion)) {
+                std::cout << "Could not read obstacle mesh " << obstacle.path << std::endl;
+                return 1;
+            }
+        }
+
+        // every rank fills its own part of one lattice over the whole tank
+        const Grid &grid = sphSolver.getGrid();
+        DomainDecomposition decomposition(transport, grid, sphSolver.getSmoothingLength());
+        glm::vec3 min;
+        glm::vec3 max;
+        if (distributed.damBreak) {
+            // the same volume, twice as tall, against the left wall
+            min = glm::vec3(grid.origin.x, 0.0f, -2.0f);
+            max = glm::vec3(grid.origin.x + std::min((float) transport.size(), grid.Width), 1.6f, 0.0f);
+            decomposition.splitEvenly(grid.origin.x, grid.origin.x + grid.Width);
+        } else {
+            float halfWidth = std::min((float) transport.size(), 0.5f * grid.Width);
+            min = glm::vec3(-halfWidth, 0.0f, -2.0f);
+            max = glm::vec3(halfWidth, 0.8f, 0.0f);
+            decomposition.splitEvenly(min.x, max.x);
+        }
+        std::vector<glm::vec3> positions = latticeFill(min, max, sphSolver.getRestSpacing());
+        positions.erase(std::remove_if(positions.begin(), positions.end(), [&](const glm::vec3 &position) {
+            return decomposition.ownerOf(position) != transport.rank();
+        }), positions.end());
+        sphSolver.removeOccupied(positions);
+        sphSolver.emitParticles(positions);
+        decomposition.exchange(sphSolver, *particles);
+
+        TimestepController timestep(options.minDt, options.maxDt > 0.0f ? options.maxDt : sphSolver.getMaxStableTimestep(), options.cfl);
+        if (options.dt > 0.0f) {
+            timestep.setBounds(options.dt, options.dt);
+        }
+        timestep.setReduction([&](float &maxSpeed, float &maxAcceleration) {
+            std::vector<float> values = {maxSpeed, maxAcceleration};
+            decomposition.maxOverRanks(values);
+            maxSpeed = values[0];
+            maxAcceleration = values[1];
+        });
+
+        auto start = std::chrono::high_resolution_clock::now();
+        float solveMs = 0.0f;
+        float exchangeMs = 0.0f;
+        long pressureIterations = 0;
+        int rebalances = 0;
+        for (int frame = 0; frame < options.frames; frame++) {
+            float dt = timestep.computeTimestep(*particles, sphSolver.getSmoothingLength());
+            auto solveStart = std::chrono::high_resolution_clock::now();
+            sphSolver.step(dt);
+            pressureIterations += sphSolver.getPressureSolverStats().iterations;
+            auto exchangeStart = std::chrono::high_resolution_clock::now();
+            decomposition.exchange(sphSolver, *particles);
+            if (distributed.rebalanceInterval > 0 && (frame + 1) % distributed.rebalanceInterval == 0) {
+                DomainDecomposition::RebalanceResult rebalance = decomposition.rebalance(sphSolver, *particles);
+                if (rebalance.moved) {
+                    rebalances++;
+                    if (transport.rank() == 0) {
+                        std::cout << "Step " << frame + 1 << ": load imbalance " << rebalance.before << ", borders moved, now " << rebalance.after << std::endl;
+                    }
+                }
+            }
+            auto exchangeEnd = std::chrono::high_resolution_clock::now();
+            solveMs += std::chrono::duration<float, std::milli>(exchangeStart - solveStart).count();
+            exchangeMs += std::chrono::duration<float, std::milli>(exchangeEnd - exchangeStart).count();
+        }
+        int frames = std::max(options.frames, 1);
+        float stepMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+
+        std::vector<float> local = {(float) decomposition.getOwnedCount(*particles), (float) decomposition.getHaloCount(),
+                                    solveMs / frames, exchangeMs / frames, (float) pressureIterations / frames};
+        std::vector<std::vector<float>> gathered = decomposition.gatherOnRoot(local);
+        std::vector<float> loads;
+        if (distributed.rebalanceInterval > 0) {
+            loads = decomposition.measureColumnLoads(sphSolver, *particles);
+            decomposition.sumOverRanks(loads);
+        }
+        if (transport.rank() != 0) {
+            return 0;
+        }
+        stats = DistributedStats();
+        stats.ranks = transport.size();
+        stats.stepMs = stepMs;
+        float largest = 0.0f;
+        for (int rank = 0; rank < transport.size(); rank++) {
+            const std::vector<float> &values = gathered[rank];
+            std::cout << "Rank " << rank << ": " << (long) values[0] << " particles, " << (long) values[1] << " in the halo, solve "
+                      << values[2] << " ms, exchange " << values[3] << " ms per step";
+            if (options.solver != SOLVER_CONTACT) {
+                std::cout << ", " << values[4] << " pressure iterations";
+            }
+            std::cout << std::endl;
+            stats.particles += (long) values[0];
+            stats.solveMs = std::max(stats.solveMs, values[2]);
+            stats.exchangeMs = std::max(stats.exchangeMs, values[3]);
+            largest = std::max(largest, values[0]);
+        }
+        stats.imbalance = stats.particles > 0 ? largest * transport.size() / stats.particles : 1.0f;
+        std::cout << "Simulated " << timestep.getTime() << " s on " << transport.size() << " ranks, " << stats.particles << " particles, " << stepMs << " ms per step";
+        if (distributed.rebalanceInterval > 0) {
+            std::cout << ", borders moved " << rebalances << " times, final load imbalance "
+                      << decomposition.imbalanceOf(loads, decomposition.getBorders());
+        }
+        std::cout << std::endl;
+        return 0;
+    }
+
+    // Forks ranks processes and waits for them, rank 0's stats come back through a pipe
+    bool launchLocal(const HeadlessOptions &options, const DistributedOptions &distributed, int ranks, DistributedStats &stats) {
+        void *region = nullptr;
+        std::vector<std::string> addresses;
+        if (distributed.transport == TRANSPORT_SHARED_MEMORY) {
+            region = SharedMemoryTransport::createRegion(ranks, ringCapacity);
+            if (!region) {
+                std::cout << "Could not map the shared memory rings" << std::endl;
+                return false;
+            }
+        }
+        int results[2];
+        if (pipe(results) != 0) {
+            if (region) {
+                SharedMemoryTransport::destroyRegion(region, ranks, ringCapacity);
+            }
+            return false;
+        }
+        for (int rank = 0; rank < ranks; rank++) {
+            if (distributed.transport == TRANSPORT_UNIX) {
+                addresses.push_back("unix:/tmp/fluid-sim-" + std::to_string(getpid()) + "-" + std::to_string(rank) + ".sock");
+            } else {
+                addresses.push_back("127.0.0.1:" + std::to_string(distributed.basePort + rank));
+            }
+        }
+
+        // the cores are split between the ranks
+        unsigned int threads = std::max(1u, std::thread::hardware_concurrency() / ranks);
+        std::cout.flush();
+        std::vector<pid_t> children;
+        bool ok = true;
+        for (int rank = 0; rank < ranks && ok; rank++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(results[0]);
+                ThreadPool::setInstanceThreadCount(threads);
+                DistributedStats rankStats;
+                int code = 1;
+                if (region) {
+                    SharedMemoryTransport transport(rank, ranks, region, ringCapacity);
+                    code = runRank(options, distributed, transport, rankStats);
+                } else {
+                    SocketTransport transport(rank, addresses);
+                    code = transport.connect() ? runRank(options, distributed, transport, rankStats) : 1;
+                }
+                if (code == 0 && rank == 0 && write(results[1], &rankStats, sizeof rankStats) != sizeof rankStats) {
+                    code = 1;
+                }
+                std::cout.flush();
+                _exit(code);
+            }
+            ok = pid > 0;
+            if (ok) {
+                children.push_back(pid);
+            }
+        }
+        close(results[1]);
+
+        // a rank that fails leaves its neighbours waiting forever, so the others are stopped
+        for (size_t waited = 0; waited < children.size(); waited++) {
+            int status = 0;
+            if (wait(&status) == -1) {
+                break;
+            }
+            if (ok && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+                ok = false;
+            }
+            if (!ok) {
+                for (pid_t child : children) {
+                    kill(child, SIGTERM);
+                }
+            }
+        }
+        ok = ok && read(results[0], &stats, sizeof stats) == sizeof stats;
+        close(results[0]);
+        if (region) {
+            SharedMemoryTransport::destroyRegion(region, ranks, ringCapacity);
+        }
+        return ok;
+    }
+}
+
+int runDistributed(const HeadlessOptions &options, const DistributedOptions &distributed) {
+    if (!supported(options)) {
+        return 1;
+    }
+    DistributedStats stats;
+    if (!distributed.hosts.empty()) {
+        SocketTransport transport(distributed.rank, distributed.hosts);
+        return transport.connect() ? runRank(options, distributed, transport, stats) : 1;
+    }
+    if (!launchLocal(options, distributed, distributed.ranks, stats)) {
+        std::cout << "A rank failed, the run was stopped" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runWeakScaling(const HeadlessOptions &options, const DistributedOptions &distributed) {
+    if (!supported(options)) {
+        return 1;
+    }
+    std::vector<int> rankCounts;
+    for (int ranks = 1; ranks < distributed.weakScalingRanks; ranks *= 2) {
+        rankCounts.push_back(ranks);
+    }
+    rankCounts.push_back(distributed.weakScalingRanks);
+
+    std::vector<DistributedStats> results;
+    for (int ranks : rankCounts) {
+        DistributedStats stats;
+        if (!launchLocal(options, distributed, ranks, stats)) {
+            std::cout << "The run on " << ranks << " ranks failed" << std::endl;
+            return 1;
+        }
+        results.push_back(stats);
+    }
+
+    std::cout << "Weak scaling over " << transportName(distributed.transport) << ", " << options.frames << " steps:\n"
+              << std::setw(6) << "ranks" << std::setw(11) << "particles" << std::setw(10) << "ms/step" << std::setw(10) << "solve"
+              << std::setw(10) << "exchange" << std::setw(11) << "imbalance" << std::setw(12) << "efficiency" << "\n";
+    for (const DistributedStats &stats : results) {
+        std::cout << std::fixed << std::setprecision(2) << std::setw(6) << stats.ranks << std::setw(11) << stats.particles
+                  << std::setw(10) << stats.stepMs << std::setw(10) << stats.solveMs << std::setw(10) << stats.exchangeMs
+                  << std::setw(11) << stats.imbalance << std::setw(11) << 100.0f * results[0].stepMs / stats.stepMs << "%\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
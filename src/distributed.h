@@ -0,0 +1,47 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <string>
+#include <vector>
+
+#include "headless.h"
+
+enum TransportKind {
+    TRANSPORT_SHARED_MEMORY,    // rings in memory shared by the ranks forked on this machine
+    TRANSPORT_UNIX,             // Unix domain sockets between the ranks forked on this machine
+    TRANSPORT_TCP               // TCP, on this machine or across machines with hosts
+};
+
+struct DistributedOptions {
+    int ranks = 0;                      // 0 runs in this process alone
+    TransportKind transport = TRANSPORT_SHARED_MEMORY;
+    int basePort = 47600;               // local TCP ranks listen on 127.0.0.1:basePort + rank
+    std::vector<std::string> hosts;     // "host:port" of every rank, this process runs only rank
+    int rank = 0;
+    int weakScalingRanks = 0;           // steps 1, 2, 4, ... up to this many ranks and compares them
+    int rebalanceInterval = 0;          // steps between load measurements that may move the borders, 0 keeps them
+    bool damBreak = false;              // the fluid starts piled against the left wall, the ranks split the whole grid
+};
+
+// What rank 0 reports at the end of a run
+struct DistributedStats {
+    int ranks = 0;
+    long particles = 0;
+    float stepMs = 0.0f;            // wall time per step, exchange included
+    float solveMs = 0.0f;           // solver time per step of the slowest rank
+    float exchangeMs = 0.0f;        // exchange time per step of the slowest rank, waiting for the others included
+    float imbalance = 1.0f;         // largest rank's particle count over the mean at the end
+};
+
+// Splits the tank between ranks, every rank a process with its own slab of the grid (see DomainDecomposition).
+// The tank is 2 m wide per rank so every rank holds the same amount of fluid. Ranks on this machine are forked
+// from this process, which must not have touched GL or the thread pool yet; with hosts only the given rank runs
+// here and the others are started the same way on their machines. Nothing is rendered.
+// With a rebalance interval the borders follow the load, rank 0 prints the imbalance every time they move.
+int runDistributed(const HeadlessOptions &options, const DistributedOptions &distributed);
+
+// Weak scaling: runs 1, 2, 4, ... up to weakScalingRanks local ranks and prints the time per step and the
+// efficiency against one rank
+int runWeakScaling(const HeadlessOptions &options, const DistributedOptions &distributed);
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,290 @@
+#include "domainDecomposition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<Particle>::value, "particles are sent as raw bytes");
+
+DomainDecomposition::DomainDecomposition(Transport &transport, const Grid &grid, float smoothingLength) :
+        _transport(transport),
+        _grid(grid),
+        _haloColumns(std::max(1, (int) std::ceil(smoothingLength / grid.size - 1e-4f))) {
+    splitEvenly(grid.origin.x, grid.origin.x + grid.Width);
+}
+
+void DomainDecomposition::setBorders(const std::vector<int> &borders) {
+    _borders = borders;
+    _columnOwners.resize(_grid.num_cells_x);
+    for (int rank = 0; rank < _transport.size(); rank++) {
+        for (int column = borders[rank]; column < borders[rank + 1]; column++) {
+            _columnOwners[column] = rank;
+        }
+    }
+}
+
+void DomainDecomposition::splitEvenly(float minX, float maxX) {
+    int ranks = _transport.size();
+    int first = columnOf(glm::vec3(minX, 0.0f, 0.0f));
+    int last = columnOf(glm::vec3(maxX, 0.0f, 0.0f)) + 1;
+    // every slab needs room for its halo, otherwise the whole grid is split
+    if (last - first < ranks * _haloColumns) {
+        first = 0;
+        last = _grid.num_cells_x;
+    }
+    std::vector<int> borders(ranks + 1);
+    for (int rank = 0; rank <= ranks; rank++) {
+        borders[rank] = first + (last - first) * rank / ranks;
+    }
+    borders[0] = 0;
+    borders[ranks] = _grid.num_cells_x;
+    setBorders(borders);
+}
+
+int DomainDecomposition::columnOf(const glm::vec3 &position) const {
+    // clamped like Grid::cellIndexOf
+    return std::clamp((int) std::floor((position.x - _grid.origin.x) / _grid.size), 0, _grid.num_cells_x - 1);
+}
+
+int DomainDecomposition::ownerOf(const glm::vec3 &position) const {
+    return _columnOwners[columnOf(position)];
+}
+
+int DomainDecomposition::neighbour(int direction) const {
+    int ranks = _transport.size();
+    int rank = _transport.rank() + direction;
+    if (_grid.periodic.x) {
+        rank = (rank + ranks) % ranks;
+    }
+    return rank < 0 || rank >= ranks || rank == _transport.rank() ? -1 : rank;
+}
+
+void DomainDecomposition::sendParticles(int peer, const std::vector<Particle> &particles) {
+    _buffer.resize(particles.size() * sizeof(Particle));
+    std::memcpy(_buffer.data(), particles.data(), _buffer.size());
+    _transport.send(peer, _buffer);
+}
+
+void DomainDecomposition::receiveParticles(int peer, std::vector<Particle> &particles, bool halo) {
+    _transport.receive(peer, _buffer);
+    size_t first = particles.size();
+    particles.resize(first + _buffer.size() / sizeof(Particle));
+    std::memcpy(particles.data() + first, _buffer.data(), _buffer.size());
+    for (size_t i = first; i < particles.size(); i++) {
+        particles[i].paused = halo;
+    }
+}
+
+void DomainDecomposition::exchange(SPHSolver &solver, std::vector<Particle> &particles) {
+    int rank = _transport.rank();
+    int ranks = _transport.size();
+    int left = neighbour(-1);
+    int right = neighbour(1);
+
+    // the old halo is dropped, owned particles that left go towards their owner the short way round. One that
+    // crossed a whole slab in a step is passed on at the next exchange.
+    size_t ownedCount = getOwnedCount(particles);
+    std::vector<Particle> next;
+    next.reserve(particles.size());
+    std::vector<Particle> toLeft;
+    std::vector<Particle> toRight;
+    for (size_t i = 0; i < ownedCount; i++) {
+        int owner = ownerOf(particles[i].position);
+        bool towardsRight = _grid.periodic.x ? (owner - rank + ranks) % ranks <= ranks / 2 : owner > rank;
+        if (owner == rank || (towardsRight ? right : left) == -1) {
+            next.push_back(particles[i]);
+        } else if (towardsRight) {
+            toRight.push_back(particles[i]);
+        } else {
+            toLeft.push_back(particles[i]);
+        }
+    }
+    // messages to both sides go out before either is read, in the same order on every rank, so with two ranks
+    // around a periodic seam (left == right) the first message to arrive is the one sent to the left
+    if (left != -1) {
+        sendParticles(left, toLeft);
+    }
+    if (right != -1) {
+        sendParticles(right, toRight);
+    }
+    if (right != -1) {
+        receiveParticles(right, next, false);
+    }
+    if (left != -1) {
+        receiveParticles(left, next, false);
+    }
+
+    size_t owned = next.size();
+    toLeft.clear();
+    toRight.clear();
+    int first = _borders[rank];
+    int last = _borders[rank + 1];
+    for (size_t i = 0; i < owned; i++) {
+        int column = columnOf(next[i].position);
+        if (left != -1 && column < first + _haloColumns) {
+            toLeft.push_back(next[i]);
+        }
+        if (right != -1 && column >= last - _haloColumns) {
+            toRight.push_back(next[i]);
+        }
+    }
+    if (left != -1) {
+        sendParticles(left, toLeft);
+    }
+    if (right != -1) {
+        sendParticles(right, toRight);
+    }
+    if (right != -1) {
+        receiveParticles(right, next, true);
+    }
+    if (left != -1) {
+        receiveParticles(left, next, true);
+    }
+    _haloCount = next.size() - owned;
+    solver.replaceParticles(next);
+}
+
+std::vector<float> DomainDecomposition::measureColumnLoads(const SPHSolver &solver, const std::vector<Particle> &particles) const {
+    std::vector<float> loads(_grid.num_cells_x, 0.0f);
+    size_t ownedCount = getOwnedCount(particles);
+    for (size_t i = 0; i < ownedCount; i++) {
+        int cell = particles[i].gridIndex;
+        float cost = 1.0f;
+        if (!solver.isAsleep(cell)) {
+            cost = (float) _grid.grid[cell].size();
+            for (int neighbour : _grid.neighbours[cell]) {
+                if (neighbour != -1) {
+                    cost += (float) _grid.grid[neighbour].size();
+                }
+            }
+        }
+        loads[cell % _grid.num_cells_x] += cost;
+    }
+    return loads;
+}
+
+float DomainDecomposition::imbalanceOf(const std::vector<float> &columnLoads, const std::vector<int> &borders) const {
+    int ranks = (int) borders.size() - 1;
+    float total = 0.0f;
+    float heaviest = 0.0f;
+    for (int rank = 0; rank < ranks; rank++) {
+        float load = 0.0f;
+        for (int column = borders[rank]; column < borders[rank + 1]; column++) {
+            load += columnLoads[column];
+        }
+        total += load;
+        heaviest = std::max(heaviest, load);
+    }
+    return total > 0.0f ? heaviest * ranks / total : 1.0f;
+}
+
+std::vector<int> DomainDecomposition::balancedBorders(const std::vector<float> &columnLoads) const {
+    int ranks = _transport.size();
+    int columns = _grid.num_cells_x;
+    std::vector<double> prefix(columns + 1, 0.0);
+    for (int column = 0; column < columns; column++) {
+        prefix[column + 1] = prefix[column] + columnLoads[column];
+    }
+    // border r goes where the load to its left is closest to r / ranks of the total, leaving every slab at
+    // least the halo wide on both sides of it
+    std::vector<int> borders(ranks + 1);
+    borders[0] = 0;
+    borders[ranks] = columns;
+    for (int rank = 1; rank < ranks; rank++) {
+        double target = prefix[columns] * rank / ranks;
+        int border = (int) (std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin());
+        if (border > 0 && target - prefix[border - 1] < prefix[border] - target) {
+            border--;
+        }
+        borders[rank] = std::clamp(border, borders[rank - 1] + _haloColumns, columns - (ranks - rank) * _haloColumns);
+    }
+    return borders;
+}
+
+DomainDecomposition::RebalanceResult DomainDecomposition::rebalance(SPHSolver &solver, std::vector<Particle> &particles, float threshold, float margin) {
+    RebalanceResult result;
+    if (_transport.size() < 2 || _grid.num_cells_x < _transport.size() * _haloColumns) {
+        return result;
+    }
+    std::vector<float> loads = measureColumnLoads(solver, particles);
+    sumOverRanks(loads);
+    result.before = imbalanceOf(loads, _borders);
+    result.after = result.before;
+    if (result.before <= 1.0f + threshold) {
+        return result;
+    }
+    // every rank has the same loads, so they all agree on the borders without another message
+    std::vector<int> borders = balancedBorders(loads);
+    float predicted = imbalanceOf(loads, borders);
+    if (predicted > result.before - margin) {
+        return result;
+    }
+    setBorders(borders);
+
+    // a border can move past several slabs and exchange passes particles one neighbour per call
+    std::vector<float> strays(1);
+    do {
+        exchange(solver, particles);
+        strays[0] = 0.0f;
+        size_t ownedCount = getOwnedCount(particles);
+        for (size_t i = 0; i < ownedCount; i++) {
+            if (ownerOf(particles[i].position) != _transport.rank()) {
+                strays[0] += 1.0f;
+            }
+        }
+        maxOverRanks(strays);
+    } while (strays[0] > 0.0f);
+
+    loads = measureColumnLoads(solver, particles);
+    sumOverRanks(loads);
+    result.moved = true;
+    result.after = imbalanceOf(loads, _borders);
+    return result;
+}
+
+std::vector<std::vector<float>> DomainDecomposition::gatherOnRoot(const std::vector<float> &values) {
+    std::vector<std::vector<float>> gathered;
+    if (_transport.rank() != 0) {
+        std::vector<char> message(values.size() * sizeof(float));
+        std::memcpy(message.data(), values.data(), message.size());
+        _transport.send(0, message);
+        return gathered;
+    }
+    gathered.push_back(values);
+    std::vector<char> message;
+    for (int peer = 1; peer < _transport.size(); peer++) {
+        _transport.receive(peer, message);
+        gathered.emplace_back(message.size() / sizeof(float));
+        std::memcpy(gathered.back().data(), message.data(), message.size());
+    }
+    return gathered;
+}
+
+void DomainDecomposition::maxOverRanks(std::vector<float> &values) {
+    reduceOverRanks(values, [](float a, float b) { return std::max(a, b); });
+}
+
+void DomainDecomposition::sumOverRanks(std::vector<float> &values) {
+    reduceOverRanks(values, [](float a, float b) { return a + b; });
+}
+
+void DomainDecomposition::reduceOverRanks(std::vector<float> &values, const std::function<float(float, float)> &combine) {
+    std::vector<char> message(values.size() * sizeof(float));
+    if (_transport.rank() == 0) {
+        std::vector<std::vector<float>> gathered = gatherOnRoot(values);
+        for (size_t other = 1; other < gathered.size(); other++) {
+            for (size_t k = 0; k < values.size(); k++) {
+                values[k] = combine(values[k], gathered[other][k]);
+            }
+        }
+        std::memcpy(message.data(), values.data(), message.size());
+        for (int peer = 1; peer < _transport.size(); peer++) {
+            _transport.send(peer, message);
+        }
+    } else {
+        gatherOnRoot(values);
+        _transport.receive(0, message);
+        std::memcpy(values.data(), message.data(), message.size());
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef DOMAIN_DECOMPOSITION_H
+#define DOMAIN_DECOMPOSITION_H
+
+#include <functional>
+#include <vector>
+
+#include "sphSolver.h"
+#include "utils/Transport.h"
+
+// Splits the grid into slabs of whole cell columns along x, one per rank. Every rank keeps a solver over the
+// whole grid but only owns the particles in its slab. After each step the particles that left a slab move to
+// their new owner, then the owned particles in the columns along a border are copied to the neighbour as a
+// halo. Halo particles are paused, the solver treats them like a sleeping neighbour that counts in the sums
+// but isn't moved, so the two sides of a border see each other one step late.
+//
+// The borders can follow the load: the columns are the cells in order along x, every rank keeps a contiguous
+// run of them, and rebalance cuts that order again into runs of equal load.
+class DomainDecomposition {
+public:
+    DomainDecomposition(Transport &transport, const Grid &grid, float smoothingLength);
+
+    // Rank r owns the columns [borders[r], borders[r + 1]), there is one more border than there are ranks
+    void setBorders(const std::vector<int> &borders);
+    // Splits the columns spanning [minX, maxX] evenly, the outer ranks also take the columns beyond
+    void splitEvenly(float minX, float maxX);
+    const std::vector<int> &getBorders() const { return _borders; }
+
+    int columnOf(const glm::vec3 &position) const;
+    int ownerOf(const glm::vec3 &position) const;
+
+    // Hands the particles that left the slab to their new owner and refreshes the halo, the solver's particles
+    // end up as the owned ones followed by the halo
+    void exchange(SPHSolver &solver, std::vector<Particle> &particles);
+    size_t getOwnedCount(const std::vector<Particle> &particles) const { return particles.size() - _haloCount; }
+    size_t getHaloCount() const { return _haloCount; }
+
+    // Load of every column on this rank: each owned, awake particle costs the particles in its cell and the
+    // 26 around it, the pairs the solver evaluates for it, a sleeping one costs 1. Zero outside the slab.
+    std::vector<float> measureColumnLoads(const SPHSolver &solver, const std::vector<Particle> &particles) const;
+    // Heaviest slab over the mean for the given borders, 1 is perfectly balanced
+    float imbalanceOf(const std::vector<float> &columnLoads, const std::vector<int> &borders) const;
+    // Borders cutting the columns into runs of equal load, every run at least the halo wide
+    std::vector<int> balancedBorders(const std::vector<float> &columnLoads) const;
+
+    struct RebalanceResult {
+        bool moved = false;
+        float before = 1.0f;    // imbalance of the borders in use
+        float after = 1.0f;     // measured again once the particles moved, before if the borders stayed
+    };
+    // Measures the load and moves the borders if the heaviest rank carries more than threshold over the mean
+    // and the new borders bring that down by at least margin, the gap keeps small fluctuations from moving
+    // them back and forth. The particles are then handed over until every rank holds only its own.
+    // Collective, every rank gets the same result.
+    RebalanceResult rebalance(SPHSolver &solver, std::vector<Particle> &particles, float threshold = 0.1f, float margin = 0.05f);
+
+    // Element-wise maximum and sum over all ranks, every rank gets the result
+    void maxOverRanks(std::vector<float> &values);
+    void sumOverRanks(std::vector<float> &values);
+    // Every rank's values on rank 0 in rank order, empty on the other ranks
+    std::vector<std::vector<float>> gatherOnRoot(const std::vector<float> &values);
+
+private:
+    // The rank next to this one in the direction (-1 or 1), -1 if there is none
+    int neighbour(int direction) const;
+    void sendParticles(int peer, const std::vector<Particle> &particles);
+    // Appends the received particles
+    void receiveParticles(int peer, std::vector<Particle> &particles, bool halo);
+    void reduceOverRanks(std::vector<float> &values, const std::function<float(float, float)> &combine);
+
+    Transport &_transport;
+    const Grid &_grid;
+    int _haloColumns;
+    std::vector<int> _borders;
+    std::vector<int> _columnOwners;
+    size_t _haloCount = 0;
+    std::vector<char> _buffer;
+};
+
+#endif // DOMAIN_DECOMPOSITION_H
@@ -0,0 +1,188 @@
+#include "ensemble.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+
+#include "timestepController.h"
+#include "utils/ThreadPool.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // a blown up run throws particles far faster than anything falling in the tank
+    const float UNSTABLE_SPEED = 50.0f;
+
+    EnsembleScene sceneOf(unsigned int seed) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        EnsembleScene scene;
+        scene.size.x = 0.4f + 0.8f * unit(random);
+        scene.size.y = 0.3f + 0.6f * unit(random);
+        scene.size.z = 0.4f + 0.8f * unit(random);
+        float drop = 0.5f * unit(random);
+        scene.velocity.x = 2.0f * unit(random) - 1.0f;
+        scene.velocity.y = 0.0f;
+        scene.velocity.z = 2.0f * unit(random) - 1.0f;
+        // centred in the middle of the tank
+        scene.min = glm::vec3(-0.5f * scene.size.x, drop, -2.0f - 0.5f * scene.size.z);
+        return scene;
+    }
+}
+
+EnsembleResult runEnsembleScene(SPHSolver &solver, const EnsembleScene &scene, const HeadlessOptions &options) {
+    Clock::time_point start = Clock::now();
+    solver.reset();
+    float spacing = solver.getRestSpacing();
+    glm::ivec3 counts = glm::ivec3(scene.size / spacing) + 1;
+    glm::vec3 min = scene.min + glm::vec3(0.0f, 0.5f * spacing, 0.0f);
+    std::vector<glm::vec3> positions;
+    positions.reserve(counts.x * counts.y * counts.z);
+    for (int z = 0; z < counts.z; z++) {
+        for (int y = 0; y < counts.y; y++) {
+            for (int x = 0; x < counts.x; x++) {
+                positions.push_back(min + glm::vec3(x, y, z) * spacing);
+            }
+        }
+    }
+    solver.emitParticles(positions, scene.velocity);
+
+    TimestepController timestep(options.minDt, options.maxDt > 0.0f ? options.maxDt : solver.getMaxStableTimestep(), options.cfl);
+    if (options.dt > 0.0f) {
+        timestep.setBounds(options.dt, options.dt);
+    }
+    EnsembleResult result;
+    double errorSum = 0.0;
+    for (; result.steps < options.frames; result.steps++) {
+        solver.step(timestep.computeTimestep(solver.getParticles(), solver.getSmoothingLength()));
+        float error = solver.densityError();
+        if (!std::isfinite(error)) {
+            result.stable = false;
+            result.steps++;
+            break;
+        }
+        errorSum += error;
+    }
+
+    result.particles = solver.getParticles().size();
+    result.simulatedTime = solver.getSimulationTime();
+    result.densityError = solver.densityError();
+    result.meanDensityError = errorSum / std::max(result.steps, 1);
+    glm::vec2 center(min.x + 0.5f * (counts.x - 1) * spacing, min.z + 0.5f * (counts.z - 1) * spacing);
+    for (const Particle &particle : solver.getParticles()) {
+        result.maxSpeed = std::max(result.maxSpeed, glm::length(particle.velocity));
+        result.spread = std::max(result.spread, glm::length(glm::vec2(particle.position.x, particle.position.z) - center));
+        result.height = std::max(result.height, particle.position.y);
+    }
+    result.stable = result.stable && std::isfinite(result.maxSpeed) && result.maxSpeed < UNSTABLE_SPEED;
+    result.wallMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    return result;
+}
+
+bool EnsembleRunner::init(const HeadlessOptions &options) {
+    if (!_context.init()) {
+        return false;
+    }
+    _shaderProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/vertexShader.glsl", "../src/shaders/fragmentShader.glsl");
+    ThreadPool &pool = ThreadPool::instance();
+    for (unsigned int thread = 0; thread < pool.size(); thread++) {
+        _solvers.push_back(std::make_unique<SPHSolver>(std::make_shared<std::vector<Particle>>(), _shaderProgram));
+        SPHSolver &solver = *_solvers.back();
+        // sleeping scans every cell of the tank each step, far more than a small scene's particles
+        solver.setSleepingEnabled(false);
+        solver.setSolverMode(options.solver);
+        std::string parameterError;
+        if (!solver.setParameters(options.parameters, parameterError)) {
+            std::cout << "Could not set the solver parameters: " << parameterError << std::endl;
+            return false;
+        }
+        solver.setPeriodicAxes(options.periodic);
+        for (const ParticleSink &sink : options.sinks) {
+            solver.addSink(sink);
+        }
+        for (const ParticleEmitter &emitter : options.emitters) {
+            solver.addEmitter(emitter);
+        }
+        for (const ObstacleOptions &obstacle : options.obstacles) {
+            if (!solver.addCollider(obstacle.path, obstacle.motion)) {
+                std::cout << "Could not read obstacle mesh " << obstacle.path << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void EnsembleRunner::run(const std::vector<int> &order, const std::function<void(SPHSolver &solver, int index)> &job) {
+    ThreadPool &pool = ThreadPool::instance();
+    std::atomic<size_t> next(0);
+    pool.runOnEveryThread([&]() {
+        SPHSolver &solver = *_solvers[pool.threadIndex()];
+        size_t taken;
+        while ((taken = next.fetch_add(1)) < order.size()) {
+            job(solver, order[taken]);
+        }
+    });
+}
+
+int runEnsemble(const HeadlessOptions &options, const EnsembleOptions &ensemble) {
+    Clock::time_point start = Clock::now();
+    EnsembleRunner runner;
+    if (!runner.init(options)) {
+        return 1;
+    }
+    float setupMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+    int members = ensemble.members;
+    std::vector<EnsembleScene> scenes;
+    for (int member = 0; member < members; member++) {
+        scenes.push_back(sceneOf(ensemble.seed + member));
+    }
+    // biggest first, the members left over at the end are the quick ones
+    std::vector<int> order(members);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return scenes[a].volume() > scenes[b].volume(); });
+
+    std::vector<EnsembleResult> results(members);
+    std::mutex progressMutex;
+    int finished = 0;
+    int reportEvery = std::max(members / 10, 1);
+    Clock::time_point runStart = Clock::now();
+    runner.run(order, [&](SPHSolver &solver, int member) {
+        results[member] = runEnsembleScene(solver, scenes[member], options);
+        std::lock_guard<std::mutex> lock(progressMutex);
+        if (++finished % reportEvery == 0 || finished == members) {
+            std::cout << "Ensemble: " << finished << " of " << members << " members done" << std::endl;
+        }
+    });
+    float runSeconds = std::chrono::duration<float>(Clock::now() - runStart).count();
+
+    std::ofstream out(ensemble.resultsPath);
+    if (!out) {
+        std::cout << "Could not write " << ensemble.resultsPath << std::endl;
+        return 1;
+    }
+    out << "member,seed,particles,steps,simulated_time,density_error,mean_density_error,max_speed,spread,height,stable,wall_ms\n";
+    long particleSteps = 0;
+    for (int member = 0; member < members; member++) {
+        const EnsembleResult &result = results[member];
+        out << member << "," << ensemble.seed + member << "," << result.particles << "," << result.steps << ","
+            << result.simulatedTime << "," << result.densityError << "," << result.meanDensityError << "," << result.maxSpeed << ","
+            << result.spread << "," << result.height << "," << result.stable << "," << result.wallMs << "\n";
+        particleSteps += (long) result.particles * result.steps;
+    }
+
+    float totalSeconds = std::chrono::duration<float>(Clock::now() - start).count();
+    std::cout << "Ensemble of " << members << " members on " << ThreadPool::instance().size() << " threads: " << runSeconds << " s stepping, "
+              << setupMs << " ms setup, " << members / totalSeconds * 3600.0f << " sims/hour, "
+              << particleSteps / std::max(runSeconds, 1e-6f) / 1e6f << " M particle steps/s" << std::endl;
+    std::cout << "Results written to " << ensemble.resultsPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "headless.h"
+#include "sphSolver.h"
+#include "utils/HeadlessContext.h"
+
+struct EnsembleOptions {
+    int members = 0;                    // 0 runs a single scene the usual way
+    unsigned int seed = 1;              // member i draws its scene from seed + i
+    std::string resultsPath = "ensemble.csv";
+};
+
+// A block of fluid on the lattice of the solver's rest spacing
+struct EnsembleScene {
+    glm::vec3 min = glm::vec3(-0.5f, 0.1f, -2.5f);
+    glm::vec3 size = glm::vec3(1.0f, 0.6f, 1.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    float volume() const { return size.x * size.y * size.z; }
+};
+
+// Compact outcome of one scene
+struct EnsembleResult {
+    int particles = 0;
+    int steps = 0;
+    float simulatedTime = 0.0f;
+    float densityError = 0.0f;          // mean relative deviation from the rest density at the end
+    float meanDensityError = 0.0f;      // the same, averaged over the steps
+    float maxSpeed = 0.0f;
+    float spread = 0.0f;                // furthest horizontal distance of a particle from where the block started
+    float height = 0.0f;                // highest particle above the floor
+    float wallMs = 0.0f;
+    bool stable = true;                 // every value stayed finite and no particle was flung out
+};
+
+// Resets the solver, fills in the block and takes options.frames steps, fewer if the run blows up
+EnsembleResult runEnsembleScene(SPHSolver &solver, const EnsembleScene &scene, const HeadlessOptions &options);
+
+// One solver per thread of the pool, set up once from the options (solver, parameters, periodic axes, sinks,
+// inflows and obstacles; sleeping off) in a context of its own, since the meshes need GL. Stepping doesn't touch GL.
+class EnsembleRunner {
+public:
+    bool init(const HeadlessOptions &options);
+    SPHSolver &solver(int thread) { return *_solvers[thread]; }
+
+    // job(solver, index) for every index, handed out in the order given to whichever thread is free. The
+    // solvers' own parallel loops run serially inside the job, so each one stays on one thread.
+    void run(const std::vector<int> &order, const std::function<void(SPHSolver &solver, int index)> &job);
+
+private:
+    HeadlessContext _context;
+    std::shared_ptr<ShaderProgram> _shaderProgram;
+    std::vector<std::unique_ptr<SPHSolver>> _solvers;
+};
+
+// Runs many small independent scenes in one process. Every thread of the pool steps one member at a time on a
+// solver of its own that is reset between members, so the tank, its boundary samples and the per-step arrays are
+// set up once per thread instead of once per scene, and the members' passes run serially without any
+// synchronisation between threads. The biggest members are handed out first.
+// Member i is a block of fluid of random size dropped from a random height with a random velocity, drawn from
+// seed + i, so one member can be rerun alone with --ensemble 1 --seed. It takes options.frames steps with the
+// solver, timestep and obstacles of options; sleeping is off and rigid bodies aren't supported. One line per
+// member goes to the results file, in member order. Nothing is rendered.
+int runEnsemble(const HeadlessOptions &options, const EnsembleOptions &ensemble);
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,124 @@
+#include "fluidRenderer.h"
+
+FluidRenderer::FluidRenderer(int width, int height) {
+    _depthProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/fluidSpriteVertex.glsl", "../src/shaders/fluidDepthFragment.glsl");
+    _thicknessProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/fluidSpriteVertex.glsl", "../src/shaders/fluidThicknessFragment.glsl");
+    _smoothProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/fullscreenVertex.glsl", "../src/shaders/fluidSmoothFragment.glsl");
+    _shadeProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/fullscreenVertex.glsl", "../src/shaders/fluidShadeFragment.glsl");
+
+    _pointsVao.bind();
+    _pointsVbo.bind();
+    _pointsVao.linkAttrib(_pointsVbo, 0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+    _pointsVbo.unbind();
+    _pointsVao.unbind();
+
+    resize(width, height);
+}
+
+void FluidRenderer::resize(int width, int height) {
+    if (width == _width && height == _height) {
+        return;
+    }
+    _width = width;
+    _height = height;
+    _depthTarget.create(width, height, GL_R32F, GL_RED, GL_FLOAT, true);
+    _smoothTargets[0].create(width, height, GL_R32F, GL_RED, GL_FLOAT);
+    _smoothTargets[1].create(width, height, GL_R32F, GL_RED, GL_FLOAT);
+    _thicknessTarget.create(width, height, GL_R16F, GL_RED, GL_FLOAT);
+}
+
+void FluidRenderer::drawFullscreen() {
+    _fullscreenVao.bind();
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    _fullscreenVao.unbind();
+}
+
+void FluidRenderer::render(const std::vector<Particle> &particles, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &lightPos) {
+    if (particles.empty() || _width == 0 || _height == 0) {
+        return;
+    }
+
+    _positions.resize(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        _positions[i] = particles[i].position;
+    }
+    _pointsVbo.bind();
+    _pointsVbo.setBuffer(_positions, GL_STREAM_DRAW);
+    _pointsVbo.unbind();
+
+    GLint previousViewport[4];
+    GLint previousFramebuffer;
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glViewport(0, 0, _width, _height);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glEnable(GL_DEPTH_TEST);
+    const float pointRadius = Particle::Radius();
+
+    // nearest sphere depth
+    _depthTarget.bind();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    _depthProgram->use();
+    _depthProgram->setMat4("view", view);
+    _depthProgram->setMat4("projection", projection);
+    _depthProgram->set("pointRadius", pointRadius);
+    _depthProgram->set("screenHeight", (float) _height);
+    _pointsVao.bind();
+    glDrawArrays(GL_POINTS, 0, (GLsizei) _positions.size());
+
+    // accumulated thickness, no depth test so hidden particles count too
+    _thicknessTarget.bind();
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    _thicknessProgram->use();
+    _thicknessProgram->setMat4("view", view);
+    _thicknessProgram->setMat4("projection", projection);
+    _thicknessProgram->set("pointRadius", pointRadius);
+    _thicknessProgram->set("screenHeight", (float) _height);
+    glDrawArrays(GL_POINTS, 0, (GLsizei) _positions.size());
+    _pointsVao.unbind();
+    glDisable(GL_BLEND);
+
+    // separable smoothing, horizontal then vertical
+    _smoothProgram->use();
+    _smoothProgram->set("depthTexture", 0);
+    _smoothProgram->set("filterRadius", _filterRadius);
+    _smoothProgram->set("depthFalloff", _depthFalloff);
+    glActiveTexture(GL_TEXTURE0);
+    GLuint source = _depthTarget.getTexture();
+    for (int i = 0; i < _smoothingIterations * 2; i++) {
+        FBO &target = _smoothTargets[i % 2];
+        target.bind();
+        glBindTexture(GL_TEXTURE_2D, source);
+        _smoothProgram->set("direction", i % 2 == 0 ? glm::vec2(1.0f / _width, 0.0f) : glm::vec2(0.0f, 1.0f / _height));
+        drawFullscreen();
+        source = target.getTexture();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    // shade into the scene, writing depth so it composes with the planes
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    _shadeProgram->use();
+    _shadeProgram->set("depthTexture", 0);
+    _shadeProgram->set("thicknessTexture", 1);
+    _shadeProgram->setMat4("projection", projection);
+    _shadeProgram->set("texelSize", glm::vec2(1.0f / _width, 1.0f / _height));
+    _shadeProgram->setVec3("lightPos", glm::vec3(view * glm::vec4(lightPos, 1.0f)));
+    _shadeProgram->set("fluidColor", _fluidColor);
+    _shadeProgram->set("absorption", _absorption);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _thicknessTarget.getTexture());
+    drawFullscreen();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_BLEND);
+}
@@ -0,0 +1,58 @@
+#ifndef FLUID_RENDERER_H
+#define FLUID_RENDERER_H
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "Particle.h"
+#include "utils/ShaderProgram.h"
+#include "utils/buffer/FBO.h"
+#include "utils/buffer/VAO.h"
+#include "utils/buffer/VBO.h"
+
+// Screen-space fluid rendering: particles are drawn as sphere sprites into a depth and a thickness
+// target, the depth is smoothed with a separable bilateral filter and the surface is shaded from it
+// in a full screen pass. Apart from uploading the positions, the cost only depends on the resolution.
+class FluidRenderer {
+public:
+    FluidRenderer(int width, int height);
+
+    // Reallocates the offscreen targets when the framebuffer size changes
+    void resize(int width, int height);
+
+    // Draws on top of what is already in the bound framebuffer, depth tested against it
+    void render(const std::vector<Particle> &particles, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &lightPos);
+
+    void setSmoothingIterations(int iterations) { _smoothingIterations = iterations; }
+    void setFilterRadius(int radius) { _filterRadius = radius; }
+    void setFluidColor(const glm::vec4 &color) { _fluidColor = color; }
+
+private:
+    void drawFullscreen();
+
+    std::shared_ptr<ShaderProgram> _depthProgram;
+    std::shared_ptr<ShaderProgram> _thicknessProgram;
+    std::shared_ptr<ShaderProgram> _smoothProgram;
+    std::shared_ptr<ShaderProgram> _shadeProgram;
+
+    FBO _depthTarget;
+    FBO _smoothTargets[2];
+    FBO _thicknessTarget;
+
+    VAO _pointsVao;
+    VBO _pointsVbo;
+    VAO _fullscreenVao;
+    std::vector<glm::vec3> _positions;
+
+    int _width = 0;
+    int _height = 0;
+    int _smoothingIterations = 3;
+    int _filterRadius = 8;
+    float _depthFalloff = 0.05f;
+    float _absorption = 1.5f;
+    glm::vec4 _fluidColor = glm::vec4(0.1f, 0.4f, 0.9f, 1.0f);
+};
+
+#endif // FLUID_RENDERER_H
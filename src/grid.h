@@ -1,8 +1,14 @@
 #ifndef GRID_H
 #define GRID_H
 
-#include "sphSolver.h"
-#include "particle.h"
+#include <array>
+#include <cmath>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "Particle.h"
+#include "utils/ThreadPool.h"
 
 enum direction {
     X,
@@ -11,7 +17,11 @@ enum direction {
 };
 
 struct Grid {
-    std::vector<std::vector<int>> grid; // maps a grid cell index to a list of particle indices
+    // The cell lists come from a pool, so a cell growing past its capacity mostly gets memory the pool already
+    // holds, and once every cell has seen its fullest moving particles between cells doesn't allocate at all.
+    // Cells are only changed from one thread at a time. A copy of the grid allocates its cells the usual way.
+    std::shared_ptr<std::pmr::unsynchronized_pool_resource> cellStorage;
+    std::pmr::vector<std::pmr::vector<int>> grid; // maps a grid cell index to a list of particle indices
     int num_cells_x;
     int num_cells_y;
     int num_cells_z;
@@ -19,10 +29,12 @@ struct Grid {
     float Depth;
     float Height;
     float size;
+    glm::vec3 origin = glm::vec3(0.0f);  // corner of cell (0, 0, 0)
+    glm::bvec3 periodic = glm::bvec3(false);  // axes that wrap around, Width/Height/Depth is the period
     std::shared_ptr<std::vector<Particle>> particles;
     std::vector<std::array<int, 26>> neighbours;
 
-    std::vector<std::vector<int>>* getGrid() {
+    std::pmr::vector<std::pmr::vector<int>>* getGrid() {
         return &grid;
     }
 
@@ -37,12 +49,14 @@ struct Grid {
          RigidPlane Rightplane,
          RigidPlaneInvisible Frontplane,
          int height,
-         std::shared_ptr<std::vector<Particle>> particles) : particles(particles) {
+         std::shared_ptr<std::vector<Particle>> particles) :
+            cellStorage(std::make_shared<std::pmr::unsynchronized_pool_resource>()), grid(cellStorage.get()), particles(particles) {
         float r = Particle::Radius();
         size = 2 * r;
         Width = Rightplane.position.x - Leftplane.position.x;
         Depth = Frontplane.position.z - Backplane.position.z;
         Height = height;
+        origin = glm::vec3(Leftplane.position.x, Yplane.position.y, Backplane.position.z);
         num_cells_x = Width / size;
         num_cells_y = Height / size;
         num_cells_z = Depth / size;
@@ -57,30 +71,103 @@ struct Grid {
         }
     }
 
+    // Periodic axes wrap the neighbour table around instead of ending at the border, no ghost copies are made
+    void setPeriodic(glm::bvec3 axes) {
+        periodic = axes;
+        neighbours.clear();
+        precomputeNeighbours();
+    }
+
+    // Offset from b to a, on periodic axes the shortest one across the seam (minimum image)
+    glm::vec3 separation(const glm::vec3 &a, const glm::vec3 &b) const {
+        glm::vec3 offset = a - b;
+        if (periodic.x) {
+            offset.x -= Width * std::round(offset.x / Width);
+        }
+        if (periodic.y) {
+            offset.y -= Height * std::round(offset.y / Height);
+        }
+        if (periodic.z) {
+            offset.z -= Depth * std::round(offset.z / Depth);
+        }
+        return offset;
+    }
+
+    // Brings a position back into [origin, origin + period) on the periodic axes
+    void wrap(glm::vec3 &position) const {
+        glm::vec3 period(Width, Height, Depth);
+        for (int axis = 0; axis < 3; axis++) {
+            if (periodic[axis]) {
+                float local = position[axis] - origin[axis];
+                position[axis] = origin[axis] + local - period[axis] * std::floor(local / period[axis]);
+            }
+        }
+    }
+
     std::array<int, 26> getNeighbours(int index) {
         return neighbours[index];
     }
 
-    void recomputeParticleIndex(int particle_id, int index) {
-        Particle &particle = (*particles)[particle_id];
-        int i = (particle.position.x + Width / 2) / size;
-        int j = (particle.position.y) / size;
-        int k = (particle.position.z + Depth / 2) / size;
+    int cellIndexOf(const glm::vec3 &position) {
+        glm::vec3 local = (position - origin) / size;
+        // floor, a plain int cast would round -0.5 up into the first cell
+        int i = (int) std::floor(local.x);
+        int j = (int) std::floor(local.y);
+        int k = (int) std::floor(local.z);
         fixIndex(i, X);
         fixIndex(j, Y);
         fixIndex(k, Z);
-        int newIndex = getIndexInGrid(i, j, k, num_cells_x, num_cells_y);
+        return getIndexInGrid(i, j, k, num_cells_x, num_cells_y);
+    }
+
+    void recomputeParticleIndex(int particle_id, int index) {
+        Particle &particle = (*particles)[particle_id];
+        int newIndex = cellIndexOf(particle.position);
         if (index == newIndex) {
             return;
         }
         if (validIndex(index)) {
             removeParticleFromGrid(particle_id, index);
         }
-        int sizeofparticles = particles->size();
         grid[newIndex].push_back(particle_id);
         particle.setGridIndex(newIndex);
     }
 
+    // Empties every cell, the particles are inserted again with insertParticles
+    void clearParticles() {
+        for (std::pmr::vector<int> &cell : grid) {
+            cell.clear();
+        }
+    }
+
+    // Inserts the particles [first, last) in one pass, the cells are computed in parallel
+    void insertParticles(int first, int last) {
+        ThreadPool::instance().parallelFor(first, last, [&](int begin, int end) {
+            for (int p = begin; p < end; p++) {
+                (*particles)[p].setGridIndex(cellIndexOf((*particles)[p].position));
+            }
+        }, 4096);
+        for (int p = first; p < last; p++) {
+            grid[(*particles)[p].gridIndex].push_back(p);
+        }
+    }
+
+    // Calls f(particleId) for every particle in the cell and its 26 neighbours
+    template <typename F>
+    void forEachNeighbour(int index, F &&f) const {
+        for (int id : grid[index]) {
+            f(id);
+        }
+        for (int neighbour : neighbours[index]) {
+            if (neighbour == -1) {
+                continue;
+            }
+            for (int id : grid[neighbour]) {
+                f(id);
+            }
+        }
+    }
+
     bool validIndex(int index) {
         std::array<int, 3> coords = getGridfromIndex(index, num_cells_x, num_cells_y);
         return coords[0] >= 0 && coords[0] < num_cells_x &&
@@ -114,11 +201,7 @@ struct Grid {
         
 
         for (Particle &particle : *particles) {
-            float r = Particle::Radius();
-            int i = (particle.position.x + Width / 2) / 2 * r;
-            int j = (particle.position.y) / 2 * r;
-            int k = (particle.position.z + Depth / 2) / 2 * r;
-            int index = getIndexInGrid(i, j, k, num_cells_x, num_cells_y);
+            int index = cellIndexOf(particle.position);
             grid[index].push_back(particle.id);
             particle.setGridIndex(index);
         }
@@ -144,6 +227,16 @@ struct Grid {
         }
     }
 
+    // Renames a particle in its cell after it moved to another slot of the particle vector
+    void renameParticle(int old_id, int new_id, int index) {
+        for (int &id : grid[index]) {
+            if (id == old_id) {
+                id = new_id;
+                break;
+            }
+        }
+    }
+
     bool inGrid(int particle_id, int index) {
         for (int i = 0; i < grid[index].size(); i++) {
             if (grid[index][i] == particle_id) {
@@ -186,6 +279,15 @@ struct Grid {
     }
 
     int getValidIndexInGrid(int i, int j, int k, int num_cells_x, int num_cells_y, int num_cells_z) {
+        if (periodic.x) {
+            i = (i + num_cells_x) % num_cells_x;
+        }
+        if (periodic.y) {
+            j = (j + num_cells_y) % num_cells_y;
+        }
+        if (periodic.z) {
+            k = (k + num_cells_z) % num_cells_z;
+        }
         // First check if coordinates are within bounds
         if (i < 0 || i >= num_cells_x || 
             j < 0 || j >= num_cells_y || 
@@ -0,0 +1,242 @@
+#include "headless.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include "utils/HeadlessContext.h"
+#include "utils/Camera.h"
+#include "utils/Numa.h"
+#include "utils/ThreadPool.h"
+#include "utils/util.h"
+#include "sphSolver.h"
+#include "fluidRenderer.h"
+#include "timestepController.h"
+
+namespace {
+    const char *placementName(MemoryPlacement placement) {
+        switch (placement) {
+        case PLACEMENT_INTERLEAVED:
+            return "interleaved";
+        case PLACEMENT_LOCAL:
+            return "local";
+        default:
+            return "first touch";
+        }
+    }
+
+    // Pins the shared pool node by node for the placements that need it, false if NUMA isn't available
+    bool preparePlacement(MemoryPlacement placement) {
+        if (placement == PLACEMENT_FIRST_TOUCH) {
+            if (ThreadPool::instance().isPinned()) {
+                ThreadPool::instance().pinThreads({});
+            }
+            return true;
+        }
+        if (!Numa::available()) {
+            std::cout << "NUMA placement needs libnuma (-DFLUID_NUMA=ON) and a kernel with NUMA support" << std::endl;
+            return false;
+        }
+        ThreadPool::instance().pinThreads(Numa::cpusByNode());
+        return true;
+    }
+}
+
+int runHeadless(const HeadlessOptions &options) {
+    HeadlessContext context;
+    if (!context.init()) {
+        return 1;
+    }
+    if (!preparePlacement(options.placement)) {
+        return 1;
+    }
+
+    std::shared_ptr<ShaderProgram> shaderProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/vertexShader.glsl", "../src/shaders/fragmentShader.glsl");
+    std::shared_ptr<std::vector<Particle>> particles = std::make_shared<std::vector<Particle>>();
+    SPHSolver sphSolver(particles, shaderProgram);
+    sphSolver.setSleepingEnabled(options.sleeping);
+    sphSolver.setSolverMode(options.solver);
+    std::string parameterError;
+    if (!sphSolver.setParameters(options.parameters, parameterError)) {
+        std::cout << "Could not set the solver parameters: " << parameterError << std::endl;
+        return 1;
+    }
+    TimestepController timestep(options.minDt, options.maxDt > 0.0f ? options.maxDt : sphSolver.getMaxStableTimestep(), options.cfl);
+    if (options.dt > 0.0f) {
+        timestep.setBounds(options.dt, options.dt);
+    }
+    sphSolver.setPeriodicAxes(options.periodic);
+    sphSolver.setMemoryPlacement(options.placement);
+    sphSolver.setTaskGraph(options.taskGraph);
+    for (const ObstacleOptions &obstacle : options.obstacles) {
+        if (!sphSolver.addCollider(obstacle.path, obstacle.motion)) {
+            std::cout << "Could not read obstacle mesh " << obstacle.path << std::endl;
+            return 1;
+        }
+    }
+    for (const RigidBodyOptions &body : options.bodies) {
+        if (!sphSolver.addRigidBody(body.path, body.relativeDensity)) {
+            std::cout << "Could not read rigid body mesh " << body.path << std::endl;
+            return 1;
+        }
+    }
+    for (const ParticleSink &sink : options.sinks) {
+        sphSolver.addSink(sink);
+    }
+    for (const ParticleEmitter &emitter : options.emitters) {
+        sphSolver.addEmitter(emitter);
+    }
+    if (options.maxParticles > 0) {
+        sphSolver.setMaxParticles(options.maxParticles);
+    }
+    if (options.fillTank) {
+        sphSolver.fillBox(glm::vec3(-1.0f, 0.0f, -2.0f), glm::vec3(1.0f, 0.8f, 0.0f), options.packing, options.stateCache);
+    } else if (options.emitters.empty()) {
+        sphSolver.spawnParticles();
+    }
+
+    Camera camera(glm::vec3(0.0f, 1.0f, 5.0f));
+    glm::vec3 lightPos(0.0f, 2.0f, 1.0f);
+    glm::mat4 view = camera.getViewMatrix();
+    glm::mat4 projection = camera.getProjectionMatrix((float) options.width / (float) options.height);
+
+    std::unique_ptr<FluidRenderer> fluidRenderer;
+    if (options.screenSpace) {
+        fluidRenderer = std::make_unique<FluidRenderer>(options.width, options.height);
+    }
+    FrameRecorder recorder(options.width, options.height, options.outputPath, options.format);
+    std::ofstream log(options.outputPath + "/timesteps.csv");
+    timestep.setLog(&log);
+    ShaderProgram::printLoadStats();
+
+    glEnable(GL_DEPTH_TEST);
+    auto start = std::chrono::high_resolution_clock::now();
+    float updateMs = 0.0f;
+    long pressureIterations = 0;
+    // counted over the second half of the run, once the arrays, cells and scratch arenas have grown to size
+    unsigned long long warmAllocations = 0;
+    unsigned long long maxAllocations = 0;
+    // with inflow or outflow the second half of the run is compared with the first, they match in steady state
+    float firstHalfMs = 0.0f;
+    size_t middleParticles = 0;
+    size_t middleMemory = 0;
+    for (int frame = 0; frame < options.frames; frame++) {
+        if (options.spawnEvery > 0 && frame > 0 && frame % options.spawnEvery == 0) {
+            sphSolver.spawnParticles();
+        }
+        recorder.beginFrame();
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shaderProgram->use();
+        shaderProgram->setMat4("view", view);
+        shaderProgram->setVec3("lightPos", lightPos);
+        shaderProgram->setMat4("projection", projection);
+        sphSolver.setDrawParticles(!options.screenSpace);
+        auto updateStart = std::chrono::high_resolution_clock::now();
+        sphSolver.update(timestep.computeTimestep(*particles, sphSolver.getSmoothingLength()));
+        updateMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - updateStart).count();
+        pressureIterations += sphSolver.getPressureSolverStats().iterations;
+        if (frame >= options.frames / 2) {
+            warmAllocations += sphSolver.getStepAllocations();
+            maxAllocations = std::max(maxAllocations, sphSolver.getStepAllocations());
+        }
+        if (frame == options.frames / 2 - 1) {
+            firstHalfMs = updateMs;
+            middleParticles = particles->size();
+            middleMemory = residentMemoryBytes();
+        }
+        if (fluidRenderer) {
+            fluidRenderer->render(*particles, view, projection, lightPos);
+        }
+        recorder.endFrame();
+    }
+    recorder.finish();
+
+    float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Recorded " << recorder.getFrameCount() << " frames to " << options.outputPath << " in " << seconds
+              << " s (" << recorder.getFrameCount() / seconds << " fps)" << std::endl;
+    std::cout << "Simulated " << timestep.getTime() << " s" << std::endl;
+    std::cout << "Solver update: " << updateMs / std::max(options.frames, 1) << " ms per frame, " << sphSolver.getSleepingParticleCount()
+              << " of " << particles->size() << " particles asleep at the end" << std::endl;
+    if (!options.sinks.empty() || !options.emitters.empty()) {
+        int firstHalf = std::max(options.frames / 2, 1);
+        int secondHalf = std::max(options.frames - options.frames / 2, 1);
+        std::cout << "Flow: " << sphSolver.getEmittedParticleCount() << " particles emitted, " << sphSolver.getRemovedParticleCount()
+                  << " removed; from the middle to the end " << middleParticles << " -> " << particles->size() << " particles, "
+                  << firstHalfMs / firstHalf << " -> " << (updateMs - firstHalfMs) / secondHalf << " ms per frame, "
+                  << middleMemory / (1024 * 1024) << " -> " << residentMemoryBytes() / (1024 * 1024) << " MB resident" << std::endl;
+    }
+    int warmFrames = options.frames - options.frames / 2;
+    std::cout << "Allocations: " << (float) warmAllocations / std::max(warmFrames, 1) << " per step after warm-up, at most " << maxAllocations
+              << ", " << sphSolver.getScratchCapacity() / 1024 << " KB of scratch arenas" << std::endl;
+    if (options.solver != SOLVER_CONTACT) {
+        std::cout << "Pressure solver: " << (float) pressureIterations / std::max(options.frames, 1) << " iterations per step, last density error "
+                  << sphSolver.getPressureSolverStats().densityError * 100.0f << "%" << std::endl;
+    }
+    if (sphSolver.isTaskGraphEnabled()) {
+        sphSolver.getTaskGraphProfile().print(std::cout);
+    }
+    for (const RigidBody &body : sphSolver.getRigidBodies()) {
+        glm::vec3 position = body.getPosition();
+        std::cout << "Rigid body at (" << position.x << ", " << position.y << ", " << position.z << "), speed " << glm::length(body.getVelocity()) << std::endl;
+    }
+    return 0;
+}
+
+int runPlacementBenchmark(const HeadlessOptions &options) {
+    HeadlessContext context;
+    if (!context.init()) {
+        return 1;
+    }
+    if (!Numa::available()) {
+        std::cout << "NUMA placement needs libnuma (-DFLUID_NUMA=ON) and a kernel with NUMA support" << std::endl;
+        return 1;
+    }
+    std::shared_ptr<ShaderProgram> shaderProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/vertexShader.glsl", "../src/shaders/fragmentShader.glsl");
+
+    const MemoryPlacement placements[] = {PLACEMENT_FIRST_TOUCH, PLACEMENT_INTERLEAVED, PLACEMENT_LOCAL};
+    float stepMs[3] = {};
+    size_t particleCount = 0;
+    for (int run = 0; run < 3; run++) {
+        preparePlacement(placements[run]);
+        std::shared_ptr<std::vector<Particle>> particles = std::make_shared<std::vector<Particle>>();
+        SPHSolver sphSolver(particles, shaderProgram);
+        sphSolver.setSleepingEnabled(options.sleeping);
+        sphSolver.setSolverMode(options.solver);
+        std::string parameterError;
+        if (!sphSolver.setParameters(options.parameters, parameterError)) {
+            std::cout << "Could not set the solver parameters: " << parameterError << std::endl;
+            return 1;
+        }
+        sphSolver.setPeriodicAxes(options.periodic);
+        sphSolver.setMemoryPlacement(placements[run]);
+        // large enough that the particle arrays don't fit in the caches
+        sphSolver.fillBox(glm::vec3(-4.0f, 0.0f, -3.0f), glm::vec3(4.0f, 0.8f, 0.0f), options.packing);
+        particleCount = particles->size();
+        float dt = options.dt > 0.0f ? options.dt : sphSolver.getMaxStableTimestep();
+
+        // the first steps sort and place the arrays, they aren't timed
+        for (int frame = 0; frame < 2; frame++) {
+            sphSolver.step(dt);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int frame = 0; frame < options.frames; frame++) {
+            sphSolver.step(dt);
+        }
+        stepMs[run] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / std::max(options.frames, 1);
+    }
+    preparePlacement(PLACEMENT_FIRST_TOUCH);
+
+    std::cout << "Memory placement over " << Numa::nodeCount() << " NUMA nodes and " << ThreadPool::instance().size() << " threads, "
+              << particleCount << " particles, " << options.frames << " steps:\n"
+              << std::setw(13) << "placement" << std::setw(10) << "ms/step" << std::setw(16) << "vs interleaved" << "\n";
+    for (int run = 0; run < 3; run++) {
+        std::cout << std::fixed << std::setprecision(2) << std::setw(13) << placementName(placements[run]) << std::setw(10) << stepMs[run]
+                  << std::setw(15) << stepMs[1] / stepMs[run] << "x\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
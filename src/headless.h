@@ -0,0 +1,57 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+#include <vector>
+
+#include "utils/FrameRecorder.h"
+#include "initialConditions.h"
+#include "sphSolver.h"
+
+struct ObstacleOptions {
+    std::string path;           // OBJ mesh
+    KinematicMotion motion;
+};
+
+struct RigidBodyOptions {
+    std::string path;           // OBJ mesh
+    float relativeDensity = 0.5f;
+};
+
+struct HeadlessOptions {
+    int width = 1280;
+    int height = 720;
+    int frames = 300;
+    float dt = 0.0f;            // fixed timestep, 0 picks every step's dt adaptively within [minDt, maxDt]
+    float minDt = 0.0005f;
+    float maxDt = 0.0f;         // 0 uses the solver's stable limit
+    float cfl = 0.4f;
+    int spawnEvery = 0;         // spawn a new block every n frames, 0 spawns a single block at start
+    bool screenSpace = false;   // screen-space fluid instead of spheres
+    bool fillTank = false;      // start from a tank filled at rest density instead of a single block
+    PackingMode packing = PACKING_LATTICE;
+    std::string stateCache;     // relax the tank once and keep the settled state in this directory
+    bool sleeping = true;       // freeze settled grid cells
+    SolverMode solver = SOLVER_CONTACT;
+    glm::bvec3 periodic = glm::bvec3(false);  // axes the fluid wraps around
+    MemoryPlacement placement = PLACEMENT_FIRST_TOUCH;  // other than first touch the threads are pinned node by node
+    bool taskGraph = false;     // PBF steps run as a task graph, its profile is printed at the end
+    std::vector<std::pair<std::string, double>> parameters;     // solver constants by name, see SPHSolver::setParameter
+    std::vector<ObstacleOptions> obstacles;
+    std::vector<RigidBodyOptions> bodies;
+    std::vector<ParticleSink> sinks;    // boxes and outflow planes the fluid is removed through
+    std::vector<ParticleEmitter> emitters;  // inflow, without --fill the run starts from an empty tank then
+    size_t maxParticles = 0;            // cap for the emitters, every per-particle array is reserved for it
+    std::string outputPath = "frames";
+    FrameFormat format = FRAME_PNG;
+};
+
+// Runs the simulation without a window and records every frame to disk, one solver step per frame.
+// The dt series is written to timesteps.csv next to the frames.
+int runHeadless(const HeadlessOptions &options);
+
+// Steps the same tank with first-touch, interleaved and local placement and prints the time per step of each,
+// nothing is rendered
+int runPlacementBenchmark(const HeadlessOptions &options);
+
+#endif // HEADLESS_H
@@ -0,0 +1,175 @@
+#include "initialConditions.h"
+#include "kernels.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+namespace {
+    const char stateMagic[4] = {'F', 'S', 'I', 'S'};
+    const uint32_t stateVersion = 1;
+
+    float latticeDensity(float spacing, float mass, float h) {
+        int reach = (int) std::ceil(h / spacing);
+        float density = 0.0f;
+        for (int z = -reach; z <= reach; z++) {
+            for (int y = -reach; y <= reach; y++) {
+                for (int x = -reach; x <= reach; x++) {
+                    glm::vec3 offset = glm::vec3(x, y, z) * spacing;
+                    density += mass * poly6(glm::dot(offset, offset), h);
+                }
+            }
+        }
+        return density;
+    }
+
+    std::vector<glm::vec3> bridson(glm::vec3 min, glm::vec3 max, float distance, unsigned int seed) {
+        const int attempts = 30;
+        float cellSize = distance / std::sqrt(3.0f);
+        glm::vec3 extent = max - min;
+        glm::ivec3 dims = glm::max(glm::ivec3(glm::ceil(extent / cellSize)), glm::ivec3(1));
+        std::vector<int> cells(dims.x * dims.y * dims.z, -1);
+        auto cellOf = [&](glm::vec3 p) {
+            return glm::clamp(glm::ivec3((p - min) / cellSize), glm::ivec3(0), dims - 1);
+        };
+
+        std::vector<glm::vec3> points;
+        std::vector<int> active;
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        auto add = [&](glm::vec3 p) {
+            glm::ivec3 c = cellOf(p);
+            cells[c.x + dims.x * (c.y + dims.y * c.z)] = points.size();
+            active.push_back(points.size());
+            points.push_back(p);
+        };
+        auto farEnough = [&](glm::vec3 p) {
+            glm::ivec3 c = cellOf(p);
+            glm::ivec3 lo = glm::max(c - 2, glm::ivec3(0));
+            glm::ivec3 hi = glm::min(c + 2, dims - 1);
+            for (int z = lo.z; z <= hi.z; z++) {
+                for (int y = lo.y; y <= hi.y; y++) {
+                    for (int x = lo.x; x <= hi.x; x++) {
+                        int other = cells[x + dims.x * (y + dims.y * z)];
+                        if (other != -1 && glm::dot(points[other] - p, points[other] - p) < distance * distance) {
+                            return false;
+                        }
+                    }
+                }
+            }
+            return true;
+        };
+
+        add(min + glm::vec3(unit(random), unit(random), unit(random)) * extent);
+        while (!active.empty()) {
+            int slot = std::uniform_int_distribution<int>(0, active.size() - 1)(random);
+            glm::vec3 origin = points[active[slot]];
+            bool found = false;
+            for (int attempt = 0; attempt < attempts && !found; attempt++) {
+                // uniform direction, radius in [distance, 2 distance)
+                float cosTheta = 2.0f * unit(random) - 1.0f;
+                float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+                float phi = 2.0f * glm::pi<float>() * unit(random);
+                float radius = distance * (1.0f + unit(random));
+                glm::vec3 candidate = origin + radius * glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+                if (glm::all(glm::greaterThanEqual(candidate, min)) && glm::all(glm::lessThanEqual(candidate, max)) && farEnough(candidate)) {
+                    add(candidate);
+                    found = true;
+                }
+            }
+            if (!found) {
+                active[slot] = active.back();
+                active.pop_back();
+            }
+        }
+        return points;
+    }
+}
+
+float latticeRestSpacing(float mass, float restDensity, float h) {
+    // density only grows as the lattice gets denser, so bisect between a very dense lattice and one with no neighbours
+    float dense = 0.1f * h;
+    float sparse = h;
+    if (latticeDensity(sparse, mass, h) >= restDensity) {
+        return sparse;
+    }
+    for (int i = 0; i < 40; i++) {
+        float middle = 0.5f * (dense + sparse);
+        if (latticeDensity(middle, mass, h) > restDensity) {
+            dense = middle;
+        } else {
+            sparse = middle;
+        }
+    }
+    return 0.5f * (dense + sparse);
+}
+
+std::vector<glm::vec3> latticeFill(glm::vec3 min, glm::vec3 max, float spacing) {
+    glm::ivec3 counts = glm::max(glm::ivec3(glm::floor((max - min) / spacing + 1e-4f)), glm::ivec3(0));
+    std::vector<glm::vec3> positions;
+    positions.reserve(counts.x * counts.y * counts.z);
+    for (int z = 0; z < counts.z; z++) {
+        for (int y = 0; y < counts.y; y++) {
+            for (int x = 0; x < counts.x; x++) {
+                positions.push_back(min + (glm::vec3(x, y, z) + 0.5f) * spacing);
+            }
+        }
+    }
+    return positions;
+}
+
+std::vector<glm::vec3> poissonDiskFill(glm::vec3 min, glm::vec3 max, float spacing, unsigned int seed) {
+    glm::vec3 inner = max - min - spacing;
+    if (glm::any(glm::lessThan(inner, glm::vec3(0.0f)))) {
+        return {};
+    }
+    glm::ivec3 counts = glm::ivec3(glm::floor((max - min) / spacing + 1e-4f));
+    float target = (float) counts.x * counts.y * counts.z;
+
+    // a maximal 3D Poisson-disk set holds about 0.67 / d^3 points per unit volume, one correction pass fixes the rest
+    float distance = spacing * std::cbrt(0.67f);
+    std::vector<glm::vec3> points = bridson(min + 0.5f * spacing, max - 0.5f * spacing, distance, seed);
+    if (!points.empty()) {
+        distance *= std::cbrt(points.size() / target);
+        points = bridson(min + 0.5f * spacing, max - 0.5f * spacing, distance, seed);
+    }
+    return points;
+}
+
+bool loadParticleState(const std::string &path, std::vector<glm::vec3> &positions, std::vector<glm::vec3> &velocities) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    input.read(magic, sizeof(magic));
+    input.read(reinterpret_cast<char *>(&version), sizeof(version));
+    input.read(reinterpret_cast<char *>(&count), sizeof(count));
+    if (!input || std::memcmp(magic, stateMagic, sizeof(magic)) != 0 || version != stateVersion) {
+        return false;
+    }
+    positions.resize(count);
+    velocities.resize(count);
+    input.read(reinterpret_cast<char *>(positions.data()), count * sizeof(glm::vec3));
+    input.read(reinterpret_cast<char *>(velocities.data()), count * sizeof(glm::vec3));
+    return (bool) input;
+}
+
+bool saveParticleState(const std::string &path, const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &velocities) {
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return false;
+    }
+    uint64_t count = positions.size();
+    output.write(stateMagic, sizeof(stateMagic));
+    output.write(reinterpret_cast<const char *>(&stateVersion), sizeof(stateVersion));
+    output.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    output.write(reinterpret_cast<const char *>(positions.data()), count * sizeof(glm::vec3));
+    output.write(reinterpret_cast<const char *>(velocities.data()), count * sizeof(glm::vec3));
+    return (bool) output;
+}
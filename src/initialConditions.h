@@ -0,0 +1,27 @@
+#ifndef INITIAL_CONDITIONS_H
+#define INITIAL_CONDITIONS_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+enum PackingMode {
+    PACKING_LATTICE,
+    PACKING_POISSON
+};
+
+// Spacing of an infinite cubic lattice whose kernel-summed density is restDensity, found by bisection
+float latticeRestSpacing(float mass, float restDensity, float h);
+
+// Cubic lattice filling [min, max], points sit half a spacing away from the faces of the box
+std::vector<glm::vec3> latticeFill(glm::vec3 min, glm::vec3 max, float spacing);
+
+// Poisson-disk samples of [min, max] (Bridson 2007) with about the particle count of latticeFill for the same spacing
+std::vector<glm::vec3> poissonDiskFill(glm::vec3 min, glm::vec3 max, float spacing, unsigned int seed = 1);
+
+// Settled particle states, a small binary file per scene
+bool loadParticleState(const std::string &path, std::vector<glm::vec3> &positions, std::vector<glm::vec3> &velocities);
+bool saveParticleState(const std::string &path, const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &velocities);
+
+#endif // INITIAL_CONDITIONS_H
@@ -0,0 +1,35 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// SPH smoothing kernels from Müller et al. 2003, h is the support radius
+
+inline float poly6(float r2, float h) {
+    float h2 = h * h;
+    if (r2 >= h2) {
+        return 0.0f;
+    }
+    float x = h2 - r2;
+    return 315.0f / (64.0f * glm::pi<float>() * glm::pow(h, 9.0f)) * x * x * x;
+}
+
+// Gradient of the spiky kernel with respect to the first particle, r = xi - xj
+inline glm::vec3 spikyGradient(const glm::vec3 &r, float h) {
+    float length = glm::length(r);
+    if (length >= h || length <= 1e-6f) {
+        return glm::vec3(0.0f);
+    }
+    float x = h - length;
+    return -45.0f / (glm::pi<float>() * glm::pow(h, 6.0f)) * x * x * (r / length);
+}
+
+inline float viscosityLaplacian(float r, float h) {
+    if (r >= h) {
+        return 0.0f;
+    }
+    return 45.0f / (glm::pi<float>() * glm::pow(h, 6.0f)) * (h - r);
+}
+
+#endif // KERNELS_H
@@ -0,0 +1,57 @@
+#ifndef KINEMATIC_MOTION_H
+#define KINEMATIC_MOTION_H
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Scripted rigid motion of an obstacle. The mesh turns about pivot (mesh coordinates) around axis by
+// angularSpeed * t + angularAmplitude * sin(2 pi angularFrequency t), then moves by
+// velocity * t + amplitude * sin(2 pi frequency t + phase). The default is at rest.
+struct KinematicMotion {
+    glm::vec3 velocity = glm::vec3(0.0f);
+    glm::vec3 amplitude = glm::vec3(0.0f);
+    float frequency = 0.0f;
+    float phase = 0.0f;
+    glm::vec3 pivot = glm::vec3(0.0f);
+    glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float angularSpeed = 0.0f;          // rad/s
+    float angularAmplitude = 0.0f;      // rad
+    float angularFrequency = 0.0f;
+
+    bool isStatic() const {
+        return velocity == glm::vec3(0.0f) && (amplitude == glm::vec3(0.0f) || frequency == 0.0f) &&
+               angularSpeed == 0.0f && (angularAmplitude == 0.0f || angularFrequency == 0.0f);
+    }
+
+    glm::vec3 offset(float t) const {
+        return velocity * t + amplitude * std::sin(2.0f * glm::pi<float>() * frequency * t + phase);
+    }
+    glm::vec3 offsetRate(float t) const {
+        float omega = 2.0f * glm::pi<float>() * frequency;
+        return velocity + amplitude * omega * std::cos(omega * t + phase);
+    }
+    float angle(float t) const {
+        return angularSpeed * t + angularAmplitude * std::sin(2.0f * glm::pi<float>() * angularFrequency * t);
+    }
+    float angleRate(float t) const {
+        float omega = 2.0f * glm::pi<float>() * angularFrequency;
+        return angularSpeed + angularAmplitude * omega * std::cos(omega * t);
+    }
+
+    // world = rotation * mesh + translation at time t
+    void pose(float t, glm::mat3 &rotation, glm::vec3 &translation) const {
+        rotation = glm::mat3(glm::rotate(glm::mat4(1.0f), angle(t), glm::normalize(axis)));
+        translation = pivot - rotation * pivot + offset(t);
+    }
+    // Linear velocity of the moved pivot and angular velocity about it
+    void rates(float t, glm::vec3 &linear, glm::vec3 &angular, glm::vec3 &center) const {
+        linear = offsetRate(t);
+        angular = angleRate(t) * glm::normalize(axis);
+        center = pivot + offset(t);
+    }
+};
+
+#endif // KINEMATIC_MOTION_H
@@ -1,5 +1,7 @@
 #include <glad/glad.h>
+#ifdef FLUID_WINDOW
 #include <GLFW/glfw3.h>
+#endif
 
 #include "utils/util.h"
 #include "utils/ShaderProgram.h"
@@ -9,15 +11,43 @@
 #include "utils/buffer/EBO.h"
 #include "mesh.h"
 #include "sphSolver.h"
+#include "surfaceReconstructor.h"
+#include "fluidRenderer.h"
+#include "headless.h"
+#include "distributed.h"
+#include "ensemble.h"
+#include "sweep.h"
+#include "sceneConfig.h"
+#include "simulationThread.h"
+#include "timestepController.h"
+#include "utils/ConfigFile.h"
+#include "utils/ThreadPool.h"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <fstream>
+#include <sstream>
+#include <string>
 
+#ifdef FLUID_WINDOW
 bool paused = false;
 bool spawnParticles = false;
 bool pKeyPressed = false;
 bool fKeyPressed = false;
 bool tabKeyPressed = false;
+enum RenderMode {
+    RENDER_PARTICLES,
+    RENDER_SURFACE,
+    RENDER_SCREEN_SPACE
+};
+
+RenderMode renderMode = RENDER_PARTICLES;
+bool exportSurface = false;
+bool switchSolver = false;
+bool kKeyPressed = false;
+bool mKeyPressed = false;
+bool oKeyPressed = false;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -66,15 +96,60 @@ GLFWwindow* initGLFWContext() {
 }
 
 
-int main() {
+int runWindowed(const HeadlessOptions &options) {
     GLFWwindow* window = initGLFWContext();
     shaderProgram = ShaderProgram::genBasicShaderProgram("../src/shaders/vertexShader.glsl", "../src/shaders/fragmentShader.glsl");
     // create 9x9x9 cube of particles
     std::shared_ptr<std::vector<Particle>> particles = std::make_shared<std::vector<Particle>>();
     SPHSolver sphSolver(particles, shaderProgram);
+    sphSolver.setSleepingEnabled(options.sleeping);
+    sphSolver.setSolverMode(options.solver);
+    std::string parameterError;
+    if (!sphSolver.setParameters(options.parameters, parameterError)) {
+        exitOnCriticalError("Could not set the solver parameters: " + parameterError, "runWindowed");
+    }
+    sphSolver.setPeriodicAxes(options.periodic);
+    sphSolver.setTaskGraph(options.taskGraph);
+    for (const ObstacleOptions &obstacle : options.obstacles) {
+        if (!sphSolver.addCollider(obstacle.path, obstacle.motion)) {
+            exitOnCriticalError("Could not read obstacle mesh " + obstacle.path, "runWindowed");
+        }
+    }
+    for (const RigidBodyOptions &body : options.bodies) {
+        if (!sphSolver.addRigidBody(body.path, body.relativeDensity)) {
+            exitOnCriticalError("Could not read rigid body mesh " + body.path, "runWindowed");
+        }
+    }
+    for (const ParticleSink &sink : options.sinks) {
+        sphSolver.addSink(sink);
+    }
+    for (const ParticleEmitter &emitter : options.emitters) {
+        sphSolver.addEmitter(emitter);
+    }
+    if (options.maxParticles > 0) {
+        sphSolver.setMaxParticles(options.maxParticles);
+    }
     Mesh mesh(MeshType::CUBE, shaderProgram);
     mesh.makeCube(glm::vec3(2.0f, 0.0f, -1.0f), glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), 0.1f);
 
+    // the surface is rebuilt from snapshots, in a grid of its own since the solver's keeps changing
+    std::shared_ptr<std::vector<Particle>> surfaceParticles = std::make_shared<std::vector<Particle>>();
+    Grid surfaceGrid = sphSolver.getGrid();
+    surfaceGrid.particles = surfaceParticles;
+    SurfaceReconstructor surface;
+    Mesh surfaceMesh(MeshType::SURFACE, shaderProgram);
+    std::vector<Vertex> surfaceVertices;
+    std::vector<glm::uvec3> surfaceTriangles;
+    int exportedSurfaces = 0;
+    FluidRenderer fluidRenderer(SCR_WIDTH, SCR_HEIGHT);
+    TimestepController timestep(options.minDt, options.maxDt > 0.0f ? options.maxDt : sphSolver.getMaxStableTimestep(), options.cfl);
+    if (options.dt > 0.0f) {
+        timestep.setBounds(options.dt, options.dt);
+    }
+    std::ofstream log("timesteps.csv");
+    timestep.setLog(&log);
+    ShaderProgram::printLoadStats();
+
 
     glEnable(GL_DEPTH_TEST);
     //glEnable(GL_BLEND);
@@ -86,7 +161,10 @@ int main() {
     float currentTime = 0.0f;
     float lastTime = 0.0f;
     float deltaTime = 0.0f;
-    
+
+    // the solver steps on its own thread from here on, this loop only draws its snapshots
+    SimulationThread simulation(sphSolver, timestep, options.dt > 0.0f ? options.dt : options.maxDt);
+    simulation.start();
     while (!glfwWindowShouldClose(window)) {
         currentTime = glfwGetTime();
         deltaTime = currentTime - lastTime;
@@ -99,22 +177,50 @@ int main() {
         shaderProgram->setMat4("view", view);
         shaderProgram->setVec3("lightPos", lightPos);
         shaderProgram->setMat4("projection", projection);
-        if (paused) {
-            sphSolver.pause();
-        } else {
-            sphSolver.unpause();
-        }
+        simulation.setPaused(paused);
         if (spawnParticles){
-            sphSolver.spawnParticles();
+            simulation.requestSpawn();
+        }
+        if (switchSolver) {
+            simulation.requestSolverSwitch();
+            switchSolver = false;
         }
-        sphSolver.update(0.01f);
-        std::cout << "FPS: " << 1.0f / deltaTime << std::endl;
+        const SolverSnapshot &snapshot = simulation.latest();
+        sphSolver.renderBoundaries(snapshot.colliderModels);
+        if (renderMode == RENDER_PARTICLES) {
+            sphSolver.renderParticles(snapshot.particles);
+        }
+        if (renderMode == RENDER_SCREEN_SPACE) {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            fluidRenderer.resize(width, height);
+            fluidRenderer.render(snapshot.particles, view, projection, lightPos);
+        }
+        if (renderMode == RENDER_SURFACE) {
+            *surfaceParticles = snapshot.particles;
+            surfaceGrid.clearParticles();
+            surfaceGrid.insertParticles(0, surfaceParticles->size());
+            surface.reconstruct(*surfaceParticles, surfaceGrid);
+            surface.gatherMesh(surfaceVertices, surfaceTriangles, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+            surfaceMesh.setGeometry(surfaceVertices, surfaceTriangles);
+            surfaceMesh.render();
+            const SurfaceStats &stats = surface.getStats();
+            std::cout << "Surface: " << stats.totalMs << " ms (splat " << stats.splatMs << " ms, polygonise " << stats.polygoniseMs
+                      << " ms) " << stats.activeBlocks << " blocks " << stats.triangleCount << " triangles" << std::endl;
+            if (exportSurface) {
+                std::ofstream out("surface_" + std::to_string(exportedSurfaces++) + ".obj");
+                surface.writeObj(out);
+            }
+        }
+        exportSurface = false;
+        std::cout << "FPS: " << 1.0f / deltaTime << " steps/s: " << simulation.getStepRate() << " dt: " << snapshot.dt << std::endl;
         lastTime = currentTime;
         //mesh.render();
         glfwSwapBuffers(window);
         glfwPollEvents();
         spawnParticles = false;
     }
+    simulation.stop();
     glfwTerminate();
     return 0;
 }
@@ -139,6 +245,33 @@ void processInput(GLFWwindow *window) {
         tabKeyPressed = false;
     }
 
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
+        if (!mKeyPressed) {
+            renderMode = (RenderMode) ((renderMode + 1) % 3);
+            mKeyPressed = true;
+        }
+    } else {
+        mKeyPressed = false;
+    }
+
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+        if (!kKeyPressed) {
+            switchSolver = true;
+            kKeyPressed = true;
+        }
+    } else {
+        kKeyPressed = false;
+    }
+
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+        if (!oKeyPressed) {
+            exportSurface = true;
+            oKeyPressed = true;
+        }
+    } else {
+        oKeyPressed = false;
+    }
+
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
@@ -192,4 +325,260 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glm::mat4 projection = camera.getProjectionMatrix((float)width / (float)height);
     shaderProgram->use();
     shaderProgram->setMat4("projection", projection);
-}
\ No newline at end of file
+}
+#endif // FLUID_WINDOW
+
+// Comma separated floats, false unless there are exactly count of them
+bool parseFloats(const std::string &text, int count, std::vector<float> &values) {
+    values.clear();
+    std::stringstream fields(text);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        try {
+            values.push_back(std::stof(field));
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+    return (int) values.size() == count;
+}
+
+void printUsage() {
+    std::cout << "Usage: FLUID_SIMULATION_CPP [--headless] [--frames n] [--output dir] [--format png|raw]\n"
+              << "                            [--width w] [--height h] [--dt seconds] [--dt-min seconds] [--dt-max seconds] [--cfl c]\n"
+              << "                            [--spawn-every n] [--screen-space]\n"
+              << "                            [--fill lattice|poisson] [--state-cache dir] [--no-sleep]\n"
+              << "                            [--solver contact|pcisph|pbf [--task-graph]] [--periodic x|y|z|xy|xz|yz|xyz]\n"
+              << "                            [--numa local|interleave | --numa-benchmark]\n"
+              << "                            [--obstacle mesh.obj [--translate vx,vy,vz] [--oscillate ax,ay,az,hz]\n"
+              << "                             [--pivot x,y,z] [--rotate ax,ay,az,rad/s] [--rock ax,ay,az,rad,hz]]...\n"
+              << "                            [--rigid-body mesh.obj [--body-density relative]]...\n"
+              << "                            [--sink x0,y0,z0,x1,y1,z1]... [--outflow px,py,pz,nx,ny,nz]...\n"
+              << "                            [--inflow-disk cx,cy,cz,nx,ny,nz,radius,speed[,rate]]...\n"
+              << "                            [--inflow-rect cx,cy,cz,nx,ny,nz,width,height,speed[,rate]]... [--max-particles n]\n"
+              << "                            [--ranks n [--transport shm|unix|tcp] [--port first] | --weak-scaling n\n"
+              << "                             | --hosts host:port,... --rank r] [--rebalance steps] [--dam-break]\n"
+              << "                            [--ensemble n [--seed s] [--results file.csv]]\n"
+              << "                            [--config scene.toml] [--sweep sweep.toml] [--jobs n]\n"
+              << "Flags after --config or --sweep override the file" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    bool headless = false;
+    bool placementBenchmark = false;
+    HeadlessOptions options;
+    DistributedOptions distributed;
+    EnsembleOptions ensemble;
+    ConfigFile sweep;
+    bool sweeping = false;
+    // malformed numbers throw out of the std::sto* conversions
+    try {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--frames" && hasValue) {
+            options.frames = std::stoi(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (arg == "--format" && hasValue) {
+            options.format = std::string(argv[++i]) == "raw" ? FRAME_RAW : FRAME_PNG;
+        } else if (arg == "--width" && hasValue) {
+            options.width = std::stoi(argv[++i]);
+        } else if (arg == "--height" && hasValue) {
+            options.height = std::stoi(argv[++i]);
+        } else if (arg == "--dt" && hasValue) {
+            options.dt = std::stof(argv[++i]);
+        } else if (arg == "--dt-min" && hasValue) {
+            options.minDt = std::stof(argv[++i]);
+        } else if (arg == "--dt-max" && hasValue) {
+            options.maxDt = std::stof(argv[++i]);
+        } else if (arg == "--cfl" && hasValue) {
+            options.cfl = std::stof(argv[++i]);
+        } else if (arg == "--spawn-every" && hasValue) {
+            options.spawnEvery = std::stoi(argv[++i]);
+        } else if (arg == "--screen-space") {
+            options.screenSpace = true;
+        } else if (arg == "--fill" && hasValue) {
+            options.fillTank = true;
+            options.packing = std::string(argv[++i]) == "poisson" ? PACKING_POISSON : PACKING_LATTICE;
+        } else if (arg == "--state-cache" && hasValue) {
+            options.stateCache = argv[++i];
+        } else if (arg == "--no-sleep") {
+            options.sleeping = false;
+        } else if (arg == "--solver" && hasValue) {
+            std::string solver = argv[++i];
+            options.solver = solver == "pcisph" ? SOLVER_PCISPH : solver == "pbf" ? SOLVER_PBF : SOLVER_CONTACT;
+        } else if (arg == "--task-graph") {
+            options.taskGraph = true;
+        } else if (arg == "--numa" && hasValue) {
+            std::string placement = argv[++i];
+            if (placement != "local" && placement != "interleave") {
+                printUsage();
+                return 1;
+            }
+            options.placement = placement == "local" ? PLACEMENT_LOCAL : PLACEMENT_INTERLEAVED;
+        } else if (arg == "--numa-benchmark") {
+            placementBenchmark = true;
+        } else if (arg == "--periodic" && hasValue) {
+            std::string axes = argv[++i];
+            options.periodic = glm::bvec3(axes.find('x') != std::string::npos, axes.find('y') != std::string::npos,
+                                          axes.find('z') != std::string::npos);
+            if (axes.find_first_not_of("xyz") != std::string::npos) {
+                printUsage();
+                return 1;
+            }
+        } else if (arg == "--ranks" && hasValue) {
+            distributed.ranks = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--transport" && hasValue) {
+            std::string transport = argv[++i];
+            distributed.transport = transport == "tcp" ? TRANSPORT_TCP : transport == "unix" ? TRANSPORT_UNIX : TRANSPORT_SHARED_MEMORY;
+        } else if (arg == "--port" && hasValue) {
+            distributed.basePort = std::stoi(argv[++i]);
+        } else if (arg == "--hosts" && hasValue) {
+            std::stringstream hosts(argv[++i]);
+            std::string host;
+            while (std::getline(hosts, host, ',')) {
+                distributed.hosts.push_back(host);
+            }
+        } else if (arg == "--rank" && hasValue) {
+            distributed.rank = std::stoi(argv[++i]);
+        } else if (arg == "--weak-scaling" && hasValue) {
+            distributed.weakScalingRanks = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--rebalance" && hasValue) {
+            distributed.rebalanceInterval = std::max(std::stoi(argv[++i]), 0);
+        } else if (arg == "--dam-break") {
+            distributed.damBreak = true;
+        } else if (arg == "--ensemble" && hasValue) {
+            ensemble.members = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--seed" && hasValue) {
+            ensemble.seed = std::stoul(argv[++i]);
+        } else if (arg == "--results" && hasValue) {
+            ensemble.resultsPath = argv[++i];
+        } else if ((arg == "--config" || arg == "--sweep") && hasValue) {
+            // applied where it stands, the flags after it change what it sets
+            ConfigFile config;
+            std::string error;
+            if (!config.load(argv[++i]) || !loadSceneConfig(config, options, error)) {
+                std::cout << (error.empty() ? config.getError() : argv[i] + std::string(": ") + error) << std::endl;
+                return 1;
+            }
+            if (arg == "--sweep") {
+                sweep = config;
+                sweeping = true;
+            }
+        } else if (arg == "--jobs" && hasValue) {
+            ThreadPool::setInstanceThreadCount(std::max(std::stoi(argv[++i]), 1));
+        } else if (arg == "--obstacle" && hasValue) {
+            options.obstacles.push_back({argv[++i], KinematicMotion()});
+        } else if (arg == "--rigid-body" && hasValue) {
+            options.bodies.push_back({argv[++i]});
+        } else if (arg == "--body-density" && hasValue && !options.bodies.empty()) {
+            options.bodies.back().relativeDensity = std::stof(argv[++i]);
+        } else if ((arg == "--sink" || arg == "--outflow") && hasValue) {
+            std::vector<float> v;
+            if (!parseFloats(argv[++i], 6, v) || (arg == "--outflow" && glm::vec3(v[3], v[4], v[5]) == glm::vec3(0.0f))) {
+                printUsage();
+                return 1;
+            }
+            glm::vec3 a(v[0], v[1], v[2]);
+            glm::vec3 b(v[3], v[4], v[5]);
+            options.sinks.push_back(arg == "--sink" ? ParticleSink::box(a, b) : ParticleSink::outflow(a, b));
+        } else if ((arg == "--inflow-disk" || arg == "--inflow-rect") && hasValue) {
+            // the rate is optional, 0 lets speed times the opening's area through
+            std::vector<float> v;
+            std::string value = argv[++i];
+            int count = arg == "--inflow-disk" ? 8 : 9;
+            if (!parseFloats(value, count, v) && !parseFloats(value, count + 1, v)) {
+                printUsage();
+                return 1;
+            }
+            v.resize(count + 1, 0.0f);
+            glm::vec3 center(v[0], v[1], v[2]);
+            glm::vec3 normal(v[3], v[4], v[5]);
+            if (normal == glm::vec3(0.0f)) {
+                printUsage();
+                return 1;
+            }
+            options.emitters.push_back(arg == "--inflow-disk" ? ParticleEmitter::disk(center, normal, v[6], v[7], v[8])
+                                                               : ParticleEmitter::rectangle(center, normal, glm::vec2(v[6], v[7]), v[8], v[9]));
+        } else if (arg == "--max-particles" && hasValue) {
+            options.maxParticles = std::max(std::stol(argv[++i]), 0l);
+        } else if ((arg == "--translate" || arg == "--oscillate" || arg == "--pivot" || arg == "--rotate" || arg == "--rock") &&
+                   hasValue && !options.obstacles.empty()) {
+            // motion of the last obstacle given
+            KinematicMotion &motion = options.obstacles.back().motion;
+            std::vector<float> v;
+            std::string value = argv[++i];
+            if (arg == "--translate" && parseFloats(value, 3, v)) {
+                motion.velocity = glm::vec3(v[0], v[1], v[2]);
+            } else if (arg == "--oscillate" && parseFloats(value, 4, v)) {
+                motion.amplitude = glm::vec3(v[0], v[1], v[2]);
+                motion.frequency = v[3];
+            } else if (arg == "--pivot" && parseFloats(value, 3, v)) {
+                motion.pivot = glm::vec3(v[0], v[1], v[2]);
+            } else if (arg == "--rotate" && parseFloats(value, 4, v) && glm::vec3(v[0], v[1], v[2]) != glm::vec3(0.0f)) {
+                motion.axis = glm::vec3(v[0], v[1], v[2]);
+                motion.angularSpeed = v[3];
+            } else if (arg == "--rock" && parseFloats(value, 5, v) && glm::vec3(v[0], v[1], v[2]) != glm::vec3(0.0f)) {
+                motion.axis = glm::vec3(v[0], v[1], v[2]);
+                motion.angularAmplitude = v[3];
+                motion.angularFrequency = v[4];
+            } else {
+                printUsage();
+                return 1;
+            }
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    } catch (const std::exception &) {
+        printUsage();
+        return 1;
+    }
+
+    if (!distributed.hosts.empty() && (distributed.rank < 0 || distributed.rank >= (int) distributed.hosts.size())) {
+        printUsage();
+        return 1;
+    }
+    if (distributed.ranks > 0 || !distributed.hosts.empty() || distributed.weakScalingRanks > 0) {
+#ifdef FLUID_HEADLESS
+        return distributed.weakScalingRanks > 0 ? runWeakScaling(options, distributed) : runDistributed(options, distributed);
+#else
+        exitOnCriticalError("Distributed runs need the headless renderer, reconfigure with -DFLUID_HEADLESS=ON", "main");
+        return 1;
+#endif
+    }
+    if (sweeping) {
+#ifdef FLUID_HEADLESS
+        return runSweep(options, sweep);
+#else
+        exitOnCriticalError("Sweeps need the headless renderer, reconfigure with -DFLUID_HEADLESS=ON", "main");
+        return 1;
+#endif
+    }
+    if (ensemble.members > 0) {
+#ifdef FLUID_HEADLESS
+        return runEnsemble(options, ensemble);
+#else
+        exitOnCriticalError("Ensembles need the headless renderer, reconfigure with -DFLUID_HEADLESS=ON", "main");
+        return 1;
+#endif
+    }
+    if (headless || placementBenchmark) {
+#ifdef FLUID_HEADLESS
+        return placementBenchmark ? runPlacementBenchmark(options) : runHeadless(options);
+#else
+        exitOnCriticalError("Built without headless support, reconfigure with -DFLUID_HEADLESS=ON", "main");
+        return 1;
+#endif
+    }
+#ifdef FLUID_WINDOW
+    return runWindowed(options);
+#else
+    exitOnCriticalError("Built without GLFW, only --headless is available", "main");
+    return 1;
+#endif
+}
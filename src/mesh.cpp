@@ -1,4 +1,4 @@
-#include "Mesh.h"
+#include "mesh.h"
 
 #include <iostream>
 
@@ -162,6 +162,20 @@ void Mesh::makePlane(glm::vec3 u, glm::vec3 v, glm::vec4 color, float size) {
 }
 
 
+void Mesh::setGeometry(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &triangleIndices) {
+    _vertices = vertices;
+    _triangleIndices = triangleIndices;
+
+    _vao.bind();
+    _vbo.bind();
+    _ebo.bind();
+
+    _vbo.setBuffer(_vertices, GL_DYNAMIC_DRAW);
+    _ebo.setBuffer(_triangleIndices, GL_DYNAMIC_DRAW);
+
+    init(_vertices);
+}
+
 void Mesh::init(std::vector<Vertex> vertices) {
     _vao.linkAttrib(_vbo, 0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position)); // Position
     //param 1 : ith layout basicaly the ith vertex attribute (0 for position, 1 for color, 2 for normal)
@@ -188,6 +202,27 @@ void Mesh::render() {
     glDrawElements(GL_TRIANGLES, _triangleIndices.size() * 3, GL_UNSIGNED_INT, 0);
 }
 
+void Mesh::setInstanceOffsets(const std::vector<glm::vec3> &offsets) {
+    _vao.bind();
+    _instanceVbo.bind();
+    _instanceVbo.setBuffer(offsets, GL_STREAM_DRAW);
+    _vao.linkAttrib(_instanceVbo, 3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+    glVertexAttribDivisor(3, 1);
+    _instanceVbo.unbind();
+    _vao.unbind();
+    _instanceCount = offsets.size();
+}
+
+void Mesh::renderInstanced() {
+    if (_instanceCount == 0) {
+        return;
+    }
+    _shaderProgram->use();
+    _shaderProgram->setMat4("model", _modelMatrix);
+    _vao.bind();
+    glDrawElementsInstanced(GL_TRIANGLES, _triangleIndices.size() * 3, GL_UNSIGNED_INT, 0, _instanceCount);
+}
+
 Mesh::~Mesh() {
     _vao.~VAO();
     _vbo.~VBO();
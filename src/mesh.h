@@ -12,7 +12,8 @@
 enum MeshType {
     CUBE,
     SPHERE,
-    PLANE
+    PLANE,
+    SURFACE
 };
 
 class Mesh {
@@ -28,11 +29,19 @@ public:
 
     void render();
 
+    // Draws one copy of the mesh per offset, the offsets are added to the vertex positions
+    void setInstanceOffsets(const std::vector<glm::vec3> &offsets);
+    void renderInstanced();
+
     void updateModelMatrix(glm::vec3 position);
+    void setModelMatrix(const glm::mat4 &modelMatrix) { _modelMatrix = modelMatrix; }
     glm::mat4 getModelMatrix() { return _modelMatrix; }
 
     void makeCube(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4 color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), float size = 1.0f);
     void makeSphere(glm::vec4 color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), float radius = 1.0f, int sectorCount = 36, int stackCount = 18);
+    // Replaces the whole geometry, used for meshes rebuilt every frame
+    void setGeometry(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &triangleIndices);
+
     void makePlane(glm::vec3 u = glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3 v = glm::vec3(0.0f, 0.0f, -1.0f), glm::vec4 color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), float size = 4.0f);
 
     std::vector<glm::vec3> &vertexPositions() { return _vertexPositions; }
@@ -60,5 +69,7 @@ private:
     VAO _vao;
     VBO _vbo;
     EBO _ebo;
+    VBO _instanceVbo;
+    GLsizei _instanceCount = 0;
 };
 #endif // MESH_H
\ No newline at end of file
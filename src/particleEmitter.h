@@ -0,0 +1,70 @@
+#ifndef PARTICLE_EMITTER_H
+#define PARTICLE_EMITTER_H
+
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Continuous inflow through a disk or a rectangle. The fluid enters along the normal at speed, one layer of the
+// rest spacing's lattice across the opening at a time, rate cubic metres per second, or speed times the area of
+// the opening for a rate of 0. The solver emits the layers due at the start of every step.
+struct ParticleEmitter {
+    enum Shape {
+        DISK,
+        RECTANGLE
+    };
+
+    Shape shape = DISK;
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(1.0f, 0.0f, 0.0f);
+    float radius = 0.1f;                    // disk
+    glm::vec2 size = glm::vec2(0.2f);       // rectangle, along the two axes of the opening
+    float speed = 1.0f;
+    float rate = 0.0f;
+
+    static ParticleEmitter disk(glm::vec3 center, glm::vec3 normal, float radius, float speed, float rate = 0.0f) {
+        ParticleEmitter emitter;
+        emitter.center = center;
+        emitter.normal = glm::normalize(normal);
+        emitter.radius = radius;
+        emitter.speed = speed;
+        emitter.rate = rate;
+        return emitter;
+    }
+
+    static ParticleEmitter rectangle(glm::vec3 center, glm::vec3 normal, glm::vec2 size, float speed, float rate = 0.0f) {
+        ParticleEmitter emitter = disk(center, normal, 0.0f, speed, rate);
+        emitter.shape = RECTANGLE;
+        emitter.size = size;
+        return emitter;
+    }
+
+    // Unit vectors across the opening, u is horizontal unless the normal is vertical, then it is along x
+    void axes(glm::vec3 &u, glm::vec3 &v) const {
+        glm::vec3 up = std::abs(normal.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        u = glm::normalize(glm::cross(up, normal));
+        v = glm::cross(normal, u);
+    }
+
+    // Points of the square lattice of the given spacing inside the opening, centred on it
+    std::vector<glm::vec3> opening(float spacing) const {
+        glm::vec3 u;
+        glm::vec3 v;
+        axes(u, v);
+        glm::vec2 extent = shape == DISK ? glm::vec2(2.0f * radius) : size;
+        glm::ivec2 counts = glm::max(glm::ivec2(glm::floor(extent / spacing + 1e-4f)), glm::ivec2(0)) + 1;
+        std::vector<glm::vec3> points;
+        for (int b = 0; b < counts.y; b++) {
+            for (int a = 0; a < counts.x; a++) {
+                glm::vec2 local = (glm::vec2(a, b) - 0.5f * glm::vec2(counts - 1)) * spacing;
+                if (shape == RECTANGLE || glm::dot(local, local) <= radius * radius) {
+                    points.push_back(center + local.x * u + local.y * v);
+                }
+            }
+        }
+        return points;
+    }
+};
+
+#endif // PARTICLE_EMITTER_H
@@ -0,0 +1,44 @@
+#ifndef PARTICLE_SINK_H
+#define PARTICLE_SINK_H
+
+#include <glm/glm.hpp>
+
+// Region the fluid drains out of. A box removes every particle inside it, an outflow every particle past its
+// plane, on the side the normal points to, e.g. the open end of a channel. The solver applies its sinks at the
+// start of every step.
+struct ParticleSink {
+    enum Shape {
+        BOX,
+        OUTFLOW
+    };
+
+    Shape shape = BOX;
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec3 point = glm::vec3(0.0f);                  // on the outflow plane
+    glm::vec3 normal = glm::vec3(1.0f, 0.0f, 0.0f);     // out of the fluid
+
+    static ParticleSink box(glm::vec3 min, glm::vec3 max) {
+        ParticleSink sink;
+        sink.min = glm::min(min, max);
+        sink.max = glm::max(min, max);
+        return sink;
+    }
+
+    static ParticleSink outflow(glm::vec3 point, glm::vec3 normal) {
+        ParticleSink sink;
+        sink.shape = OUTFLOW;
+        sink.point = point;
+        sink.normal = glm::normalize(normal);
+        return sink;
+    }
+
+    bool contains(const glm::vec3 &position) const {
+        if (shape == OUTFLOW) {
+            return glm::dot(position - point, normal) > 0.0f;
+        }
+        return glm::all(glm::greaterThanEqual(position, min)) && glm::all(glm::lessThanEqual(position, max));
+    }
+};
+
+#endif // PARTICLE_SINK_H
@@ -0,0 +1,166 @@
+#include "rigidBody.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Polynomial terms of one triangle edge set (Eberly, Polyhedral Mass Properties)
+    void subexpressions(float w0, float w1, float w2, float &f1, float &f2, float &f3, float &g0, float &g1, float &g2) {
+        float temp0 = w0 + w1;
+        f1 = temp0 + w2;
+        float temp1 = w0 * w0;
+        float temp2 = temp1 + w1 * temp0;
+        f2 = temp2 + w2 * f1;
+        f3 = w0 * temp1 + w1 * temp2 + w2 * f2;
+        g0 = f2 + w0 * (f1 + w0);
+        g1 = f2 + w1 * (f1 + w1);
+        g2 = f2 + w2 * (f1 + w2);
+    }
+}
+
+RigidBody::RigidBody(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, float density) :
+        _vertices(vertices) {
+    // volume integrals of 1, x, y, z, x^2, y^2, z^2, xy, yz, zx over the closed mesh
+    const float multipliers[10] = {1.0f / 6, 1.0f / 24, 1.0f / 24, 1.0f / 24, 1.0f / 60, 1.0f / 60, 1.0f / 60, 1.0f / 120, 1.0f / 120, 1.0f / 120};
+    double integrals[10] = {0.0};
+    for (const glm::uvec3 &triangle : triangles) {
+        glm::vec3 p0 = vertices[triangle.x];
+        glm::vec3 p1 = vertices[triangle.y];
+        glm::vec3 p2 = vertices[triangle.z];
+        glm::vec3 d = glm::cross(p1 - p0, p2 - p0);
+        float f1x, f2x, f3x, g0x, g1x, g2x;
+        float f1y, f2y, f3y, g0y, g1y, g2y;
+        float f1z, f2z, f3z, g0z, g1z, g2z;
+        subexpressions(p0.x, p1.x, p2.x, f1x, f2x, f3x, g0x, g1x, g2x);
+        subexpressions(p0.y, p1.y, p2.y, f1y, f2y, f3y, g0y, g1y, g2y);
+        subexpressions(p0.z, p1.z, p2.z, f1z, f2z, f3z, g0z, g1z, g2z);
+        integrals[0] += d.x * f1x;
+        integrals[1] += d.x * f2x;
+        integrals[2] += d.y * f2y;
+        integrals[3] += d.z * f2z;
+        integrals[4] += d.x * f3x;
+        integrals[5] += d.y * f3y;
+        integrals[6] += d.z * f3z;
+        integrals[7] += d.x * (p0.y * g0x + p1.y * g1x + p2.y * g2x);
+        integrals[8] += d.y * (p0.z * g0y + p1.z * g1y + p2.z * g2y);
+        integrals[9] += d.z * (p0.x * g0z + p1.x * g1z + p2.x * g2z);
+    }
+    // a mesh wound inwards gives the same integrals with the opposite sign
+    double orientation = integrals[0] < 0.0 ? -1.0 : 1.0;
+    for (int k = 0; k < 10; k++) {
+        integrals[k] *= orientation * multipliers[k] * density;
+    }
+
+    _mass = integrals[0];
+    _centerOfMass = glm::vec3(integrals[1], integrals[2], integrals[3]) / _mass;
+    glm::vec3 c = _centerOfMass;
+    glm::mat3 inertia;
+    inertia[0][0] = integrals[5] + integrals[6] - _mass * (c.y * c.y + c.z * c.z);
+    inertia[1][1] = integrals[4] + integrals[6] - _mass * (c.z * c.z + c.x * c.x);
+    inertia[2][2] = integrals[4] + integrals[5] - _mass * (c.x * c.x + c.y * c.y);
+    inertia[0][1] = inertia[1][0] = -(integrals[7] - _mass * c.x * c.y);
+    inertia[1][2] = inertia[2][1] = -(integrals[8] - _mass * c.y * c.z);
+    inertia[0][2] = inertia[2][0] = -(integrals[9] - _mass * c.z * c.x);
+    _inverseInertia = glm::inverse(inertia);
+    _position = _centerOfMass;
+}
+
+void RigidBody::sampleSurface(const SdfCollider &collider, float spacing, float smoothingLength, float volumeScale) {
+    glm::vec3 low(_vertices[0]);
+    glm::vec3 high(low);
+    for (const glm::vec3 &vertex : _vertices) {
+        low = glm::min(low, vertex);
+        high = glm::max(high, vertex);
+    }
+    low -= glm::vec3(spacing);
+    high += glm::vec3(spacing);
+    // lattice points within half a spacing of the surface, projected onto it
+    _samples.clear();
+    glm::ivec3 count = glm::ivec3(glm::ceil((high - low) / spacing)) + 1;
+    for (int k = 0; k < count.z; k++) {
+        for (int j = 0; j < count.y; j++) {
+            for (int i = 0; i < count.x; i++) {
+                glm::vec3 point = low + glm::vec3(i, j, k) * spacing;
+                float distance = collider.distance(point);
+                if (std::abs(distance) < 0.5f * spacing) {
+                    _samples.push_back(point - distance * collider.normal(point));
+                }
+            }
+        }
+    }
+
+    _sampleVolumes.resize(_samples.size());
+    for (size_t b = 0; b < _samples.size(); b++) {
+        float kernelSum = 0.0f;
+        for (const glm::vec3 &other : _samples) {
+            glm::vec3 offset = _samples[b] - other;
+            kernelSum += poly6(glm::dot(offset, offset), smoothingLength);
+        }
+        _sampleVolumes[b] = volumeScale / kernelSum;
+    }
+}
+
+glm::mat3 RigidBody::inverseWorldInertia() const {
+    glm::mat3 r = rotation();
+    return r * _inverseInertia * glm::transpose(r);
+}
+
+void RigidBody::applyImpulseAt(const glm::vec3 &impulse, const glm::vec3 &arm) {
+    _velocity += impulse / _mass;
+    _angularVelocity += inverseWorldInertia() * glm::cross(arm, impulse);
+}
+
+void RigidBody::applyImpulse(const BodyImpulse &impulse) {
+    _velocity += impulse.linear / _mass;
+    _angularVelocity += inverseWorldInertia() * impulse.angular;
+}
+
+void RigidBody::integrate(float dt, const glm::vec3 &gravity, const glm::vec3 &low, const glm::vec3 &high) {
+    _velocity += dt * gravity;
+    _position += dt * _velocity;
+    glm::quat spin(0.0f, _angularVelocity.x, _angularVelocity.y, _angularVelocity.z);
+    _orientation = glm::normalize(_orientation + 0.5f * dt * spin * _orientation);
+
+    // floor and walls: the deepest vertex sets the push out, then a few sweeps of inelastic impulses with
+    // friction at every vertex still moving into a wall
+    const float friction = 0.5f;
+    const glm::vec3 normals[5] = {glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+    const float offsets[5] = {low.y, low.x, -high.x, low.z, -high.z};
+    for (int wall = 0; wall < 5; wall++) {
+        float depth = 0.0f;
+        for (const glm::vec3 &vertex : _vertices) {
+            depth = std::max(depth, offsets[wall] - glm::dot(normals[wall], toWorld(vertex)));
+        }
+        _position += depth * normals[wall];
+    }
+    for (int sweep = 0; sweep < 4; sweep++) {
+        for (int wall = 0; wall < 5; wall++) {
+            const glm::vec3 &n = normals[wall];
+            for (const glm::vec3 &vertex : _vertices) {
+                glm::vec3 world = toWorld(vertex);
+                if (glm::dot(n, world) > offsets[wall] + 1e-4f) {
+                    continue;
+                }
+                glm::vec3 arm = world - _position;
+                float approach = glm::dot(velocityAt(world), n);
+                if (approach >= 0.0f) {
+                    continue;
+                }
+                glm::mat3 inverseInertia = inverseWorldInertia();
+                float normalMass = 1.0f / _mass + glm::dot(n, glm::cross(inverseInertia * glm::cross(arm, n), arm));
+                float normalImpulse = -approach / normalMass;
+                applyImpulseAt(normalImpulse * n, arm);
+
+                glm::vec3 tangentVelocity = velocityAt(world);
+                tangentVelocity -= glm::dot(tangentVelocity, n) * n;
+                float slip = glm::length(tangentVelocity);
+                if (slip > 1e-6f) {
+                    glm::vec3 t = tangentVelocity / slip;
+                    float tangentMass = 1.0f / _mass + glm::dot(t, glm::cross(inverseInertia * glm::cross(arm, t), arm));
+                    applyImpulseAt(-std::min(slip / tangentMass, friction * normalImpulse) * t, arm);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef RIGID_BODY_H
+#define RIGID_BODY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+#include "sdfCollider.h"
+
+// Impulse gathered on a body during one pass, one slot per thread and body. The slots are cache line
+// sized so threads filling neighbouring slots don't share a line.
+struct alignas(64) BodyImpulse {
+    glm::vec3 linear = glm::vec3(0.0f);
+    glm::vec3 angular = glm::vec3(0.0f);   // about the centre of mass
+};
+
+// Rigid body driven by the fluid. Mass, centre of mass and inertia come from the closed mesh at uniform density,
+// the surface is sampled into boundary samples that take part in the fluid's density and pressure sums, the
+// reactions on them are applied as impulses.
+class RigidBody {
+public:
+    RigidBody(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, float density);
+
+    // Boundary samples about spacing apart on the zero level of the collider's field (built from the same mesh and
+    // not yet moved), with volumes from the body's own sampling like the walls'
+    void sampleSurface(const SdfCollider &collider, float spacing, float smoothingLength, float volumeScale);
+
+    // Applies the gathered impulses and gravity, then keeps the mesh inside [low, high] (no upper bound in y)
+    void integrate(float dt, const glm::vec3 &gravity, const glm::vec3 &low, const glm::vec3 &high);
+    void applyImpulse(const BodyImpulse &impulse);
+
+    glm::mat3 rotation() const { return glm::mat3_cast(_orientation); }
+    // world = rotation() * mesh + translation()
+    glm::vec3 translation() const { return _position - rotation() * _centerOfMass; }
+    glm::vec3 toWorld(const glm::vec3 &meshPoint) const { return rotation() * (meshPoint - _centerOfMass) + _position; }
+    glm::vec3 velocityAt(const glm::vec3 &position) const { return _velocity + glm::cross(_angularVelocity, position - _position); }
+
+    const glm::vec3 &getPosition() const { return _position; }
+    const glm::vec3 &getVelocity() const { return _velocity; }
+    const glm::vec3 &getAngularVelocity() const { return _angularVelocity; }
+    float getMass() const { return _mass; }
+    const std::vector<glm::vec3> &getSamples() const { return _samples; }
+    const std::vector<float> &getSampleVolumes() const { return _sampleVolumes; }
+
+private:
+    glm::mat3 inverseWorldInertia() const;
+    // Velocity change from an impulse at a point relative to the centre of mass
+    void applyImpulseAt(const glm::vec3 &impulse, const glm::vec3 &arm);
+
+    std::vector<glm::vec3> _vertices;       // mesh coordinates, used for the contacts with the domain
+    std::vector<glm::vec3> _samples;        // mesh coordinates
+    std::vector<float> _sampleVolumes;
+    float _mass = 0.0f;
+    glm::vec3 _centerOfMass = glm::vec3(0.0f);  // mesh coordinates
+    glm::mat3 _inverseInertia = glm::mat3(1.0f);  // body frame, about the centre of mass
+    glm::vec3 _position = glm::vec3(0.0f);  // of the centre of mass
+    glm::quat _orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 _velocity = glm::vec3(0.0f);
+    glm::vec3 _angularVelocity = glm::vec3(0.0f);
+};
+
+#endif // RIGID_BODY_H
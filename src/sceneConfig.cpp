@@ -0,0 +1,277 @@
+#include "sceneConfig.h"
+
+#include <algorithm>
+
+namespace {
+    bool expect(const std::string &key, const ConfigValue &value, ConfigValue::Type type, std::string &error) {
+        if (value.type == type) {
+            return true;
+        }
+        ConfigValue wanted;
+        wanted.type = type;
+        error = key + " should be a " + wanted.typeName() + ", not a " + value.typeName();
+        return false;
+    }
+
+    // One of the given words, as on the command line
+    bool choice(const std::string &key, const ConfigValue &value, const std::vector<std::string> &words, int &index, std::string &error) {
+        if (!expect(key, value, ConfigValue::STRING, error)) {
+            return false;
+        }
+        auto found = std::find(words.begin(), words.end(), value.string);
+        if (found == words.end()) {
+            error = "unknown " + key + " \"" + value.string + "\"";
+            return false;
+        }
+        index = found - words.begin();
+        return true;
+    }
+
+    // [x, y, z]
+    bool readVec3(const std::string &key, const ConfigValue *value, glm::vec3 &v, std::string &error) {
+        if (!value) {
+            error = key + " is missing";
+            return false;
+        }
+        if (!expect(key, *value, ConfigValue::ARRAY, error)) {
+            return false;
+        }
+        if (value->items.size() != 3) {
+            error = key + " should have 3 numbers";
+            return false;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            if (!expect(key, value->items[axis], ConfigValue::NUMBER, error)) {
+                return false;
+            }
+            v[axis] = (float) value->items[axis].number;
+        }
+        return true;
+    }
+
+    // The options that take a value as it is
+    bool readPlain(const std::string &key, const ConfigValue &value, HeadlessOptions &options, std::string &error) {
+        const std::vector<std::pair<std::string, std::string *>> strings = {
+            {"output", &options.outputPath},
+            {"stateCache", &options.stateCache},
+        };
+        const std::vector<std::pair<std::string, bool *>> flags = {
+            {"sleeping", &options.sleeping},
+            {"taskGraph", &options.taskGraph},
+            {"screenSpace", &options.screenSpace},
+        };
+        const std::vector<std::pair<std::string, int *>> integers = {
+            {"frames", &options.frames},
+            {"width", &options.width},
+            {"height", &options.height},
+            {"spawnEvery", &options.spawnEvery},
+        };
+        const std::vector<std::pair<std::string, float *>> numbers = {
+            {"dt", &options.dt},
+            {"dtMin", &options.minDt},
+            {"dtMax", &options.maxDt},
+            {"cfl", &options.cfl},
+        };
+        for (const auto &option : strings) {
+            if (option.first == key) {
+                if (!expect(key, value, ConfigValue::STRING, error)) {
+                    return false;
+                }
+                *option.second = value.string;
+                return true;
+            }
+        }
+        for (const auto &option : flags) {
+            if (option.first == key) {
+                if (!expect(key, value, ConfigValue::BOOLEAN, error)) {
+                    return false;
+                }
+                *option.second = value.boolean;
+                return true;
+            }
+        }
+        for (const auto &option : integers) {
+            if (option.first == key) {
+                if (!expect(key, value, ConfigValue::NUMBER, error)) {
+                    return false;
+                }
+                *option.second = (int) value.number;
+                return true;
+            }
+        }
+        for (const auto &option : numbers) {
+            if (option.first == key) {
+                if (!expect(key, value, ConfigValue::NUMBER, error)) {
+                    return false;
+                }
+                *option.second = (float) value.number;
+                return true;
+            }
+        }
+        error = "unknown scene option " + key;
+        return false;
+    }
+
+    bool readScene(const std::string &key, const ConfigValue &value, HeadlessOptions &options, std::string &error) {
+        int index = 0;
+        if (key == "solver") {
+            if (!choice(key, value, {"contact", "pcisph", "pbf"}, index, error)) {
+                return false;
+            }
+            options.solver = (SolverMode) index;
+        } else if (key == "fill") {
+            if (!choice(key, value, {"lattice", "poisson"}, index, error)) {
+                return false;
+            }
+            options.fillTank = true;
+            options.packing = index == 0 ? PACKING_LATTICE : PACKING_POISSON;
+        } else if (key == "format") {
+            if (!choice(key, value, {"png", "raw"}, index, error)) {
+                return false;
+            }
+            options.format = index == 0 ? FRAME_PNG : FRAME_RAW;
+        } else if (key == "periodic") {
+            if (!expect(key, value, ConfigValue::STRING, error)) {
+                return false;
+            }
+            if (value.string.find_first_not_of("xyz") != std::string::npos) {
+                error = "periodic takes the axes that wrap, e.g. \"xz\"";
+                return false;
+            }
+            options.periodic = glm::bvec3(value.string.find('x') != std::string::npos, value.string.find('y') != std::string::npos,
+                                          value.string.find('z') != std::string::npos);
+        } else if (key == "obstacles") {
+            // static obstacles, the motion flags are only on the command line
+            if (!expect(key, value, ConfigValue::ARRAY, error)) {
+                return false;
+            }
+            for (const ConfigValue &item : value.items) {
+                if (!expect("an obstacle", item, ConfigValue::STRING, error)) {
+                    return false;
+                }
+                options.obstacles.push_back({item.string, KinematicMotion()});
+            }
+        } else if (key == "sinks" || key == "outflows") {
+            // { min = [x, y, z], max = [x, y, z] } boxes, or { point = [x, y, z], normal = [x, y, z] } planes
+            if (!expect(key, value, ConfigValue::ARRAY, error)) {
+                return false;
+            }
+            bool box = key == "sinks";
+            for (const ConfigValue &item : value.items) {
+                if (!expect(box ? "a sink" : "an outflow", item, ConfigValue::TABLE, error)) {
+                    return false;
+                }
+                glm::vec3 a;
+                glm::vec3 b;
+                if (!readVec3(box ? "a sink's min" : "an outflow's point", item.field(box ? "min" : "point"), a, error) ||
+                    !readVec3(box ? "a sink's max" : "an outflow's normal", item.field(box ? "max" : "normal"), b, error)) {
+                    return false;
+                }
+                if (!box && b == glm::vec3(0.0f)) {
+                    error = "an outflow's normal can't be zero";
+                    return false;
+                }
+                options.sinks.push_back(box ? ParticleSink::box(a, b) : ParticleSink::outflow(a, b));
+            }
+        } else if (key == "inflows") {
+            // { center = [x, y, z], normal = [x, y, z], radius = r, speed = s } disks, size = [w, h] instead of the
+            // radius for rectangles, and an optional rate in cubic metres per second
+            if (!expect(key, value, ConfigValue::ARRAY, error)) {
+                return false;
+            }
+            for (const ConfigValue &item : value.items) {
+                if (!expect("an inflow", item, ConfigValue::TABLE, error)) {
+                    return false;
+                }
+                glm::vec3 center;
+                glm::vec3 normal;
+                glm::vec2 size(0.0f);
+                const ConfigValue *radius = item.field("radius");
+                const ConfigValue *speed = item.field("speed");
+                const ConfigValue *rate = item.field("rate");
+                if (!readVec3("an inflow's center", item.field("center"), center, error) ||
+                    !readVec3("an inflow's normal", item.field("normal"), normal, error)) {
+                    return false;
+                }
+                if (normal == glm::vec3(0.0f)) {
+                    error = "an inflow's normal can't be zero";
+                    return false;
+                }
+                if (!speed || !expect("an inflow's speed", *speed, ConfigValue::NUMBER, error) ||
+                    (rate && !expect("an inflow's rate", *rate, ConfigValue::NUMBER, error)) ||
+                    (radius && !expect("an inflow's radius", *radius, ConfigValue::NUMBER, error))) {
+                    error = speed ? error : "an inflow needs a speed";
+                    return false;
+                }
+                const ConfigValue *extent = item.field("size");
+                if (!radius) {
+                    if (!extent || !expect("an inflow's size", *extent, ConfigValue::ARRAY, error) || extent->items.size() != 2 ||
+                        !expect("an inflow's size", extent->items[0], ConfigValue::NUMBER, error) ||
+                        !expect("an inflow's size", extent->items[1], ConfigValue::NUMBER, error)) {
+                        error = error.empty() ? "an inflow needs a radius or a size = [width, height]" : error;
+                        return false;
+                    }
+                    size = glm::vec2(extent->items[0].number, extent->items[1].number);
+                }
+                float flowRate = rate ? (float) rate->number : 0.0f;
+                options.emitters.push_back(radius ? ParticleEmitter::disk(center, normal, (float) radius->number, (float) speed->number, flowRate)
+                                                  : ParticleEmitter::rectangle(center, normal, size, (float) speed->number, flowRate));
+            }
+        } else if (key == "maxParticles") {
+            if (!expect(key, value, ConfigValue::NUMBER, error)) {
+                return false;
+            }
+            options.maxParticles = (size_t) std::max(value.number, 0.0);
+        } else if (key == "bodies") {
+            // "mesh.obj", or { path = "mesh.obj", density = 0.5 }
+            if (!expect(key, value, ConfigValue::ARRAY, error)) {
+                return false;
+            }
+            for (const ConfigValue &item : value.items) {
+                RigidBodyOptions body;
+                const ConfigValue *path = item.type == ConfigValue::TABLE ? item.field("path") : &item;
+                const ConfigValue *density = item.type == ConfigValue::TABLE ? item.field("density") : nullptr;
+                if (!path) {
+                    error = "a body needs a path";
+                    return false;
+                }
+                if (!expect("a body's path", *path, ConfigValue::STRING, error) ||
+                    (density && !expect("a body's density", *density, ConfigValue::NUMBER, error))) {
+                    return false;
+                }
+                body.path = path->string;
+                if (density) {
+                    body.relativeDensity = (float) density->number;
+                }
+                options.bodies.push_back(body);
+            }
+        } else {
+            return readPlain(key, value, options, error);
+        }
+        return true;
+    }
+}
+
+bool loadSceneConfig(const ConfigFile &config, HeadlessOptions &options, std::string &error) {
+    if (!config.section("").empty()) {
+        error = config.section("").front().first + " is outside of any [section]";
+        return false;
+    }
+    for (const auto &entry : config.section("scene")) {
+        if (!readScene(entry.first, entry.second, options, error)) {
+            return false;
+        }
+    }
+    std::vector<std::string> names = SPHSolver::parameterNames();
+    for (const auto &entry : config.section("parameters")) {
+        if (std::find(names.begin(), names.end(), entry.first) == names.end()) {
+            error = "unknown solver parameter " + entry.first;
+            return false;
+        }
+        if (!expect(entry.first, entry.second, ConfigValue::NUMBER, error)) {
+            return false;
+        }
+        options.parameters.emplace_back(entry.first, entry.second.number);
+    }
+    return true;
+}
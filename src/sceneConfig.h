@@ -0,0 +1,15 @@
+#ifndef SCENE_CONFIG_H
+#define SCENE_CONFIG_H
+
+#include <string>
+
+#include "headless.h"
+#include "utils/ConfigFile.h"
+
+// Scene files (--config): [scene] sets the options of the command line flags of the same name (solver, frames,
+// dt, dtMin, dtMax, cfl, fill, stateCache, sleeping, periodic, taskGraph, sinks, outflows, inflows, maxParticles, ...), [parameters] the solver constants
+// by member name (see SPHSolver::setParameter). Keys the file leaves out keep their value. False with a message
+// on an unknown key or a value of the wrong type.
+bool loadSceneConfig(const ConfigFile &config, HeadlessOptions &options, std::string &error);
+
+#endif // SCENE_CONFIG_H
@@ -0,0 +1,268 @@
+#include "sdfCollider.h"
+#include "utils/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace {
+    // Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+    glm::vec3 closestPointOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+        glm::vec3 ab = b - a;
+        glm::vec3 ac = c - a;
+        glm::vec3 ap = p - a;
+        float d1 = glm::dot(ab, ap);
+        float d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            return a;
+        }
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp);
+        float d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) {
+            return b;
+        }
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            return a + d1 / (d1 - d3) * ab;
+        }
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp);
+        float d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) {
+            return c;
+        }
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            return a + d2 / (d2 - d6) * ac;
+        }
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+            return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+        }
+        float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    // Twice the signed area of the 2D triangle, with a fixed tie-break so points on a shared edge count once
+    float orientation(float x1, float y1, float x2, float y2) {
+        float area = y1 * x2 - x1 * y2;
+        if (area != 0.0f) {
+            return area;
+        }
+        if (y2 > y1 || (y2 == y1 && x1 > x2)) {
+            return 1.0f;
+        }
+        return -1.0f;
+    }
+}
+
+bool SdfCollider::loadObj(const std::string &path, std::vector<glm::vec3> &vertices, std::vector<glm::uvec3> &triangles) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    vertices.clear();
+    triangles.clear();
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string type;
+        fields >> type;
+        if (type == "v") {
+            glm::vec3 vertex;
+            if (!(fields >> vertex.x >> vertex.y >> vertex.z)) {
+                return false;
+            }
+            vertices.push_back(vertex);
+        } else if (type == "f") {
+            // "i", "i/t", "i//n" or "i/t/n", negative indices count back from the last vertex
+            std::vector<unsigned int> polygon;
+            std::string corner;
+            while (fields >> corner) {
+                char *end = nullptr;
+                long index = std::strtol(corner.c_str(), &end, 10);
+                if (end == corner.c_str() || (*end != '\0' && *end != '/') || index == 0) {
+                    return false;
+                }
+                polygon.push_back(index < 0 ? vertices.size() + index : index - 1);
+            }
+            for (size_t k = 2; k < polygon.size(); k++) {
+                triangles.emplace_back(polygon[0], polygon[k - 1], polygon[k]);
+            }
+        }
+    }
+    for (const glm::uvec3 &triangle : triangles) {
+        if (triangle.x >= vertices.size() || triangle.y >= vertices.size() || triangle.z >= vertices.size()) {
+            return false;
+        }
+    }
+    return !triangles.empty();
+}
+
+SdfCollider::SdfCollider(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, float cellSize, int bandCells) :
+        _vertices(vertices),
+        _triangles(triangles),
+        _cellSize(cellSize),
+        _band(bandCells * cellSize) {
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(-std::numeric_limits<float>::max());
+    for (const glm::vec3 &vertex : vertices) {
+        low = glm::min(low, vertex);
+        high = glm::max(high, vertex);
+    }
+    _meshLow = low;
+    _meshHigh = high;
+    _origin = low - glm::vec3((bandCells + 1) * cellSize);
+    _size = glm::ivec3(glm::ceil((high - low) / cellSize)) + 2 * (bandCells + 1) + 1;
+    int pointCount = _size.x * _size.y * _size.z;
+    _phi.assign(pointCount, _band);
+
+    // Unsigned distance in the band, each slab of k owns its points so triangles can be split by slab in parallel
+    ThreadPool::instance().parallelFor(0, _size.z, [&](int begin, int end) {
+        for (const glm::uvec3 &triangle : triangles) {
+            glm::vec3 a = vertices[triangle.x];
+            glm::vec3 b = vertices[triangle.y];
+            glm::vec3 c = vertices[triangle.z];
+            glm::ivec3 first = glm::max(glm::ivec3(glm::floor((glm::min(a, glm::min(b, c)) - _origin) / cellSize)) - bandCells, glm::ivec3(0));
+            glm::ivec3 last = glm::min(glm::ivec3(glm::ceil((glm::max(a, glm::max(b, c)) - _origin) / cellSize)) + bandCells, _size - 1);
+            for (int k = std::max(first.z, begin); k <= std::min(last.z, end - 1); k++) {
+                for (int j = first.y; j <= last.y; j++) {
+                    for (int i = first.x; i <= last.x; i++) {
+                        glm::vec3 point = _origin + glm::vec3(i, j, k) * cellSize;
+                        float &phi = _phi[i + _size.x * (j + _size.y * k)];
+                        phi = std::min(phi, glm::length(point - closestPointOnTriangle(point, a, b, c)));
+                    }
+                }
+            }
+        }
+    }, 1);
+
+    // Sign from the parity of the crossings along +x (as in Bridson's SDFGen): every triangle marks the
+    // grid interval where it crosses each (j, k) row it covers
+    std::vector<int> crossings(pointCount, 0);
+    for (const glm::uvec3 &triangle : triangles) {
+        glm::vec3 a = (vertices[triangle.x] - _origin) / cellSize;
+        glm::vec3 b = (vertices[triangle.y] - _origin) / cellSize;
+        glm::vec3 c = (vertices[triangle.z] - _origin) / cellSize;
+        int firstJ = std::max((int) std::ceil(std::min({a.y, b.y, c.y})), 0);
+        int lastJ = std::min((int) std::floor(std::max({a.y, b.y, c.y})), _size.y - 1);
+        int firstK = std::max((int) std::ceil(std::min({a.z, b.z, c.z})), 0);
+        int lastK = std::min((int) std::floor(std::max({a.z, b.z, c.z})), _size.z - 1);
+        for (int k = firstK; k <= lastK; k++) {
+            for (int j = firstJ; j <= lastJ; j++) {
+                float ay = a.y - j, az = a.z - k;
+                float by = b.y - j, bz = b.z - k;
+                float cy = c.y - j, cz = c.z - k;
+                float wa = orientation(by, bz, cy, cz);
+                float wb = orientation(cy, cz, ay, az);
+                float wc = orientation(ay, az, by, bz);
+                if ((wa < 0.0f || wb < 0.0f || wc < 0.0f) && (wa > 0.0f || wb > 0.0f || wc > 0.0f)) {
+                    continue;
+                }
+                float x = (wa * a.x + wb * b.x + wc * c.x) / (wa + wb + wc);
+                int interval = std::max((int) std::ceil(x), 0);
+                if (interval < _size.x) {
+                    crossings[interval + _size.x * (j + _size.y * k)]++;
+                }
+            }
+        }
+    }
+    ThreadPool::instance().parallelFor(0, _size.y * _size.z, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            int total = 0;
+            for (int i = 0; i < _size.x; i++) {
+                int index = i + _size.x * row;
+                total += crossings[index];
+                if (total % 2 == 1) {
+                    _phi[index] = -_phi[index];
+                }
+            }
+        }
+    }, 64);
+}
+
+void SdfCollider::setVelocity(const glm::vec3 &linear, const glm::vec3 &angular, const glm::vec3 &center) {
+    _linearVelocity = linear;
+    _angularVelocity = angular;
+    _velocityCenter = center;
+}
+
+void SdfCollider::worldBounds(glm::vec3 &low, glm::vec3 &high) const {
+    low = glm::vec3(std::numeric_limits<float>::max());
+    high = glm::vec3(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 point((corner & 1) ? _meshHigh.x : _meshLow.x, (corner & 2) ? _meshHigh.y : _meshLow.y, (corner & 4) ? _meshHigh.z : _meshLow.z);
+        point = _rotation * point + _translation;
+        low = glm::min(low, point);
+        high = glm::max(high, point);
+    }
+}
+
+bool SdfCollider::locate(const glm::vec3 &position, glm::ivec3 &cell, glm::vec3 &weights) const {
+    // the rotation is orthonormal, its transpose takes world offsets back to mesh coordinates
+    glm::vec3 local = (glm::transpose(_rotation) * (position - _translation) - _origin) / _cellSize;
+    if (local.x < 0.0f || local.y < 0.0f || local.z < 0.0f ||
+        local.x >= _size.x - 1 || local.y >= _size.y - 1 || local.z >= _size.z - 1) {
+        return false;
+    }
+    cell = glm::ivec3(local);
+    weights = local - glm::vec3(cell);
+    return true;
+}
+
+float SdfCollider::distance(const glm::vec3 &position) const {
+    glm::ivec3 c;
+    glm::vec3 w;
+    if (!locate(position, c, w)) {
+        return _band;
+    }
+    float x00 = glm::mix(value(c.x, c.y, c.z), value(c.x + 1, c.y, c.z), w.x);
+    float x10 = glm::mix(value(c.x, c.y + 1, c.z), value(c.x + 1, c.y + 1, c.z), w.x);
+    float x01 = glm::mix(value(c.x, c.y, c.z + 1), value(c.x + 1, c.y, c.z + 1), w.x);
+    float x11 = glm::mix(value(c.x, c.y + 1, c.z + 1), value(c.x + 1, c.y + 1, c.z + 1), w.x);
+    return glm::mix(glm::mix(x00, x10, w.y), glm::mix(x01, x11, w.y), w.z);
+}
+
+glm::vec3 SdfCollider::normal(const glm::vec3 &position) const {
+    glm::ivec3 c;
+    glm::vec3 w;
+    if (!locate(position, c, w)) {
+        return glm::vec3(0.0f);
+    }
+    float v000 = value(c.x, c.y, c.z), v100 = value(c.x + 1, c.y, c.z);
+    float v010 = value(c.x, c.y + 1, c.z), v110 = value(c.x + 1, c.y + 1, c.z);
+    float v001 = value(c.x, c.y, c.z + 1), v101 = value(c.x + 1, c.y, c.z + 1);
+    float v011 = value(c.x, c.y + 1, c.z + 1), v111 = value(c.x + 1, c.y + 1, c.z + 1);
+    glm::vec3 gradient(
+        glm::mix(glm::mix(v100 - v000, v110 - v010, w.y), glm::mix(v101 - v001, v111 - v011, w.y), w.z),
+        glm::mix(glm::mix(v010 - v000, v110 - v100, w.x), glm::mix(v011 - v001, v111 - v101, w.x), w.z),
+        glm::mix(glm::mix(v001 - v000, v101 - v100, w.x), glm::mix(v011 - v010, v111 - v110, w.x), w.y));
+    float length = glm::length(gradient);
+    return length > 1e-6f ? _rotation * (gradient / length) : glm::vec3(0.0f);
+}
+
+glm::vec3 SdfCollider::project(glm::vec3 &position, float radius) const {
+    float d = distance(position);
+    if (d >= radius) {
+        return glm::vec3(0.0f);
+    }
+    glm::vec3 n = normal(position);
+    position += (radius - d) * n;
+    return n;
+}
+
+bool SdfCollider::resolve(glm::vec3 &position, glm::vec3 &velocity, float radius) const {
+    glm::vec3 n = project(position, radius);
+    if (n == glm::vec3(0.0f)) {
+        return false;
+    }
+    float approach = glm::dot(velocity - velocityAt(position), n);
+    if (approach < 0.0f) {
+        velocity -= approach * n;
+    }
+    return true;
+}
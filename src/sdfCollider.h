@@ -0,0 +1,64 @@
+#ifndef SDF_COLLIDER_H
+#define SDF_COLLIDER_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Obstacle given by a closed triangle mesh. At setup the mesh is voxelised into a signed distance field
+// (negative inside) on a regular grid. Exact distances are only computed in a narrow band around the surface,
+// the rest of the grid is clamped to +-band. A particle then costs one trilinear lookup and a gradient, whatever
+// the triangle count. The field is stored in mesh coordinates, a rigid pose places it in the world, so moving
+// the obstacle never re-voxelises it.
+class SdfCollider {
+public:
+    // Reads the v and f records of a Wavefront OBJ, polygons are fanned into triangles
+    static bool loadObj(const std::string &path, std::vector<glm::vec3> &vertices, std::vector<glm::uvec3> &triangles);
+
+    SdfCollider(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, float cellSize, int bandCells);
+
+    // world = rotation * mesh + translation
+    void setPose(const glm::mat3 &rotation, const glm::vec3 &translation) { _rotation = rotation; _translation = translation; }
+    // Rigid velocity of the surface: linear is the velocity of the world point center, angular is about it
+    void setVelocity(const glm::vec3 &linear, const glm::vec3 &angular, const glm::vec3 &center);
+    glm::vec3 velocityAt(const glm::vec3 &position) const { return _linearVelocity + glm::cross(_angularVelocity, position - _velocityCenter); }
+    // Axis-aligned world bounds of the mesh at the current pose
+    void worldBounds(glm::vec3 &low, glm::vec3 &high) const;
+
+    // Trilinear distance, positive outside; past the grid it is the band width
+    float distance(const glm::vec3 &position) const;
+    // Outward normal from the gradient of the trilinear interpolant, zero where the field is flat
+    glm::vec3 normal(const glm::vec3 &position) const;
+
+    // Moves a position closer than radius to the surface back out, returns the normal it was pushed along
+    // (zero when nothing happened)
+    glm::vec3 project(glm::vec3 &position, float radius) const;
+    // project, then drops the velocity into the surface relative to the surface's own velocity
+    bool resolve(glm::vec3 &position, glm::vec3 &velocity, float radius) const;
+
+    const std::vector<glm::vec3> &getVertices() const { return _vertices; }
+    const std::vector<glm::uvec3> &getTriangles() const { return _triangles; }
+
+private:
+    float value(int i, int j, int k) const { return _phi[i + _size.x * (j + _size.y * k)]; }
+    // Cell and in-cell weights of a world position, false outside the grid
+    bool locate(const glm::vec3 &position, glm::ivec3 &cell, glm::vec3 &weights) const;
+
+    std::vector<glm::vec3> _vertices;
+    std::vector<glm::uvec3> _triangles;
+    glm::vec3 _meshLow;
+    glm::vec3 _meshHigh;
+    glm::mat3 _rotation = glm::mat3(1.0f);
+    glm::vec3 _translation = glm::vec3(0.0f);
+    glm::vec3 _linearVelocity = glm::vec3(0.0f);
+    glm::vec3 _angularVelocity = glm::vec3(0.0f);
+    glm::vec3 _velocityCenter = glm::vec3(0.0f);
+    glm::vec3 _origin;
+    glm::ivec3 _size;       // grid points per axis
+    float _cellSize;
+    float _band;
+    std::vector<float> _phi;
+};
+
+#endif // SDF_COLLIDER_H
@@ -0,0 +1,23 @@
+#version 330 core
+
+in vec3 eyeCenter;
+
+uniform mat4 projection;
+uniform float pointRadius;
+
+out float depth; // Linear eye-space depth, 0 where there is no fluid
+
+void main() {
+    vec2 xy = gl_PointCoord * 2.0 - 1.0;
+    xy.y = -xy.y;
+    float r2 = dot(xy, xy);
+    if (r2 > 1.0) {
+        discard;
+    }
+
+    // front point of the sphere covered by this fragment
+    vec3 eyePos = eyeCenter + vec3(xy, sqrt(1.0 - r2)) * pointRadius;
+    vec4 clipPos = projection * vec4(eyePos, 1.0);
+    gl_FragDepth = clipPos.z / clipPos.w * 0.5 + 0.5;
+    depth = -eyePos.z;
+}
@@ -0,0 +1,56 @@
+#version 330 core
+
+in vec2 texCoord;
+
+uniform sampler2D depthTexture;
+uniform sampler2D thicknessTexture;
+uniform mat4 projection;
+uniform vec2 texelSize;
+uniform vec3 lightPos;    // Eye space
+uniform vec4 fluidColor;
+uniform float absorption;
+
+out vec4 FragColor;
+
+vec3 eyePosition(vec2 uv) {
+    float depth = texture(depthTexture, uv).r;
+    vec2 ndc = uv * 2.0 - 1.0;
+    return vec3(ndc.x * depth / projection[0][0], ndc.y * depth / projection[1][1], -depth);
+}
+
+void main() {
+    float depth = texture(depthTexture, texCoord).r;
+    if (depth <= 0.0) {
+        discard;
+    }
+    vec3 position = eyePosition(texCoord);
+
+    // use the smaller difference on each axis so silhouettes don't smear the normal
+    vec3 ddx = eyePosition(texCoord + vec2(texelSize.x, 0.0)) - position;
+    vec3 ddx2 = position - eyePosition(texCoord - vec2(texelSize.x, 0.0));
+    if (abs(ddx.z) > abs(ddx2.z)) {
+        ddx = ddx2;
+    }
+    vec3 ddy = eyePosition(texCoord + vec2(0.0, texelSize.y)) - position;
+    vec3 ddy2 = position - eyePosition(texCoord - vec2(0.0, texelSize.y));
+    if (abs(ddy.z) > abs(ddy2.z)) {
+        ddy = ddy2;
+    }
+    vec3 normal = normalize(cross(ddx, ddy));
+
+    float thickness = texture(thicknessTexture, texCoord).r;
+    vec3 transmitted = fluidColor.rgb * exp(-(1.0 - fluidColor.rgb) * thickness * absorption);
+
+    vec3 light = normalize(lightPos - position);
+    vec3 viewDir = normalize(-position);
+    float diffuse = max(dot(normal, light), 0.0) * 0.5 + 0.5;
+    float specular = pow(max(dot(normal, normalize(light + viewDir)), 0.0), 64.0);
+    float fresnel = 0.1 + 0.9 * pow(1.0 - max(dot(normal, viewDir), 0.0), 5.0);
+
+    vec3 result = mix(transmitted * diffuse, vec3(0.8, 0.9, 1.0), fresnel * 0.5) + vec3(specular);
+    float alpha = clamp(1.0 - exp(-thickness * absorption), fresnel, 1.0);
+
+    vec4 clipPos = projection * vec4(position, 1.0);
+    gl_FragDepth = clipPos.z / clipPos.w * 0.5 + 0.5;
+    FragColor = vec4(result, alpha);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+
+in vec2 texCoord;
+
+uniform sampler2D depthTexture;
+uniform vec2 direction;     // One texel along the filtered axis
+uniform int filterRadius;   // In pixels
+uniform float depthFalloff; // Depth difference at which neighbours stop contributing
+
+out float depth;
+
+// One pass of a separable bilateral filter. Samples far behind or in front of the center are
+// clamped to a narrow range around it, so silhouettes are kept while flat areas are smoothed.
+void main() {
+    float center = texture(depthTexture, texCoord).r;
+    if (center <= 0.0) {
+        depth = 0.0;
+        return;
+    }
+
+    float sigma = max(float(filterRadius) * 0.5, 1.0);
+    float sum = 0.0;
+    float weightSum = 0.0;
+    for (int i = -filterRadius; i <= filterRadius; i++) {
+        float sampleDepth = texture(depthTexture, texCoord + float(i) * direction).r;
+        if (sampleDepth <= 0.0) {
+            continue;
+        }
+        sampleDepth = clamp(sampleDepth, center - depthFalloff, center + depthFalloff);
+        float difference = (sampleDepth - center) / depthFalloff;
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma)) * exp(-difference * difference);
+        sum += sampleDepth * weight;
+        weightSum += weight;
+    }
+    depth = sum / weightSum;
+}
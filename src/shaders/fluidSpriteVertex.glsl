@@ -0,0 +1,18 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos; // Particle center
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float pointRadius;
+uniform float screenHeight;
+
+out vec3 eyeCenter; // Particle center in eye space
+
+void main() {
+    vec4 eyePos = view * vec4(aPos, 1.0);
+    eyeCenter = eyePos.xyz;
+    gl_Position = projection * eyePos;
+    // projected diameter of the sphere in pixels
+    gl_PointSize = pointRadius * projection[1][1] * screenHeight / -eyePos.z;
+}
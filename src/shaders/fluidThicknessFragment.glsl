@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform float pointRadius;
+
+out float thickness; // Summed with additive blending
+
+void main() {
+    vec2 xy = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(xy, xy);
+    if (r2 > 1.0) {
+        discard;
+    }
+    thickness = 2.0 * sqrt(1.0 - r2) * pointRadius;
+}
@@ -3,6 +3,7 @@
 layout (location = 0) in vec3 aPos;   // Position attribute
 layout (location = 1) in vec4 aColor; // Color attribute
 layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec3 aOffset; // Per instance, (0, 0, 0) when not instanced
 
 uniform mat4 model;
 uniform mat4 view;
@@ -14,6 +15,6 @@ out vec3 fragPosition;
 
 void main() {
     vertexColor = aColor;
-    vertexNormal = aNormal;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vertexNormal = mat3(model) * aNormal;   // models are rigid, no inverse transpose needed
+    gl_Position = projection * view * model * vec4(aPos + aOffset, 1.0);
 }
\ No newline at end of file
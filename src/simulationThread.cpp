@@ -0,0 +1,95 @@
+#include "simulationThread.h"
+
+#include <algorithm>
+#include <chrono>
+
+SimulationThread::SimulationThread(SPHSolver &solver, TimestepController &timestep, float maxDt) :
+        _solver(solver),
+        _timestep(timestep),
+        _maxDt(maxDt) {}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (_running) {
+        return;
+    }
+    _running = true;
+    // the step copies the particles into the snapshot itself, block by block when it runs as a task graph
+    // sinks and emitters change the count at the start of the step, the snapshot follows it before the first
+    // block is copied. Resizing keeps the slot's storage, so after a few steps no snapshot allocates.
+    _solver.setStepExportCount([this](size_t count) {
+        _snapshots.writeBuffer().particles.resize(count);
+    });
+    _solver.setStepExport([this](const std::vector<Particle> &particles, int first, int last) {
+        std::copy(particles.begin() + first, particles.begin() + last, _snapshots.writeBuffer().particles.begin() + first);
+    });
+    _thread = std::thread([this]() { run(); });
+}
+
+void SimulationThread::stop() {
+    _running = false;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    _solver.setStepExport(nullptr);
+    _solver.setStepExportCount(nullptr);
+}
+
+const SolverSnapshot &SimulationThread::latest() {
+    _snapshots.update();
+    return _snapshots.readBuffer();
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+    Clock::time_point rateStart = start;
+    float startTime = _solver.getSimulationTime();
+    int stepsSinceRate = 0;
+    long steps = 0;
+    while (_running) {
+        if (_paused) {
+            _solver.pause();
+        } else {
+            _solver.unpause();
+        }
+        for (int spawns = _spawnRequests.exchange(0); spawns > 0; spawns--) {
+            _solver.spawnParticles();
+        }
+        for (int switches = _solverSwitches.exchange(0); switches > 0; switches--) {
+            _solver.setSolverMode((SolverMode) ((_solver.getSolverMode() + 1) % (SOLVER_PBF + 1)));
+            _timestep.setBounds(_timestep.getMinDt(), _maxDt > 0.0f ? _maxDt : _solver.getMaxStableTimestep());
+        }
+
+        SolverSnapshot &snapshot = _snapshots.writeBuffer();
+        float dt = _timestep.computeTimestep(_solver.getParticles(), _solver.getSmoothingLength());
+        _solver.step(dt);
+        steps++;
+
+        snapshot.colliderModels = _solver.getColliderModels();
+        snapshot.time = _solver.getSimulationTime();
+        snapshot.dt = dt;
+        snapshot.step = steps;
+        _snapshots.publish();
+
+        Clock::time_point now = Clock::now();
+        stepsSinceRate++;
+        float rateSeconds = std::chrono::duration<float>(now - rateStart).count();
+        if (rateSeconds >= 1.0f) {
+            _stepRate = stepsSinceRate / rateSeconds;
+            stepsSinceRate = 0;
+            rateStart = now;
+        }
+        // not ahead of the wall clock, a slow step lets it fall behind for good instead of catching up later
+        float ahead = (_solver.getSimulationTime() - startTime) - std::chrono::duration<float>(now - start).count();
+        if (ahead > 0.0f) {
+            std::this_thread::sleep_for(std::chrono::duration<float>(ahead));
+        } else {
+            start = now;
+            startTime = _solver.getSimulationTime();
+        }
+    }
+}
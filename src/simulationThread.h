@@ -0,0 +1,64 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "sphSolver.h"
+#include "timestepController.h"
+#include "utils/TripleBuffer.h"
+
+// What the renderer needs from one solver step, copied out so drawing never reads the live state
+struct SolverSnapshot {
+    std::vector<Particle> particles;
+    std::vector<glm::mat4> colliderModels;
+    float time = 0.0f;
+    float dt = 0.0f;
+    long step = 0;              // 0 before the first step
+};
+
+// Steps the solver on its own thread and publishes a snapshot after every step through a triple buffer, so the
+// render loop draws the newest state at display rate while the solver runs at its own pace. The simulation is
+// held to real time: a step that would get ahead of the wall clock waits.
+// Once started, the solver and the timestep controller belong to this thread until stop(); the render thread
+// only talks to it through the commands below.
+class SimulationThread {
+public:
+    // maxDt is kept as the controller's max across solver switches, 0 follows the max stable timestep of the solver
+    SimulationThread(SPHSolver &solver, TimestepController &timestep, float maxDt = 0.0f);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    void start();
+    // Finishes the step under way and joins the thread
+    void stop();
+
+    // Commands, applied before the next step
+    void setPaused(bool paused) { _paused = paused; }
+    void requestSpawn() { _spawnRequests++; }
+    void requestSolverSwitch() { _solverSwitches++; }
+
+    // Render thread: the newest snapshot, valid until the next call
+    const SolverSnapshot &latest();
+    // Steps per second over the last second or so
+    float getStepRate() const { return _stepRate; }
+
+private:
+    void run();
+
+    SPHSolver &_solver;
+    TimestepController &_timestep;
+    float _maxDt;
+    TripleBuffer<SolverSnapshot> _snapshots;
+    std::thread _thread;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _paused{false};
+    std::atomic<int> _spawnRequests{0};
+    std::atomic<int> _solverSwitches{0};
+    std::atomic<float> _stepRate{0.0f};
+};
+
+#endif // SIMULATION_THREAD_H
@@ -1,5 +1,55 @@
 #include "sphSolver.h"
+#include "kernels.h"
+#include "utils/AllocationCounter.h"
+#include "utils/Numa.h"
+#include "utils/ThreadPool.h"
+#include "utils/util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+namespace {
+    // A point closer than this fraction of the rest spacing to a particle counts as covered by fluid, for the
+    // emitters and removeOccupied
+    const float OCCUPIED_SPACING = 0.9f;
+
+    // Appends count particles whose positions and velocities are given by positionOf(i) and velocityOf(i), in parallel for large counts
+    void emit(std::vector<Particle> &particles, Grid &grid, int count, FunctionRef<glm::vec3(int)> positionOf,
+              FunctionRef<glm::vec3(int)> velocityOf, float radius, float mass, bool paused) {
+        int first = particles.size();
+        particles.resize(first + count);
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Particle &particle = particles[first + i];
+                particle = Particle(positionOf(i), radius, first + i);
+                particle.velocity = velocityOf(i);
+                particle.mass = mass;
+                particle.paused = paused;
+            }
+        }, 4096);
+        grid.insertParticles(first, first + count);
+    }
+
+    // Samples the parallelogram origin + a * u + b * v, a and b in [0, 1], edges included. An edge direction
+    // that wraps around stops short of 1, the far edge is the first one again.
+    void samplePlane(std::vector<glm::vec3> &samples, glm::vec3 origin, glm::vec3 u, glm::vec3 v, float spacing,
+                     bool wrapU = false, bool wrapV = false) {
+        int countU = (int) std::round(glm::length(u) / spacing);
+        int countV = (int) std::round(glm::length(v) / spacing);
+        for (int b = 0; b < countV + !wrapV; b++) {
+            for (int a = 0; a < countU + !wrapU; a++) {
+                samples.push_back(origin + u * ((float) a / countU) + v * ((float) b / countV));
+            }
+        }
+    }
+}
 
 SPHSolver::SPHSolver(std::shared_ptr<std::vector<Particle>> particles, std::shared_ptr<ShaderProgram> shaderProgram) :
         particles(particles),
@@ -9,75 +59,1725 @@ SPHSolver::SPHSolver(std::shared_ptr<std::vector<Particle>> particles, std::shar
         Leftplane(shaderProgram, glm::vec3(-10.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), 1.0f),
         Rightplane(shaderProgram, glm::vec3(10.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), 1.0f),
         Frontplane(glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+        particleMesh(SPHERE, shaderProgram),
         grid(Yplane, Backplane, Leftplane, Rightplane, Frontplane, 2, particles)
-    {}
+    {
+        for (unsigned int thread = 0; thread < ThreadPool::instance().size(); thread++) {
+            scratchArenas.push_back(std::make_unique<Arena>());
+        }
+        updateDerivedConstants();
+        cellQuietSteps.assign(grid.grid.size(), 0);
+        cellSleepingCount.assign(grid.grid.size(), -1);
+        cellDisturbed.assign(grid.grid.size(), 0);
+        particleMesh.makeSphere(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), 0.5f * restSpacing, 16, 8);
+    }
+
+void SPHSolver::updateDerivedConstants() {
+    particleMass = restDensity * Particle::Radius() * Particle::Radius() * Particle::Radius();
+    restSpacing = latticeRestSpacing(particleMass, restDensity, effectLength);
+
+    // constraint gradient of a particle with a full neighbourhood, it scales the PCISPH and PBF corrections
+    glm::vec3 gradientSum(0.0f);
+    float gradientSquares = 0.0f;
+    int reach = (int) std::ceil(effectLength / restSpacing);
+    for (int z = -reach; z <= reach; z++) {
+        for (int y = -reach; y <= reach; y++) {
+            for (int x = -reach; x <= reach; x++) {
+                glm::vec3 gradient = spikyGradient(glm::vec3(x, y, z) * restSpacing, effectLength);
+                gradientSum += gradient;
+                gradientSquares += glm::dot(gradient, gradient);
+            }
+        }
+    }
+    float massRatio = particleMass / restDensity;
+    latticeGradientNorm = massRatio * massRatio * (glm::dot(gradientSum, gradientSum) + gradientSquares);
+    pcisphStiffness = 0.5f / latticeGradientNorm;
+
+    // the layer stands in for the whole half-space behind the wall, its volumes are scaled so that a lattice
+    // resting against it is at rest density
+    float fluidSide = 0.0f;
+    float planeSelf = 0.0f;
+    float planeBehind = 0.0f;
+    for (int z = -reach; z <= reach; z++) {
+        for (int x = -reach; x <= reach; x++) {
+            planeSelf += poly6(glm::dot(glm::vec3(x, 0, z), glm::vec3(x, 0, z)) * restSpacing * restSpacing, effectLength);
+            planeBehind += poly6(glm::dot(glm::vec3(x, 1, z), glm::vec3(x, 1, z)) * restSpacing * restSpacing, effectLength);
+            for (int y = 0; y <= reach; y++) {
+                fluidSide += particleMass * poly6(glm::dot(glm::vec3(x, y, z), glm::vec3(x, y, z)) * restSpacing * restSpacing, effectLength);
+            }
+        }
+    }
+    boundaryVolumeScale = (restDensity - fluidSide) / (restDensity * planeBehind / planeSelf);
+    buildStaticBoundary();
+    for (size_t e = 0; e < emitters.size(); e++) {
+        emitterOpenings[e] = emitters[e].opening(restSpacing);
+    }
+}
+
+const std::vector<std::pair<std::string, float SPHSolver::*>> &SPHSolver::floatParameters() {
+    static const std::vector<std::pair<std::string, float SPHSolver::*>> table = {
+        {"pressureConstant", &SPHSolver::pressureConstant},
+        {"restDensity", &SPHSolver::restDensity},
+        {"gasConstant", &SPHSolver::gasConstant},
+        {"nearGasConstant", &SPHSolver::nearGasConstant},
+        {"collisionDamping", &SPHSolver::collisionDamping},
+        {"viscosityConstant", &SPHSolver::viscosityConstant},
+        {"effectLength", &SPHSolver::effectLength},
+        {"densityTolerance", &SPHSolver::densityTolerance},
+        {"maxDensityTolerance", &SPHSolver::maxDensityTolerance},
+        {"pcisphContactFraction", &SPHSolver::pcisphContactFraction},
+        {"pbfRelaxation", &SPHSolver::pbfRelaxation},
+        {"pbfCorrectionStrength", &SPHSolver::pbfCorrectionStrength},
+        {"pbfCorrectionDistance", &SPHSolver::pbfCorrectionDistance},
+        {"xsphViscosity", &SPHSolver::xsphViscosity},
+        {"sleepVelocity", &SPHSolver::sleepVelocity},
+        {"sleepDensityError", &SPHSolver::sleepDensityError},
+    };
+    return table;
+}
+
+const std::vector<std::pair<std::string, int SPHSolver::*>> &SPHSolver::intParameters() {
+    static const std::vector<std::pair<std::string, int SPHSolver::*>> table = {
+        {"minPressureIterations", &SPHSolver::minPressureIterations},
+        {"maxPressureIterations", &SPHSolver::maxPressureIterations},
+        {"pbfIterations", &SPHSolver::pbfIterations},
+        {"sleepSteps", &SPHSolver::sleepSteps},
+    };
+    return table;
+}
+
+std::vector<std::string> SPHSolver::parameterNames() {
+    std::vector<std::string> names;
+    for (const auto &parameter : floatParameters()) {
+        names.push_back(parameter.first);
+    }
+    for (const auto &parameter : intParameters()) {
+        names.push_back(parameter.first);
+    }
+    return names;
+}
+
+bool SPHSolver::setParameter(const std::string &name, double value) {
+    std::string error;
+    return setParameters({{name, value}}, error);
+}
+
+bool SPHSolver::setParameters(const std::vector<std::pair<std::string, double>> &parameters, std::string &error) {
+    // all or nothing, a bad value leaves the solver as it was
+    for (const auto &parameter : parameters) {
+        if (!validParameter(parameter.first, parameter.second)) {
+            error = "invalid parameter " + parameter.first + " = " + std::to_string(parameter.second);
+            return false;
+        }
+    }
+    bool changed = false;
+    for (const auto &parameter : parameters) {
+        assignParameter(parameter.first, parameter.second, changed);
+    }
+    if (changed) {
+        updateDerivedConstants();
+    }
+    return true;
+}
+
+bool SPHSolver::validParameter(const std::string &name, double value) const {
+    if (!std::isfinite(value) || value < 0.0) {
+        return false;
+    }
+    for (const auto &parameter : intParameters()) {
+        if (parameter.first == name) {
+            return true;
+        }
+    }
+    for (const auto &parameter : floatParameters()) {
+        if (parameter.first != name) {
+            continue;
+        }
+        if ((name == "restDensity" || name == "effectLength") && value == 0.0) {
+            return false;
+        }
+        // the neighbour search only looks one cell around, the kernel can't reach further
+        return name != "effectLength" || value <= grid.size;
+    }
+    return false;
+}
+
+void SPHSolver::assignParameter(const std::string &name, double value, bool &changed) {
+    for (const auto &parameter : intParameters()) {
+        if (parameter.first == name) {
+            this->*parameter.second = (int) std::lround(value);
+            return;
+        }
+    }
+    for (const auto &parameter : floatParameters()) {
+        if (parameter.first == name) {
+            // only these two set the mass, the spacing and the boundary samples
+            bool derived = name == "restDensity" || name == "effectLength";
+            changed = changed || (derived && this->*parameter.second != (float) value);
+            this->*parameter.second = (float) value;
+            return;
+        }
+    }
+}
+
+bool SPHSolver::getParameter(const std::string &name, double &value) const {
+    for (const auto &parameter : floatParameters()) {
+        if (parameter.first == name) {
+            value = this->*parameter.second;
+            return true;
+        }
+    }
+    for (const auto &parameter : intParameters()) {
+        if (parameter.first == name) {
+            value = this->*parameter.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SPHSolver::buildStaticBoundary() {
+    // one layer of boundary samples at rest spacing on the floor and the four walls, up to the grid's height.
+    // The layer sits half a spacing behind the wall, so fluid resting against it is a full spacing away. Along a
+    // periodic axis the planes span exactly one period, so the layer continues seamlessly across the seam.
+    glm::bvec3 periodic = grid.periodic;
+    glm::vec3 inset = 0.5f * restSpacing * glm::vec3(!periodic.x, !periodic.y, !periodic.z);
+    glm::vec3 corner = grid.origin - inset;
+    glm::vec3 extent = glm::vec3(grid.Width, grid.Height, grid.Depth) + 2.0f * inset;
+    std::vector<glm::vec3> samples;
+    if (!periodic.y) {
+        samplePlane(samples, corner, glm::vec3(extent.x, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, extent.z), restSpacing, periodic.x, periodic.z);
+    }
+    if (!periodic.x) {
+        samplePlane(samples, corner, glm::vec3(0.0f, extent.y, 0.0f), glm::vec3(0.0f, 0.0f, extent.z), restSpacing, periodic.y, periodic.z);
+        samplePlane(samples, corner + glm::vec3(extent.x, 0.0f, 0.0f), glm::vec3(0.0f, extent.y, 0.0f), glm::vec3(0.0f, 0.0f, extent.z), restSpacing, periodic.y, periodic.z);
+    }
+    if (!periodic.z) {
+        samplePlane(samples, corner, glm::vec3(extent.x, 0.0f, 0.0f), glm::vec3(0.0f, extent.y, 0.0f), restSpacing, periodic.x, periodic.y);
+        samplePlane(samples, corner + glm::vec3(0.0f, 0.0f, extent.z), glm::vec3(extent.x, 0.0f, 0.0f), glm::vec3(0.0f, extent.y, 0.0f), restSpacing, periodic.x, periodic.y);
+    }
+    staticBoundary.build(samples, grid, effectLength, boundaryVolumeScale);
+    // sorted against the old grid, the next step gathers them again
+    bodySamples = BoundaryParticles();
+}
+
+void SPHSolver::setPeriodicAxes(glm::bvec3 axes) {
+    grid.setPeriodic(axes);
+    // the blocks of the task graph only wrap around along a periodic z
+    taskGraph.clear();
+    buildStaticBoundary();
+    for (Particle &particle : *particles) {
+        grid.wrap(particle.position);
+        grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
+    }
+}
 
 void SPHSolver::update(float dt) {
+    renderBoundaries(colliderModels);
+    step(dt);
+    if (drawParticles) {
+        renderParticles(*particles);
+    }
+}
+
+void SPHSolver::renderBoundaries(const std::vector<glm::mat4> &models) {
     Yplane.render();
-    Backplane.render();
-    Leftplane.render();
-    Rightplane.render();
+    if (!grid.periodic.z) {
+        Backplane.render();
+    }
+    if (!grid.periodic.x) {
+        Leftplane.render();
+        Rightplane.render();
+    }
+    for (size_t c = 0; c < colliderMeshes.size() && c < models.size(); c++) {
+        colliderMeshes[c]->setModelMatrix(models[c]);
+        colliderMeshes[c]->render();
+    }
+}
+
+void SPHSolver::step(float dt) {
+    unsigned long long allocationsBefore = AllocationCounter::count();
+    for (std::unique_ptr<Arena> &arena : scratchArenas) {
+        arena->reset();
+    }
+    if (!sinks.empty()) {
+        // paused particles are left alone, they include the halo copies a distributed run keeps at the tail
+        removeParticles([&](const Particle &particle) {
+            for (const ParticleSink &sink : sinks) {
+                if (!particle.paused && sink.contains(particle.position)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+    if (!emitters.empty()) {
+        emitInflow(dt);
+    }
+    if (stepExportCount) {
+        stepExportCount(particles->size());
+    }
+    if (memoryPlacement != PLACEMENT_FIRST_TOUCH) {
+        bool sorted = ++stepsSinceSort >= sortInterval;
+        if (sorted) {
+            sortParticlesByCell();
+            stepsSinceSort = 0;
+        }
+        placeParticleArrays(sorted);
+    }
+    // collisions all happen after integration, so the obstacles are posed at the end of the step
+    simulationTime += dt;
+    if (collidersMoving) {
+        updateColliders(simulationTime);
+    }
+    if (!bodies.empty()) {
+        gatherBodySamples();
+    }
+    if (solverMode == SOLVER_PCISPH) {
+        stepPCISPH(dt);
+    } else if (solverMode == SOLVER_PBF && taskGraphEnabled) {
+        stepPBFGraph(dt);
+    } else if (solverMode == SOLVER_PBF) {
+        stepPBF(dt);
+    } else {
+        stepContact(dt);
+    }
+    if (!bodies.empty()) {
+        integrateRigidBodies(dt);
+        updateColliders(simulationTime);
+    }
+    if (sleepingEnabled) {
+        updateSleeping();
+    }
+    // the task graph exports every block as soon as its densities are done
+    if (stepExport && !(solverMode == SOLVER_PBF && taskGraphEnabled)) {
+        stepExport(*particles, 0, particles->size());
+    }
+    stepAllocations = AllocationCounter::count() - allocationsBefore;
+}
+
+void SPHSolver::stepContact(float dt) {
+    startVelocities.resize(particles->size());
     for (Particle &particle : *particles) {
-        particle.render(dt);
+        startVelocities[particle.id] = particle.velocity;
+        if (isAsleep(particle.gridIndex)) {
+            continue;
+        }
+        if (!particle.paused) {
+            particle.acceleration = gravity;
+            particle.update(dt);
+        }
         grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
     }
     handleCollisions();
-    
-    //populateGrid();
+    // the contact pushes change the velocity too, the timestep controller reads the whole change
+    for (Particle &particle : *particles) {
+        if (!isFrozen(particle)) {
+            particle.acceleration = (particle.velocity - startVelocities[particle.id]) / dt;
+        }
+    }
+    computeDensities();
+}
+
+void SPHSolver::buildNeighbourLists(float radius, bool predicted) {
+    int count = particles->size();
+    neighbourOffsets.assign(count + 1, 0);
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        countNeighbours(begin, end, radius, predicted);
+    }, 256);
+    for (int i = 0; i < count; i++) {
+        neighbourOffsets[i + 1] += neighbourOffsets[i];
+    }
+    neighbourIds.resize(neighbourOffsets[count]);
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        fillNeighbours(begin, end, radius, predicted);
+    }, 256);
+}
+
+void SPHSolver::countNeighbours(int begin, int end, float radius, bool predicted) {
+    const std::vector<Particle> &all = *particles;
+    auto position = [&](int i) -> const glm::vec3 & { return predicted ? predictedPositions[i] : all[i].position; };
+    for (int i = begin; i < end; i++) {
+        int found = 0;
+        grid.forEachNeighbour(all[i].gridIndex, [&](int j) {
+            glm::vec3 offset = grid.separation(position(i), position(j));
+            found += glm::dot(offset, offset) < radius * radius;
+        });
+        neighbourOffsets[i + 1] = found;
+    }
+}
+
+void SPHSolver::fillNeighbours(int begin, int end, float radius, bool predicted) {
+    const std::vector<Particle> &all = *particles;
+    auto position = [&](int i) -> const glm::vec3 & { return predicted ? predictedPositions[i] : all[i].position; };
+    for (int i = begin; i < end; i++) {
+        int next = neighbourOffsets[i];
+        grid.forEachNeighbour(all[i].gridIndex, [&](int j) {
+            glm::vec3 offset = grid.separation(position(i), position(j));
+            if (glm::dot(offset, offset) < radius * radius) {
+                neighbourIds[next++] = j;
+            }
+        });
+    }
+}
+
+void SPHSolver::computePressureAccelerations(const std::vector<glm::vec3> &positions) {
+    std::vector<Particle> &all = *particles;
+    float inverseRestDensity2 = 1.0f / (restDensity * restDensity);
+    ThreadPool::instance().parallelFor(0, all.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            glm::vec3 acceleration(0.0f);
+            for (int n = neighbourOffsets[i]; n < neighbourOffsets[i + 1]; n++) {
+                int j = neighbourIds[n];
+                if (j == i) {
+                    continue;
+                }
+                acceleration -= all[j].mass * (all[i].pressure + all[j].pressure) * inverseRestDensity2 *
+                                spikyGradient(grid.separation(positions[i], positions[j]), effectLength);
+            }
+            // boundary samples push with the particle's own pressure
+            forEachBoundaryNear(all[i].gridIndex, [&](const BoundaryParticles &samples, int b) {
+                acceleration -= restDensity * samples.volumes[b] * all[i].pressure * inverseRestDensity2 *
+                                spikyGradient(grid.separation(positions[i], samples.positions[b]), effectLength);
+            });
+            pressureAccelerations[i] = acceleration;
+        }
+    }, 256);
+}
+
+float SPHSolver::predictDensity(int i, const std::vector<glm::vec3> &positions) const {
+    const std::vector<Particle> &all = *particles;
+    float density = 0.0f;
+    for (int n = neighbourOffsets[i]; n < neighbourOffsets[i + 1]; n++) {
+        int j = neighbourIds[n];
+        glm::vec3 offset = grid.separation(positions[i], positions[j]);
+        density += all[j].mass * poly6(glm::dot(offset, offset), effectLength);
+    }
+    return density + boundaryDensity(all[i].gridIndex, positions[i]);
+}
+
+void SPHSolver::stepPCISPH(float dt) {
+    std::vector<Particle> &all = *particles;
+    int count = all.size();
+    // predicted positions move a little during the iterations, the margin keeps the lists valid
+    buildNeighbourLists(1.1f * effectLength);
+    currentPositions.resize(count);
+    predictedPositions.resize(count);
+    externalAccelerations.resize(count);
+    pressureAccelerations.resize(count);
+    predictedDensities.resize(count);
+    // the drag below goes to the bodies before the step is known to converge, a retried step starts over from here
+    std::pmr::vector<BodyImpulse> impulsesBefore(bodyImpulses.begin(), bodyImpulses.end(), &scratch());
+
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Particle &particle = all[i];
+            currentPositions[i] = particle.position;
+            glm::vec3 viscosity(0.0f);
+            for (int n = neighbourOffsets[i]; n < neighbourOffsets[i + 1]; n++) {
+                const Particle &neighbour = all[neighbourIds[n]];
+                if (neighbourIds[n] == i) {
+                    continue;
+                }
+                viscosity += neighbour.mass * (neighbour.velocity - particle.velocity) / std::max(neighbour.density, 1e-3f) *
+                             viscosityLaplacian(glm::length(grid.separation(particle.position, neighbour.position)), effectLength);
+            }
+            // rigid bodies drag the fluid along, and the other way round
+            forEachBoundaryNear(particle.gridIndex, [&](const BoundaryParticles &samples, int b) {
+                if (samples.owners[b] == -1 || isFrozen(particle)) {
+                    return;
+                }
+                glm::vec3 drag = samples.volumes[b] * (samples.velocities[b] - particle.velocity) *
+                                 viscosityLaplacian(glm::length(grid.separation(particle.position, samples.positions[b])), effectLength);
+                viscosity += drag;
+                BodyImpulse &impulse = bodyImpulse(samples.owners[b]);
+                glm::vec3 reaction = -dt * particle.mass * viscosityConstant * drag;
+                impulse.linear += reaction;
+                impulse.angular += glm::cross(samples.positions[b] - bodies[samples.owners[b]].getPosition(), reaction);
+            });
+            externalAccelerations[i] = isFrozen(particle) ? glm::vec3(0.0f) : gravity + viscosityConstant * viscosity;
+            if (!warmStartPressure && !isFrozen(particle)) {
+                particle.pressure = 0.0f;
+            }
+        }
+    }, 256);
+    computePressureAccelerations(currentPositions);
+
+    float delta = pcisphStiffness / (dt * dt);
+    pressureStats = PressureSolverStats();
+    bool converged = false;
+    for (int iteration = 0; iteration < maxPressureIterations; iteration++) {
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Particle &particle = all[i];
+                if (isFrozen(particle)) {
+                    predictedPositions[i] = particle.position;
+                    continue;
+                }
+                // collisions are part of the prediction, otherwise particles pushed through a wall come back overlapping
+                predictedPositions[i] = particle.position + dt * (particle.velocity + dt * (externalAccelerations[i] + pressureAccelerations[i]));
+                clampToDomain(predictedPositions[i]);
+            }
+        }, 1024);
+
+        std::mutex errorMutex;
+        double errorSum = 0.0;
+        float maxError = 0.0f;
+        int awake = 0;
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            double chunkError = 0.0;
+            float chunkMaxError = 0.0f;
+            int chunkAwake = 0;
+            for (int i = begin; i < end; i++) {
+                float density = predictDensity(i, predictedPositions);
+                predictedDensities[i] = density;
+                if (!isFrozen(all[i])) {
+                    float error = std::max(density - restDensity, 0.0f) / restDensity;
+                    chunkError += error;
+                    chunkMaxError = std::max(chunkMaxError, error);
+                    chunkAwake++;
+                }
+            }
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errorSum += chunkError;
+            maxError = std::max(maxError, chunkMaxError);
+            awake += chunkAwake;
+        }, 256);
+
+        pressureStats.iterations = iteration + 1;
+        pressureStats.densityError = awake > 0 ? errorSum / awake : 0.0f;
+        pressureStats.maxDensityError = maxError;
+        converged = pressureStats.densityError < densityTolerance && maxError < maxDensityTolerance;
+        if (iteration + 1 >= minPressureIterations && converged) {
+            break;
+        }
+
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                if (!isFrozen(all[i])) {
+                    // free-surface particles are under-dense, clamping keeps them from being pulled in
+                    all[i].pressure = std::max(all[i].pressure + delta * (predictedDensities[i] - restDensity), 0.0f);
+                }
+            }
+        }, 1024);
+        computePressureAccelerations(predictedPositions);
+    }
+
+    // hard impacts can be too compressed to resolve in one step, nothing has moved yet so the step is
+    // redone as two halves, starting from zero pressure as the pumped-up values would carry over
+    if (!converged && dt > 2.0f * minPressureSubstep) {
+        for (Particle &particle : all) {
+            if (!isFrozen(particle)) {
+                particle.pressure = 0.0f;
+            }
+        }
+        std::copy(impulsesBefore.begin(), impulsesBefore.end(), bodyImpulses.begin());
+        stepPCISPH(0.5f * dt);
+        stepPCISPH(0.5f * dt);
+        return;
+    }
+    if (!bodies.empty()) {
+        bodyPressureTerms.resize(count);
+        for (int i = 0; i < count; i++) {
+            bodyPressureTerms[i] = all[i].pressure / (restDensity * restDensity);
+        }
+        accumulateBodyPressure(predictedPositions, bodyPressureTerms, dt);
+    }
+
+    for (Particle &particle : all) {
+        if (isFrozen(particle)) {
+            continue;
+        }
+        int i = particle.id;
+        particle.acceleration = externalAccelerations[i] + pressureAccelerations[i];
+        particle.velocity += dt * particle.acceleration;
+        particle.position += dt * particle.velocity;
+        grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
+    }
+    // pairs squeezed against a wall can collapse onto each other where the kernel gradient has no usable direction,
+    // a short-range contact pass separates them without touching the regular spacing
+    handleBoundaryCollision(pcisphContactFraction * restSpacing);
+    handleColliderCollision(restSpacing);
+    handleParticleCollision(pcisphContactFraction * restSpacing);
+    computeDensities();
+}
+
+void SPHSolver::stepPBF(float dt) {
+    std::vector<Particle> &all = *particles;
+    int count = all.size();
+    resizePBFArrays(count);
+
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        predictPBF(begin, end, dt);
+    }, 1024);
+    // the constraints are evaluated at the predicted positions, the margin covers the corrections; the grid
+    // still holds the current cells, which reach far enough as long as nothing moves a cell per step
+    buildNeighbourLists(1.1f * effectLength, true);
+
+    pressureStats = PressureSolverStats();
+    for (int iteration = 0; iteration < pbfIterations; iteration++) {
+        std::mutex errorMutex;
+        ConstraintError error;
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            ConstraintError chunkError = solveDensityConstraints(begin, end);
+            std::lock_guard<std::mutex> lock(errorMutex);
+            error.add(chunkError);
+        }, 256);
+        pressureStats.iterations = iteration + 1;
+        pressureStats.densityError = error.awake > 0 ? error.sum / error.awake : 0.0f;
+        pressureStats.maxDensityError = error.max;
+
+        // Jacobi: every correction is computed from the same positions, then all are applied
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            computePositionCorrections(begin, end);
+        }, 256);
+        ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+            applyPositionCorrections(begin, end);
+        }, 1024);
+    }
+    if (!bodies.empty()) {
+        accumulateBodyPressurePBF(dt);
+    }
+
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        updateVelocitiesPBF(begin, end, dt);
+    }, 1024);
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        computeXsph(begin, end);
+    }, 256);
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        finishPBF(begin, end);
+    }, 1024);
+    for (Particle &particle : all) {
+        if (!isFrozen(particle)) {
+            grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
+        }
+    }
+    computeDensities();
+}
+
+void SPHSolver::resizePBFArrays(int count) {
+    predictedPositions.resize(count);
+    predictedDensities.resize(count);
+    constraintMultipliers.resize(count);
+    positionCorrections.resize(count);
+    accumulatedMultipliers.assign(count, 0.0f);
+}
+
+void SPHSolver::predictPBF(int begin, int end, float dt) {
+    std::vector<Particle> &all = *particles;
+    for (int i = begin; i < end; i++) {
+        Particle &particle = all[i];
+        if (isFrozen(particle)) {
+            predictedPositions[i] = particle.position;
+            continue;
+        }
+        particle.velocity += dt * gravity;
+        predictedPositions[i] = particle.position + dt * particle.velocity;
+        clampToDomain(predictedPositions[i]);
+        projectOutOfColliders(predictedPositions[i], 0.5f * restSpacing);
+    }
+}
+
+ConstraintError SPHSolver::solveDensityConstraints(int begin, int end) {
+    const std::vector<Particle> &all = *particles;
+    float inverseRestDensity = 1.0f / restDensity;
+    ConstraintError error;
+    for (int i = begin; i < end; i++) {
+        float density = predictDensity(i, predictedPositions);
+        predictedDensities[i] = density;
+        // one-sided: under-dense particles at the surface are left alone instead of being pulled together
+        float constraint = std::max(density * inverseRestDensity - 1.0f, 0.0f);
+        glm::vec3 gradientSelf(0.0f);
+        float gradientSquares = 0.0f;
+        for (int n = neighbourOffsets[i]; n < neighbourOffsets[i + 1]; n++) {
+            int j = neighbourIds[n];
+            if (j == i) {
+                continue;
+            }
+            glm::vec3 gradient = all[j].mass * inverseRestDensity * spikyGradient(grid.separation(predictedPositions[i], predictedPositions[j]), effectLength);
+            gradientSelf += gradient;
+            gradientSquares += glm::dot(gradient, gradient);
+        }
+        forEachBoundaryNear(all[i].gridIndex, [&](const BoundaryParticles &samples, int b) {
+            gradientSelf += samples.volumes[b] * spikyGradient(grid.separation(predictedPositions[i], samples.positions[b]), effectLength);
+        });
+        gradientSquares += glm::dot(gradientSelf, gradientSelf);
+        constraintMultipliers[i] = -constraint / (gradientSquares + pbfRelaxation * latticeGradientNorm);
+        accumulatedMultipliers[i] += constraintMultipliers[i];
+        if (!isFrozen(all[i])) {
+            error.sum += constraint;
+            error.max = std::max(error.max, constraint);
+            error.awake++;
+        }
+    }
+    return error;
+}
+
+void SPHSolver::computePositionCorrections(int begin, int end) {
+    const std::vector<Particle> &all = *particles;
+    float inverseRestDensity = 1.0f / restDensity;
+    // artificial pressure is measured against the kernel at a fixed fraction of h
+    float correctionReference = poly6(pbfCorrectionDistance * pbfCorrectionDistance * effectLength * effectLength, effectLength);
+    for (int i = begin; i < end; i++) {
+        glm::vec3 correction(0.0f);
+        if (!isFrozen(all[i])) {
+            for (int n = neighbourOffsets[i]; n < neighbourOffsets[i + 1]; n++) {
+                int j = neighbourIds[n];
+                if (j == i) {
+                    continue;
+                }
+                glm::vec3 offset = grid.separation(predictedPositions[i], predictedPositions[j]);
+                float ratio = poly6(glm::dot(offset, offset), effectLength) / correctionReference;
+                float artificialPressure = -pbfCorrectionStrength * ratio * ratio * ratio * ratio / latticeGradientNorm;
+                correction += all[j].mass * (constraintMultipliers[i] + constraintMultipliers[j] + artificialPressure) *
+                              spikyGradient(offset, effectLength);
+            }
+            // boundary samples only push, with the particle's own multiplier
+            forEachBoundaryNear(all[i].gridIndex, [&](const BoundaryParticles &samples, int b) {
+                correction += restDensity * samples.volumes[b] * constraintMultipliers[i] *
+                              spikyGradient(grid.separation(predictedPositions[i], samples.positions[b]), effectLength);
+            });
+            correction *= inverseRestDensity;
+        }
+        positionCorrections[i] = correction;
+    }
+}
+
+void SPHSolver::applyPositionCorrections(int begin, int end) {
+    const std::vector<Particle> &all = *particles;
+    for (int i = begin; i < end; i++) {
+        predictedPositions[i] += positionCorrections[i];
+        clampToDomain(predictedPositions[i]);
+        if (!isFrozen(all[i])) {
+            projectOutOfColliders(predictedPositions[i], 0.5f * restSpacing);
+        }
+    }
+}
+
+void SPHSolver::accumulateBodyPressurePBF(float dt) {
+    const std::vector<Particle> &all = *particles;
+    int count = all.size();
+    // the pushes of all iterations add up to dt^2 times a pressure acceleration, a = -psi p / rho0^2 grad W
+    bodyPressureTerms.resize(count);
+    for (int i = 0; i < count; i++) {
+        bodyPressureTerms[i] = isFrozen(all[i]) ? 0.0f : -accumulatedMultipliers[i] / (restDensity * dt * dt);
+    }
+    accumulateBodyPressure(predictedPositions, bodyPressureTerms, dt);
+}
+
+void SPHSolver::updateVelocitiesPBF(int begin, int end, float dt) {
+    std::vector<Particle> &all = *particles;
+    for (int i = begin; i < end; i++) {
+        Particle &particle = all[i];
+        if (!isFrozen(particle)) {
+            // gravity was applied by the prediction, the constraint corrections add (x* - x - v dt) / dt^2
+            glm::vec3 velocity = grid.separation(predictedPositions[i], particle.position) / dt;
+            particle.acceleration = gravity + (velocity - particle.velocity) / dt;
+            particle.velocity = velocity;
+        }
+    }
+}
+
+void SPHSolver::computeXsph(int begin, int end) {
+    const std::vector<Particle> &all = *particles;
+    // XSPH viscosity, the corrected velocities are blended towards the neighbourhood average
+    for (int i = begin; i < end; i++) {
+        glm::vec3 blend(0.0f);
+        for (int n = neighbourOffsets[i]; n < neighbourOffsets[i + 1]; n++) {
+            int j = neighbourIds[n];
+            glm::vec3 offset = grid.separation(predictedPositions[i], predictedPositions[j]);
+            blend += all[j].mass / std::max(predictedDensities[j], 1e-3f) * (all[j].velocity - all[i].velocity) *
+                     poly6(glm::dot(offset, offset), effectLength);
+        }
+        positionCorrections[i] = blend;
+    }
+}
+
+void SPHSolver::finishPBF(int begin, int end) {
+    std::vector<Particle> &all = *particles;
+    for (int i = begin; i < end; i++) {
+        Particle &particle = all[i];
+        if (!isFrozen(particle)) {
+            particle.velocity += xsphViscosity * positionCorrections[i];
+            particle.position = predictedPositions[i];
+        }
+    }
+}
+
+void SPHSolver::stepPBFGraph(float dt) {
+    // a block of whole z-layers of cells is one contiguous range once the particles are in cell order, and its
+    // particles only have neighbours in the blocks right before and after it
+    bool sorted = sortParticlesByCell();
+    int count = particles->size();
+    neighbourOffsets.assign(count + 1, 0);
+    resizePBFArrays(count);
+    pressureStats = PressureSolverStats();
+    if (count == 0) {
+        return;
+    }
+
+    // the block count only follows the particle count, so the graph is kept from one step to the next and only
+    // the layers the blocks start at move with the fluid. It changes once the count is a whole block off, so
+    // inflow and outflow evening out around a boundary don't rebuild the graph every other step.
+    int target = std::max(256, count / (8 * (int) ThreadPool::instance().size()));
+    float ideal = (float) count / target;
+    int blocks = graphBlocks > 0 && std::abs(ideal - graphBlocks) < 1.0f ? graphBlocks : (int) ideal;
+    blocks = sorted ? std::clamp(blocks, 1, grid.num_cells_z) : 1;
+    graphStarts.assign(blocks + 1, count);
+    graphStarts[0] = 0;
+    int layerCells = grid.num_cells_x * grid.num_cells_y;
+    int lastStart = 0;
+    int below = 0;
+    for (int layer = 0, block = 1; layer < grid.num_cells_z && block < blocks; layer++) {
+        // every block keeps at least one layer, so its neighbours stay in the blocks right next to it
+        bool due = below >= (long long) block * count / blocks || grid.num_cells_z - layer <= blocks - block;
+        if (layer > lastStart && due) {
+            graphStarts[block++] = below;
+            lastStart = layer;
+        }
+        for (int cell = layer * layerCells; cell < (layer + 1) * layerCells; cell++) {
+            below += grid.grid[cell].size();
+        }
+    }
+    if (taskGraph.size() == 0 || blocks != graphBlocks || pbfIterations != graphIterations || bodies.empty() == graphBodies ||
+        !stepExport == graphExport) {
+        buildPBFGraph(blocks);
+    }
+
+    graphDt = dt;
+    taskGraph.run(ThreadPool::instance());
+    taskGraphProfile.add(taskGraph.getProfile());
+
+    // summed in block order, so the statistics don't depend on which thread ran what
+    for (int iteration = 0; iteration < pbfIterations; iteration++) {
+        ConstraintError error;
+        for (int b = 0; b < blocks; b++) {
+            error.add(graphErrors[iteration * blocks + b]);
+        }
+        pressureStats.iterations = iteration + 1;
+        pressureStats.densityError = error.awake > 0 ? error.sum / error.awake : 0.0f;
+        pressureStats.maxDensityError = error.max;
+    }
+}
+
+void SPHSolver::buildPBFGraph(int blocks) {
+    graphBlocks = blocks;
+    graphIterations = pbfIterations;
+    graphBodies = !bodies.empty();
+    graphExport = (bool) stepExport;
+    graphErrors.assign(pbfIterations * blocks, ConstraintError());
+    std::vector<std::vector<int>> nearBlocks(blocks);
+    for (int b = 0; b < blocks; b++) {
+        for (int n = b - 1; n <= b + 1; n++) {
+            int wrapped = grid.periodic.z ? (n + blocks) % blocks : n;
+            if (wrapped >= 0 && wrapped < blocks &&
+                std::find(nearBlocks[b].begin(), nearBlocks[b].end(), wrapped) == nearBlocks[b].end()) {
+                nearBlocks[b].push_back(wrapped);
+            }
+        }
+    }
+
+    taskGraph.clear();
+    int predictStage = taskGraph.addStage("predict");
+    int countStage = taskGraph.addStage("neighbour count");
+    int offsetStage = taskGraph.addStage("neighbour offsets");
+    int fillStage = taskGraph.addStage("neighbour fill");
+    int constraintStage = taskGraph.addStage("constraints");
+    int correctionStage = taskGraph.addStage("corrections");
+    int applyStage = taskGraph.addStage("apply");
+    int bodyStage = taskGraph.addStage("rigid bodies");
+    int velocityStage = taskGraph.addStage("velocity");
+    int xsphStage = taskGraph.addStage("xsph");
+    int finishStage = taskGraph.addStage("integrate");
+    int gridStage = taskGraph.addStage("grid");
+    int densityStage = taskGraph.addStage("density");
+    int exportStage = taskGraph.addStage("export");
+
+    // one task per block running pass(block), dependencies(block) gives the tasks it waits for. The tasks outlive
+    // this call, they only capture the solver and read the step's block bounds and timestep from it.
+    auto eachBlock = [&](int stage, const std::function<void(int)> &pass, const std::function<std::vector<int>(int)> &dependencies) {
+        std::vector<int> tasks(blocks);
+        for (int b = 0; b < blocks; b++) {
+            tasks[b] = taskGraph.add(stage, [pass, b]() { pass(b); }, dependencies(b));
+        }
+        return tasks;
+    };
+    // the tasks of the blocks whose particles block b reads
+    auto near = [&](const std::vector<int> &tasks, int b) {
+        std::vector<int> dependencies;
+        for (int n : nearBlocks[b]) {
+            dependencies.push_back(tasks[n]);
+        }
+        return dependencies;
+    };
+    auto none = [](int) { return std::vector<int>(); };
+
+    std::vector<int> predicted = eachBlock(predictStage, [this](int b) {
+        predictPBF(graphStarts[b], graphStarts[b + 1], graphDt);
+    }, none);
+    // the lists are built between the predicted positions, of the block and of the blocks around it
+    std::vector<int> counted = eachBlock(countStage, [this](int b) {
+        countNeighbours(graphStarts[b], graphStarts[b + 1], 1.1f * effectLength, true);
+    }, [&](int b) { return near(predicted, b); });
+    int offsets = taskGraph.add(offsetStage, [this]() {
+        int count = particles->size();
+        for (int i = 0; i < count; i++) {
+            neighbourOffsets[i + 1] += neighbourOffsets[i];
+        }
+        neighbourIds.resize(neighbourOffsets[count]);
+    }, counted);
+    std::vector<int> filled = eachBlock(fillStage, [this](int b) {
+        fillNeighbours(graphStarts[b], graphStarts[b + 1], 1.1f * effectLength, true);
+    }, [&](int) { return std::vector<int>{offsets}; });
+
+    // an iteration waits for the blocks around it in the last one instead of for the whole pass
+    std::vector<int> applied = predicted;
+    for (int iteration = 0; iteration < pbfIterations; iteration++) {
+        std::vector<int> solved = eachBlock(constraintStage, [this, iteration](int b) {
+            graphErrors[iteration * graphBlocks + b] = solveDensityConstraints(graphStarts[b], graphStarts[b + 1]);
+        }, [&](int b) {
+            std::vector<int> dependencies = near(applied, b);
+            dependencies.push_back(filled[b]);
+            return dependencies;
+        });
+        std::vector<int> corrected = eachBlock(correctionStage, [this](int b) {
+            computePositionCorrections(graphStarts[b], graphStarts[b + 1]);
+        }, [&](int b) { return near(solved, b); });
+        applied = eachBlock(applyStage, [this](int b) {
+            applyPositionCorrections(graphStarts[b], graphStarts[b + 1]);
+        }, [&](int b) { return near(corrected, b); });
+    }
+
+    // the bodies only read the predicted positions, they run alongside the velocity passes
+    std::vector<int> beforeGrid;
+    if (graphBodies) {
+        beforeGrid.push_back(taskGraph.add(bodyStage, [this]() { accumulateBodyPressurePBF(graphDt); }, applied));
+    }
+    std::vector<int> velocities = eachBlock(velocityStage, [this](int b) {
+        updateVelocitiesPBF(graphStarts[b], graphStarts[b + 1], graphDt);
+    }, [&](int b) { return std::vector<int>{applied[b], filled[b]}; });
+    std::vector<int> blended = eachBlock(xsphStage, [this](int b) {
+        computeXsph(graphStarts[b], graphStarts[b + 1]);
+    }, [&](int b) { return near(velocities, b); });
+    std::vector<int> finished = eachBlock(finishStage, [this](int b) {
+        finishPBF(graphStarts[b], graphStarts[b + 1]);
+    }, [&](int b) { return near(blended, b); });
+    beforeGrid.insert(beforeGrid.end(), finished.begin(), finished.end());
+    // one serial pass moves the particles between cells, every task before it reads the old grid indices
+    int gridUpdated = taskGraph.add(gridStage, [this]() {
+        for (Particle &particle : *particles) {
+            if (!isFrozen(particle)) {
+                grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
+            }
+        }
+    }, beforeGrid);
+    std::vector<int> densities = eachBlock(densityStage, [this](int b) {
+        computeDensities(graphStarts[b], graphStarts[b + 1]);
+    }, [&](int) { return std::vector<int>{gridUpdated}; });
+    // a finished block is handed out while the others are still computing their densities
+    if (graphExport) {
+        eachBlock(exportStage, [this](int b) {
+            stepExport(*particles, graphStarts[b], graphStarts[b + 1]);
+        }, [&](int b) { return std::vector<int>{densities[b]}; });
+    }
+}
+
+float SPHSolver::getMaxStableTimestep() const {
+    switch (solverMode) {
+    case SOLVER_PCISPH:
+        return 0.01f;
+    case SOLVER_PBF:
+        return 0.033f;
+    default:
+        return 0.02f;
+    }
+}
+
+float SPHSolver::boundaryDensity(int cell, const glm::vec3 &position) const {
+    float density = 0.0f;
+    forEachBoundaryNear(cell, [&](const BoundaryParticles &samples, int b) {
+        glm::vec3 offset = grid.separation(position, samples.positions[b]);
+        density += restDensity * samples.volumes[b] * poly6(glm::dot(offset, offset), effectLength);
+    });
+    return density;
+}
+
+void SPHSolver::clampToDomain(glm::vec3 &position) const {
+    grid.wrap(position);
+    glm::vec3 far = grid.origin + glm::vec3(grid.Width, 0.0f, grid.Depth);
+    if (!grid.periodic.x) {
+        position.x = glm::clamp(position.x, grid.origin.x, far.x);
+    }
+    if (!grid.periodic.y) {
+        position.y = std::max(position.y, grid.origin.y);
+    }
+    if (!grid.periodic.z) {
+        position.z = glm::clamp(position.z, grid.origin.z, far.z);
+    }
+}
+
+void SPHSolver::updateSleeping() {
+    std::vector<Particle> &all = *particles;
+    int cellCount = grid.grid.size();
+    ThreadPool::instance().parallelFor(0, cellCount, [&](int begin, int end) {
+        for (int cell = begin; cell < end; cell++) {
+            const std::pmr::vector<int> &cellParticles = grid.grid[cell];
+            if (isAsleep(cell)) {
+                // particles came in or left, e.g. emitted or fallen in from an awake cell
+                cellDisturbed[cell] = cellSleepingCount[cell] != (int) cellParticles.size() || colliderGrid.isMoving(grid, cell);
+                continue;
+            }
+            if (cellParticles.empty()) {
+                // quiet steps only count while the cell holds particles, else emitted blocks would freeze mid-air
+                cellDisturbed[cell] = false;
+                cellQuietSteps[cell] = 0;
+                continue;
+            }
+            // a moving obstacle nearby can push into the cell at any time
+            bool disturbed = colliderGrid.isMoving(grid, cell);
+            for (int id : cellParticles) {
+                const Particle &particle = all[id];
+                // contacts settle into a close packing above rest density, only the pressure solvers control it
+                bool compressed = solverMode != SOLVER_CONTACT && particle.density - restDensity > sleepDensityError * restDensity;
+                if (particle.paused || glm::dot(particle.velocity, particle.velocity) > sleepVelocity * sleepVelocity || compressed) {
+                    disturbed = true;
+                    break;
+                }
+            }
+            cellDisturbed[cell] = disturbed;
+            cellQuietSteps[cell] = disturbed ? 0 : cellQuietSteps[cell] + 1;
+        }
+    }, 1024);
+
+    // cells only read the flags of the previous pass, so every cell decides on its own
+    ThreadPool::instance().parallelFor(0, cellCount, [&](int begin, int end) {
+        for (int cell = begin; cell < end; cell++) {
+            bool wake = cellDisturbed[cell];
+            for (int neighbour : grid.neighbours[cell]) {
+                wake = wake || (neighbour != -1 && cellDisturbed[neighbour]);
+            }
+            if (isAsleep(cell)) {
+                if (wake) {
+                    cellSleepingCount[cell] = -1;
+                    cellQuietSteps[cell] = 0;
+                }
+            } else if (!wake && cellQuietSteps[cell] >= sleepSteps && !grid.grid[cell].empty()) {
+                cellSleepingCount[cell] = grid.grid[cell].size();
+                for (int id : grid.grid[cell]) {
+                    all[id].velocity = glm::vec3(0.0f);
+                }
+            }
+        }
+    }, 1024);
+}
+
+void SPHSolver::setSleepingEnabled(bool enabled) {
+    sleepingEnabled = enabled;
+    if (!enabled) {
+        std::fill(cellSleepingCount.begin(), cellSleepingCount.end(), -1);
+        std::fill(cellQuietSteps.begin(), cellQuietSteps.end(), 0);
+    }
+}
+
+int SPHSolver::getSleepingParticleCount() const {
+    int count = 0;
+    for (size_t cell = 0; cell < grid.grid.size(); cell++) {
+        if (isAsleep(cell)) {
+            count += grid.grid[cell].size();
+        }
+    }
+    return count;
+}
+
+void SPHSolver::computeDensities() {
+    ThreadPool::instance().parallelFor(0, particles->size(), [&](int begin, int end) {
+        computeDensities(begin, end);
+    }, 256);
+}
+
+void SPHSolver::computeDensities(int begin, int end) {
+    std::vector<Particle> &all = *particles;
+    for (int i = begin; i < end; i++) {
+        Particle &particle = all[i];
+        if (isAsleep(particle.gridIndex)) {
+            continue;
+        }
+        float density = 0.0f;
+        grid.forEachNeighbour(particle.gridIndex, [&](int j) {
+            glm::vec3 offset = grid.separation(particle.position, all[j].position);
+            density += all[j].mass * poly6(glm::dot(offset, offset), effectLength);
+        });
+        particle.density = density + boundaryDensity(particle.gridIndex, particle.position);
+    }
+}
+
+size_t SPHSolver::getScratchCapacity() const {
+    size_t bytes = 0;
+    for (const std::unique_ptr<Arena> &arena : scratchArenas) {
+        bytes += arena->capacity();
+    }
+    return bytes;
+}
+
+float SPHSolver::densityError() const {
+    if (particles->empty()) {
+        return 0.0f;
+    }
+    double error = 0.0;
+    for (const Particle &particle : *particles) {
+        error += std::abs(particle.density - restDensity) / restDensity;
+    }
+    return error / particles->size();
+}
+
+void SPHSolver::projectOutOfColliders(glm::vec3 &position, float radius) {
+    colliderGrid.forEachCollider(grid, grid.cellIndexOf(position), [&](int c) {
+        colliders[c]->project(position, radius);
+    });
+}
+
+void SPHSolver::updateColliders(float time) {
+    colliderModels.resize(colliders.size());
+    std::pmr::vector<glm::vec3> lows(colliders.size(), &scratch());
+    std::pmr::vector<glm::vec3> highs(colliders.size(), &scratch());
+    std::pmr::vector<bool> moving(colliders.size(), false, &scratch());
+    for (size_t c = 0; c < colliders.size(); c++) {
+        const KinematicMotion &motion = colliderMotions[c];
+        moving[c] = !motion.isStatic() || colliderBodies[c] != -1;
+        glm::mat3 rotation;
+        glm::vec3 translation;
+        glm::vec3 linear, angular, center;
+        if (colliderBodies[c] != -1) {
+            const RigidBody &body = bodies[colliderBodies[c]];
+            rotation = body.rotation();
+            translation = body.translation();
+            linear = body.getVelocity();
+            angular = body.getAngularVelocity();
+            center = body.getPosition();
+        } else {
+            motion.pose(time, rotation, translation);
+            motion.rates(time, linear, angular, center);
+        }
+        colliders[c]->setPose(rotation, translation);
+        colliders[c]->setVelocity(linear, angular, center);
+        colliderModels[c] = glm::mat4(rotation);
+        colliderModels[c][3] = glm::vec4(translation, 1.0f);
+
+        // a particle is resolved against the colliders of its own cell's block, it can reach past the block by
+        // up to a cell, plus the contact distance
+        colliders[c]->worldBounds(lows[c], highs[c]);
+        lows[c] -= glm::vec3(grid.size + restSpacing);
+        highs[c] += glm::vec3(grid.size + restSpacing);
+    }
+    colliderGrid.build(grid, lows, highs, moving, &scratch());
+}
+
+void SPHSolver::addCollider(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, const KinematicMotion &motion) {
+    float cellSize = 0.5f * restSpacing;
+    colliders.push_back(std::make_shared<SdfCollider>(vertices, triangles, cellSize, (int) std::ceil(effectLength / cellSize)));
+    colliderMotions.push_back(motion);
+    colliderBodies.push_back(-1);
+    collidersMoving = collidersMoving || !motion.isStatic();
+
+    // flat shaded, every triangle gets its own corners
+    std::vector<Vertex> meshVertices;
+    std::vector<glm::uvec3> meshTriangles;
+    meshVertices.reserve(3 * triangles.size());
+    meshTriangles.reserve(triangles.size());
+    for (const glm::uvec3 &triangle : triangles) {
+        glm::vec3 a = vertices[triangle.x];
+        glm::vec3 b = vertices[triangle.y];
+        glm::vec3 c = vertices[triangle.z];
+        glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+        unsigned int first = meshVertices.size();
+        for (glm::vec3 corner : {a, b, c}) {
+            meshVertices.emplace_back(corner, glm::vec4(0.6f, 0.6f, 0.6f, 1.0f), normal);
+        }
+        meshTriangles.emplace_back(first, first + 1, first + 2);
+    }
+    colliderMeshes.push_back(std::make_unique<Mesh>(SURFACE, shaderProgram));
+    colliderMeshes.back()->setGeometry(meshVertices, meshTriangles);
+    updateColliders(simulationTime);
+}
+
+void SPHSolver::addRigidBody(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, float relativeDensity) {
+    bodies.emplace_back(vertices, triangles, relativeDensity * restDensity);
+    addCollider(vertices, triangles);
+    colliderBodies.back() = bodies.size() - 1;
+    collidersMoving = true;
+    // sampled before updateColliders poses the collider, while mesh and world coordinates still agree
+    bodies.back().sampleSurface(*colliders.back(), restSpacing, effectLength, boundaryVolumeScale);
+    updateColliders(simulationTime);
+    gatherBodySamples();
+}
+
+bool SPHSolver::addRigidBody(const std::string &objPath, float relativeDensity) {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::uvec3> triangles;
+    if (!SdfCollider::loadObj(objPath, vertices, triangles)) {
+        return false;
+    }
+    addRigidBody(vertices, triangles, relativeDensity);
+    return true;
+}
+
+void SPHSolver::gatherBodySamples() {
+    std::pmr::vector<glm::vec3> positions(&scratch());
+    std::pmr::vector<float> volumes(&scratch());
+    std::pmr::vector<glm::vec3> velocities(&scratch());
+    std::pmr::vector<int> owners(&scratch());
+    for (size_t body = 0; body < bodies.size(); body++) {
+        for (size_t b = 0; b < bodies[body].getSamples().size(); b++) {
+            glm::vec3 position = bodies[body].toWorld(bodies[body].getSamples()[b]);
+            positions.push_back(position);
+            volumes.push_back(bodies[body].getSampleVolumes()[b]);
+            velocities.push_back(bodies[body].velocityAt(position));
+            owners.push_back(body);
+        }
+    }
+    bodySamples.assign(grid, positions, volumes, velocities, owners, &scratch());
+    bodyImpulses.assign(ThreadPool::instance().size() * bodies.size(), BodyImpulse());
+}
+
+void SPHSolver::integrateRigidBodies(float dt) {
+    glm::vec3 low = grid.origin;
+    glm::vec3 high = grid.origin + glm::vec3(grid.Width, std::numeric_limits<float>::max(), grid.Depth);
+    // bodies don't wrap, on a periodic axis they are free to leave the domain
+    for (int axis = 0; axis < 3; axis++) {
+        if (grid.periodic[axis]) {
+            low[axis] = -std::numeric_limits<float>::max();
+            high[axis] = std::numeric_limits<float>::max();
+        }
+    }
+    for (size_t body = 0; body < bodies.size(); body++) {
+        BodyImpulse total;
+        for (unsigned int thread = 0; thread < ThreadPool::instance().size(); thread++) {
+            total.linear += bodyImpulses[thread * bodies.size() + body].linear;
+            total.angular += bodyImpulses[thread * bodies.size() + body].angular;
+        }
+        bodies[body].applyImpulse(total);
+        bodies[body].integrate(dt, gravity, low, high);
+    }
+}
+
+void SPHSolver::accumulateBodyPressure(const std::vector<glm::vec3> &positions, const std::vector<float> &pressureTerms, float dt) {
+    std::vector<Particle> &all = *particles;
+    ThreadPool::instance().parallelFor(0, all.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (pressureTerms[i] <= 0.0f) {
+                continue;
+            }
+            // the fluid got a = -rho0 V_b p_i / rho0^2 grad W from every sample, the body gets -m_i a back
+            forEachBoundaryNear(all[i].gridIndex, [&](const BoundaryParticles &samples, int b) {
+                if (samples.owners[b] == -1) {
+                    return;
+                }
+                glm::vec3 reaction = dt * all[i].mass * restDensity * samples.volumes[b] * pressureTerms[i] *
+                                     spikyGradient(grid.separation(positions[i], samples.positions[b]), effectLength);
+                BodyImpulse &impulse = bodyImpulse(samples.owners[b]);
+                impulse.linear += reaction;
+                impulse.angular += glm::cross(samples.positions[b] - bodies[samples.owners[b]].getPosition(), reaction);
+            });
+        }
+    }, 256);
+}
+
+bool SPHSolver::addCollider(const std::string &objPath, const KinematicMotion &motion) {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::uvec3> triangles;
+    if (!SdfCollider::loadObj(objPath, vertices, triangles)) {
+        return false;
+    }
+    addCollider(vertices, triangles, motion);
+    return true;
+}
+
+void SPHSolver::renderParticles(const std::vector<Particle> &particles) {
+    particleOffsets.resize(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        particleOffsets[i] = particles[i].position;
+    }
+    particleMesh.setInstanceOffsets(particleOffsets);
+    particleMesh.renderInstanced();
 }
 
 void SPHSolver::addParticle(Particle particle) {
+    particle.id = particles->size();
     particles->push_back(particle);
+    particleCount++;
+    grid.insertParticles(particle.id, particle.id + 1);
 }
 
-void SPHSolver::handleCollisions(){
-    handlePlaneCollision();
-    handleParticleCollision();
+void SPHSolver::removeParticle(int id) {
+    std::vector<Particle> &all = *particles;
+    int last = all.size() - 1;
+    grid.removeParticleFromGrid(id, all[id].gridIndex);
+    if (id != last) {
+        all[id] = all[last];
+        all[id].id = id;
+        grid.renameParticle(last, id, all[id].gridIndex);
+    }
+    all.pop_back();
+    particleCount--;
+    removedParticles++;
 }
 
-void SPHSolver::handlePlaneCollision(){
-    // Check for collision with planes
-    for (Particle &particle : *particles) {
-        if (particle.position.y < Yplane.position.y + particle.getRadius()) {
-            particle.position.y = Yplane.position.y + particle.getRadius();
-            if (particle.velocity.y < 0) {
-                particle.velocity.y = -particle.velocity.y * 0.5f;
+int SPHSolver::removeParticles(FunctionRef<bool(const Particle &)> remove) {
+    std::vector<Particle> &all = *particles;
+    int count = all.size();
+    // new id of every particle, -1 for the removed ones
+    std::pmr::vector<int> newIds(count, 0, &scratch());
+    ThreadPool::instance().parallelFor(0, count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            newIds[i] = remove(all[i]) ? -1 : 0;
+        }
+    }, 4096);
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (newIds[i] != -1) {
+            newIds[i] = kept++;
+        }
+    }
+    if (kept == count) {
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (newIds[i] != -1 && newIds[i] != i) {
+            all[newIds[i]] = all[i];
+            all[newIds[i]].id = newIds[i];
+        }
+    }
+    all.erase(all.begin() + kept, all.end());
+    // the cells only shrink, so every one is renumbered in place without allocating
+    ThreadPool::instance().parallelFor(0, (int) grid.grid.size(), [&](int begin, int end) {
+        for (int cell = begin; cell < end; cell++) {
+            std::pmr::vector<int> &ids = grid.grid[cell];
+            int size = 0;
+            for (int id : ids) {
+                if (newIds[id] != -1) {
+                    ids[size++] = newIds[id];
+                }
             }
+            ids.resize(size);
+        }
+    }, 1024);
+    particleCount = kept;
+    removedParticles += count - kept;
+    return count - kept;
+}
+
+void SPHSolver::addEmitter(const ParticleEmitter &emitter) {
+    emitters.push_back(emitter);
+    emitterOpenings.push_back(emitter.opening(restSpacing));
+    emitterLayers.push_back(0.0);
+}
+
+void SPHSolver::emitInflow(float dt) {
+    std::vector<Particle> &all = *particles;
+    for (size_t e = 0; e < emitters.size(); e++) {
+        const ParticleEmitter &emitter = emitters[e];
+        const std::vector<glm::vec3> &opening = emitterOpenings[e];
+        if (opening.empty() || emitter.speed <= 0.0f) {
+            continue;
         }
-        if (particle.position.z < Backplane.position.z + particle.getRadius()) {
-            particle.position.z = Backplane.position.z + particle.getRadius() + 0.01f;
-            if (particle.velocity.z < 0) {
-                particle.velocity.z = -particle.velocity.z * 0.5f;
+        // every point of a layer carries one particle's volume, a spacing cubed
+        float layerVolume = opening.size() * restSpacing * restSpacing * restSpacing;
+        float layersPerSecond = emitter.rate > 0.0f ? emitter.rate / layerVolume : emitter.speed / restSpacing;
+        emitterLayers[e] += dt * layersPerSecond;
+        std::pmr::vector<glm::vec3> positions(&scratch());
+        positions.reserve(opening.size());
+        while (emitterLayers[e] >= 1.0) {
+            emitterLayers[e] -= 1.0;
+            // a layer that fell due during the last step has already moved on by the time it comes out
+            glm::vec3 shift = emitter.normal * (emitter.speed * (float) (emitterLayers[e] / layersPerSecond));
+            positions.clear();
+            for (const glm::vec3 &point : opening) {
+                glm::vec3 position = point + shift;
+                bool free = true;
+                grid.forEachNeighbour(grid.cellIndexOf(position), [&](int j) {
+                    free = free && glm::length(grid.separation(position, all[j].position)) >= OCCUPIED_SPACING * restSpacing;
+                });
+                if (free && (maxParticles == 0 || all.size() + positions.size() < maxParticles)) {
+                    positions.push_back(position);
+                }
             }
+            // one layer at a time, the next one is checked against this one
+            emit(all, grid, positions.size(), [&](int i) { return positions[i]; }, [&](int) { return emitter.speed * emitter.normal; },
+                 0.5f * restSpacing, particleMass, paused);
+            particleCount += positions.size();
+            emittedParticles += positions.size();
         }
-        if (particle.position.z > Frontplane.position.z - particle.getRadius()) {
-            particle.position.z = Frontplane.position.z - particle.getRadius() - 0.01f;
-            if (particle.velocity.z > 0) {
-                particle.velocity.z = -particle.velocity.z * 0.5f;
+    }
+}
+
+void SPHSolver::setMaxParticles(size_t count) {
+    maxParticles = count;
+    particles->reserve(count);
+    sortedParticles.reserve(count);
+    neighbourOffsets.reserve(count + 1);
+    for (std::vector<glm::vec3> *array : {&currentPositions, &predictedPositions, &externalAccelerations, &pressureAccelerations, &positionCorrections}) {
+        array->reserve(count);
+    }
+    for (std::vector<float> *array : {&predictedDensities, &constraintMultipliers, &accumulatedMultipliers, &bodyPressureTerms}) {
+        array->reserve(count);
+    }
+}
+
+void SPHSolver::spawnBox(glm::vec3 min, glm::vec3 max, float spacing, glm::vec3 velocity) {
+    auto start = std::chrono::high_resolution_clock::now();
+    glm::ivec3 counts = glm::ivec3(glm::floor((max - min) / spacing + 1e-4f)) + 1;
+    counts = glm::max(counts, glm::ivec3(0));
+    int count = counts.x * counts.y * counts.z;
+    emit(*particles, grid, count, [&](int i) {
+        int x = i % counts.x;
+        int y = (i / counts.x) % counts.y;
+        int z = i / (counts.x * counts.y);
+        return min + glm::vec3(x, y, z) * spacing;
+    }, [&](int) { return velocity; }, 0.5f * restSpacing, particleMass, paused);
+    particleCount += count;
+    std::cout << "Spawned " << count << " particles in "
+              << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() << " ms" << std::endl;
+}
+
+void SPHSolver::spawnSphere(glm::vec3 center, float radius, float spacing, glm::vec3 velocity) {
+    std::vector<glm::vec3> positions;
+    int steps = (int) (radius / spacing);
+    positions.reserve((2 * steps + 1) * (2 * steps + 1) * (2 * steps + 1));
+    for (int z = -steps; z <= steps; z++) {
+        for (int y = -steps; y <= steps; y++) {
+            for (int x = -steps; x <= steps; x++) {
+                glm::vec3 offset = glm::vec3(x, y, z) * spacing;
+                if (glm::dot(offset, offset) <= radius * radius) {
+                    positions.push_back(center + offset);
+                }
             }
         }
-        if (particle.position.x < Leftplane.position.x + particle.getRadius()) {
-            particle.position.x = Leftplane.position.x + particle.getRadius() + 0.01f;
-            if (particle.velocity.x < 0) {
-                particle.velocity.x = -particle.velocity.x * 0.5f;
+    }
+    emitParticles(positions, velocity);
+}
+
+void SPHSolver::emitParticles(const std::vector<glm::vec3> &positions, glm::vec3 velocity) {
+    emit(*particles, grid, positions.size(), [&](int i) { return positions[i]; }, [&](int) { return velocity; },
+         0.5f * restSpacing, particleMass, paused);
+    particleCount += positions.size();
+}
+
+void SPHSolver::emitParticles(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &velocities) {
+    emit(*particles, grid, positions.size(), [&](int i) { return positions[i]; }, [&](int i) { return velocities[i]; },
+         0.5f * restSpacing, particleMass, paused);
+    particleCount += positions.size();
+}
+
+void SPHSolver::removeOccupied(std::vector<glm::vec3> &positions) {
+    if (particles->empty() && colliders.empty()) {
+        return;
+    }
+    std::vector<glm::vec3> kept;
+    kept.reserve(positions.size());
+    for (const glm::vec3 &position : positions) {
+        bool free = true;
+        grid.forEachNeighbour(grid.cellIndexOf(position), [&](int j) {
+            free = free && glm::length(grid.separation(position, (*particles)[j].position)) >= OCCUPIED_SPACING * restSpacing;
+        });
+        for (const std::shared_ptr<SdfCollider> &collider : colliders) {
+            free = free && collider->distance(position) >= 0.5f * restSpacing;
+        }
+        if (free) {
+            kept.push_back(position);
+        }
+    }
+    positions.swap(kept);
+}
+
+void SPHSolver::replaceParticles(std::vector<Particle> &replacement) {
+    particles->swap(replacement);
+    int count = particles->size();
+    for (int i = 0; i < count; i++) {
+        (*particles)[i].id = i;
+    }
+    particleCount = count;
+    grid.clearParticles();
+    grid.insertParticles(0, count);
+}
+
+void SPHSolver::reset() {
+    particles->clear();
+    particleCount = 0;
+    removedParticles = 0;
+    emittedParticles = 0;
+    std::fill(emitterLayers.begin(), emitterLayers.end(), 0.0);
+    grid.clearParticles();
+    simulationTime = 0.0f;
+    pressureStats = PressureSolverStats();
+    std::fill(cellQuietSteps.begin(), cellQuietSteps.end(), 0);
+    std::fill(cellSleepingCount.begin(), cellSleepingCount.end(), -1);
+    std::fill(cellDisturbed.begin(), cellDisturbed.end(), 0);
+    stepsSinceSort = sortInterval;
+    resetTaskGraphProfile();
+    if (!colliders.empty()) {
+        updateColliders(simulationTime);
+    }
+}
+
+void SPHSolver::setMemoryPlacement(MemoryPlacement placement) {
+    memoryPlacement = placement;
+    placedArrays.clear();
+    // sorted and placed at the start of the next step
+    stepsSinceSort = sortInterval;
+}
+
+bool SPHSolver::sortParticlesByCell() {
+    std::vector<Particle> &all = *particles;
+    sortedParticles.clear();
+    for (const std::pmr::vector<int> &cell : grid.grid) {
+        for (int id : cell) {
+            sortedParticles.push_back(all[id]);
+        }
+    }
+    if (sortedParticles.size() != all.size()) {
+        return false;
+    }
+    // copied back rather than swapped, the placed storage stays in use
+    std::copy(sortedParticles.begin(), sortedParticles.end(), all.begin());
+    int count = all.size();
+    for (int i = 0; i < count; i++) {
+        all[i].id = i;
+    }
+    grid.clearParticles();
+    grid.insertParticles(0, count);
+    return true;
+}
+
+void SPHSolver::placeParticleArrays(bool sorted) {
+    ThreadPool &pool = ThreadPool::instance();
+    size_t count = particles->size();
+    // first element of every thread's part, plus where the last part ends
+    std::pmr::vector<size_t> parts(pool.size() + 1, 0, &scratch());
+    std::pmr::vector<size_t> neighbourParts(pool.size() + 1, 0, &scratch());
+    for (int thread = 0; thread < (int) pool.size(); thread++) {
+        int begin;
+        int end;
+        pool.rangeOfThread(0, (int) count, thread, begin, end);
+        parts[thread + 1] = end;
+        neighbourParts[thread + 1] = neighbourOffsets.size() == count + 1 ? neighbourOffsets[end] : 0;
+    }
+    placeArray(0, particles->data(), sizeof(Particle), particles->capacity(), parts, false);
+    placeArray(1, currentPositions.data(), sizeof(glm::vec3), currentPositions.capacity(), parts, false);
+    placeArray(2, predictedPositions.data(), sizeof(glm::vec3), predictedPositions.capacity(), parts, false);
+    placeArray(3, externalAccelerations.data(), sizeof(glm::vec3), externalAccelerations.capacity(), parts, false);
+    placeArray(4, pressureAccelerations.data(), sizeof(glm::vec3), pressureAccelerations.capacity(), parts, false);
+    placeArray(5, predictedDensities.data(), sizeof(float), predictedDensities.capacity(), parts, false);
+    placeArray(6, constraintMultipliers.data(), sizeof(float), constraintMultipliers.capacity(), parts, false);
+    placeArray(7, positionCorrections.data(), sizeof(glm::vec3), positionCorrections.capacity(), parts, false);
+    placeArray(8, accumulatedMultipliers.data(), sizeof(float), accumulatedMultipliers.capacity(), parts, false);
+    placeArray(9, neighbourOffsets.data(), sizeof(int), neighbourOffsets.capacity(), parts, false);
+    // a thread's neighbour ids follow its particles' offsets, which drift between sorts
+    placeArray(10, neighbourIds.data(), sizeof(int), neighbourIds.capacity(), neighbourParts, sorted);
+}
+
+void SPHSolver::placeArray(size_t slot, const void *data, size_t elementSize, size_t capacity, const std::pmr::vector<size_t> &parts, bool force) {
+    std::pair<const void *, size_t> storage(data, capacity);
+    placedArrays.resize(std::max(placedArrays.size(), slot + 1));
+    if (capacity == 0 || (placedArrays[slot] == storage && !force)) {
+        return;
+    }
+    placedArrays[slot] = storage;
+    ThreadPool &pool = ThreadPool::instance();
+    if (memoryPlacement == PLACEMENT_INTERLEAVED || !pool.isPinned()) {
+        Numa::interleave(data, capacity * elementSize);
+        return;
+    }
+    const char *bytes = static_cast<const char *>(data);
+    int threads = (int) parts.size() - 1;
+    for (int thread = 0; thread < threads; thread++) {
+        size_t first = std::min(parts[thread], capacity);
+        size_t last = thread + 1 == threads ? capacity : std::min(parts[thread + 1], capacity);
+        Numa::bindToNode(bytes + first * elementSize, (last - first) * elementSize, Numa::nodeOfCpu(pool.cpuOfThread(thread)));
+    }
+}
+
+void SPHSolver::fillBox(glm::vec3 min, glm::vec3 max, PackingMode mode, const std::string &cacheDirectory) {
+    const float relaxDt = 0.005f;
+    const int relaxSteps = 400;
+    const float relaxTolerance = 0.02f;
+
+    std::string cachePath;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    if (!cacheDirectory.empty()) {
+        // everything the settled state depends on, including the particles already in the scene
+        std::ostringstream key;
+        key << std::setprecision(9) << "fillBox " << min.x << " " << min.y << " " << min.z << " " << max.x << " " << max.y << " " << max.z
+            << " " << mode << " " << particles->size() << " " << particleMass << " " << restDensity << " " << effectLength << " " << restSpacing
+            << " " << collisionDamping << " " << relaxDt << " " << relaxSteps << " " << relaxTolerance << " " << colliders.size()
+            << " " << grid.periodic.x << grid.periodic.y << grid.periodic.z;
+        // the block settles against them
+        for (const Particle &particle : *particles) {
+            key << " " << particle.position.x << " " << particle.position.y << " " << particle.position.z;
+        }
+        std::ostringstream name;
+        name << cacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << hashString(key.str()) << ".state";
+        cachePath = name.str();
+        if (loadParticleState(cachePath, positions, velocities)) {
+            emitParticles(positions, velocities);
+            std::cout << "Loaded " << positions.size() << " settled particles from " << cachePath << std::endl;
+            return;
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    positions = mode == PACKING_LATTICE ? latticeFill(min, max, restSpacing) : poissonDiskFill(min, max, restSpacing);
+    // a pressure solver would blow overlaps apart
+    removeOccupied(positions);
+    int first = particles->size();
+    emitParticles(positions);
+    computeDensities();
+    std::cout << "Filled " << positions.size() << " particles at spacing " << restSpacing << ", density error " << densityError() * 100.0f << "%" << std::endl;
+    if (cachePath.empty()) {
+        return;
+    }
+
+    int steps = relax(relaxDt, relaxSteps, relaxTolerance, first);
+    for (int i = 0; i < (int) positions.size(); i++) {
+        positions[i] = (*particles)[first + i].position;
+    }
+    velocities.assign(positions.size(), glm::vec3(0.0f));
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (!saveParticleState(cachePath, positions, velocities)) {
+        std::cout << "Could not write settled state to " << cachePath << std::endl;
+    }
+    std::cout << "Relaxed in " << steps << " steps (" << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms), density error " << densityError() * 100.0f << "%" << std::endl;
+}
+
+int SPHSolver::relax(float dt, int maxSteps, float speedTolerance, int first) {
+    std::vector<bool> wasPaused(first);
+    for (int i = 0; i < first; i++) {
+        wasPaused[i] = (*particles)[i].paused;
+        (*particles)[i].pause();
+    }
+    // gravity keeps adding velocity that the contacts take back, so settling is judged on net displacement
+    std::vector<glm::vec3> previous(particles->size());
+    int steps = 0;
+    while (steps < maxSteps) {
+        for (size_t i = first; i < particles->size(); i++) {
+            previous[i] = (*particles)[i].position;
+        }
+        step(dt);
+        steps++;
+        float maxSpeed = 0.0f;
+        for (size_t i = first; i < particles->size(); i++) {
+            Particle &particle = (*particles)[i];
+            particle.velocity *= 0.9f;
+            maxSpeed = std::max(maxSpeed, glm::length(grid.separation(particle.position, previous[i])) / dt);
+        }
+        if (maxSpeed < speedTolerance) {
+            break;
+        }
+    }
+    for (size_t i = first; i < particles->size(); i++) {
+        (*particles)[i].velocity = glm::vec3(0.0f);
+    }
+    for (int i = 0; i < first; i++) {
+        (*particles)[i].paused = wasPaused[i];
+    }
+    return steps;
+}
+
+void SPHSolver::handleCollisions(){
+    // the boundary goes last so a pile pressing down can't push its bottom layer into the wall
+    handleParticleCollision(restSpacing);
+    handleColliderCollision(restSpacing);
+    handleBoundaryCollision(restSpacing);
+}
+
+void SPHSolver::handleColliderCollision(float contactDistance) {
+    if (colliders.empty()) {
+        return;
+    }
+    std::vector<Particle> &all = *particles;
+    ThreadPool::instance().parallelFor(0, all.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Particle &particle = all[i];
+            if (isFrozen(particle)) {
+                continue;
             }
+            colliderGrid.forEachCollider(grid, particle.gridIndex, [&](int c) {
+                glm::vec3 velocity = particle.velocity;
+                if (colliders[c]->resolve(particle.position, particle.velocity, 0.5f * contactDistance) && colliderBodies[c] != -1) {
+                    BodyImpulse &impulse = bodyImpulse(colliderBodies[c]);
+                    glm::vec3 reaction = particle.mass * (velocity - particle.velocity);
+                    impulse.linear += reaction;
+                    impulse.angular += glm::cross(particle.position - bodies[colliderBodies[c]].getPosition(), reaction);
+                }
+            });
         }
-        if (particle.position.x > Rightplane.position.x - particle.getRadius()) {
-            particle.position.x = Rightplane.position.x - particle.getRadius() - 0.01f;
-            if (particle.velocity.x > 0) {
-                particle.velocity.x = -particle.velocity.x * 0.5f;
+    }, 1024);
+    for (Particle &particle : all) {
+        grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
+    }
+}
+
+void SPHSolver::handleBoundaryCollision(float contactDistance) {
+    std::vector<Particle> &all = *particles;
+    ThreadPool::instance().parallelFor(0, all.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Particle &particle = all[i];
+            if (isFrozen(particle)) {
+                continue;
             }
+            // the samples aren't pushed back, the particle takes the whole correction like against a sleeping
+            // neighbour; a rigid body gets the momentum the particle loses
+            forEachBoundaryNear(particle.gridIndex, [&](const BoundaryParticles &samples, int b) {
+                glm::vec3 offset = grid.separation(particle.position, samples.positions[b]);
+                float distance = glm::length(offset);
+                if (distance >= contactDistance || distance <= 1e-6f) {
+                    return;
+                }
+                glm::vec3 normal = offset / distance;
+                particle.position += (contactDistance - distance) * normal;
+                float approach = glm::dot(particle.velocity - samples.velocities[b], normal);
+                if (approach < 0) {
+                    particle.velocity -= approach * normal;
+                    if (samples.owners[b] != -1) {
+                        BodyImpulse &impulse = bodyImpulse(samples.owners[b]);
+                        glm::vec3 reaction = particle.mass * approach * normal;
+                        impulse.linear += reaction;
+                        impulse.angular += glm::cross(samples.positions[b] - bodies[samples.owners[b]].getPosition(), reaction);
+                    }
+                }
+            });
+            // a particle fast enough to pass between the samples in one step is still kept inside the grid
+            grid.wrap(particle.position);
+            glm::vec3 inside = particle.position;
+            clampToDomain(inside);
+            for (int axis = 0; axis < 3; axis++) {
+                if (inside[axis] != particle.position[axis] && (inside[axis] - particle.position[axis]) * particle.velocity[axis] < 0) {
+                    particle.velocity[axis] = 0.0f;
+                }
+            }
+            particle.position = inside;
         }
+    }, 1024);
+    for (Particle &particle : all) {
+        grid.recomputeParticleIndex(particle.id, particle.getGridIndex());
     }
 }
 
-void SPHSolver::handleParticleCollision() {
+void SPHSolver::handleParticleCollision(float contactDistance) {
     if (particles->size() == 0) {
         return;
     }
-    std::vector<std::vector<int>> *gridMap = grid.getGrid();
+    std::pmr::vector<std::pmr::vector<int>> *gridMap = grid.getGrid();
+    std::pmr::vector<int> particleIndices(&scratch());
     for (int index = 0; index < gridMap->size(); index++) {
-        std::vector<int> particleIndices = gridMap->at(index);
+        if (gridMap->at(index).empty() || isAsleep(index)) {
+            continue;
+        }
+        particleIndices.assign(gridMap->at(index).begin(), gridMap->at(index).end());
         const std::array<int, 26> &neighbours = grid.getNeighbours(index);
         for (int i = 0; i < neighbours.size(); i++) {
             if (neighbours[i] == -1) {
@@ -86,14 +1786,16 @@ void SPHSolver::handleParticleCollision() {
             particleIndices.insert(particleIndices.end(), gridMap->at(neighbours[i]).begin(), gridMap->at(neighbours[i]).end());
         }
 
-        for (int i = 0; i < particleIndices.size(); i++) {
+        // only the cell's own particles, the gathered neighbours get their turn in their own cells
+        int ownCount = gridMap->at(index).size();
+        for (int i = 0; i < ownCount; i++) {
             //computeDensityPressure(particleIndices[i], particleIndices);
-            computeForces(particleIndices[i], particleIndices);
+            computeForces(particleIndices[i], particleIndices, contactDistance);
         }
     }
 }
 
-void SPHSolver::computeForces(int particleIndex, std::vector<int> &neighbours) {
+void SPHSolver::computeForces(int particleIndex, const std::pmr::vector<int> &neighbours, float contactDistance) {
     Particle &particle = (*particles)[particleIndex];
     glm::vec3 repulsiveForce = glm::vec3(0.0f);
     glm::vec3 pressureForce = glm::vec3(0.0f);
@@ -102,14 +1804,21 @@ void SPHSolver::computeForces(int particleIndex, std::vector<int> &neighbours) {
             continue;
         }
         Particle &neighbour = (*particles)[neighbours[i]];
-        glm::vec3 np = particle.position - neighbour.position; // vector from neighbour to particle
+        glm::vec3 np = grid.separation(particle.position, neighbour.position); // vector from neighbour to particle
         float distance = glm::length(np);
         glm::vec3 normal = glm::normalize(np);
         pressureForce += -normal * pressureConstant * smoothingFunction(distance);
         //particle.velocity += pressureForce;
         //neighbour.velocity -= pressureForce;
-        if (distance < 2 * Particle::Radius()) {
-            float overlap = 2 * Particle::Radius() - distance;
+        if (distance < contactDistance && isAsleep(neighbour.gridIndex)) {
+            // sleeping particles don't move, the awake one takes the whole correction
+            particle.position += (contactDistance - distance) * normal;
+            float relativeVelocity = glm::dot(particle.velocity, normal);
+            if (relativeVelocity < 0) {
+                particle.velocity -= relativeVelocity * normal;
+            }
+        } else if (distance < contactDistance) {
+            float overlap = contactDistance - distance;
             particle.position += overlap * 0.5f * normal;
             neighbour.position -= overlap * 0.5f * normal;
             float relativeVelocity = glm::dot(particle.velocity - neighbour.velocity, normal);
@@ -127,34 +1836,8 @@ float SPHSolver::smoothingFunction(float r) {
 }
 
 void SPHSolver::spawnParticles() {
-    for (int i = 0; i < 100; i++) {
-        // random number between -1 and 1
-        //float x = -1 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(1-(-1))));
-        //float y = 1 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(2-1)));
-        //float z = -1 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(1-(-1))));
-        //Particle particle(shaderProgram, glm::vec3(x, y, z), 0.1f, particleCount);
-        //particleCount++;
-        //particles->push_back(particle);
-    }
-    //Particle particle(shaderProgram, glm::vec3(0.0f, 1.0f, 0.0f), 0.1f, particleCount);
-    //particleCount++;
-    //Particle particle2(shaderProgram, glm::vec3(0.0f, 1.0f, 0.0f), 0.1f, particleCount);
-    //particleCount++;
-    //Particle particle3(shaderProgram, glm::vec3(0.0f, 1.0f, 0.1f), 0.1f, particleCount);
-    //particleCount++;
-    //particles->push_back(particle);
-    //particles->push_back(particle2);
-    //particles->push_back(particle3);
-
-    for (int i = 0; i < 5; i++) {
-        for (int j = 0; j < 5; j++) {
-            for (int k = 0; k < 5; k++) {
-                Particle particle(shaderProgram, glm::vec3(i * 2 * Particle::Radius(), 1.0f + j * 2 * Particle::Radius(), -1.0f + k * 2 * Particle::Radius()), 0.1f, particleCount);
-                particleCount++;
-                particles->push_back(particle);
-            }
-        }
-    }
+    glm::vec3 corner(0.0f, 1.0f, -1.0f);
+    fillBox(corner, corner + glm::vec3(10 * Particle::Radius()), PACKING_LATTICE);
 }
 
 void SPHSolver::pause() {
@@ -1,16 +1,65 @@
 #ifndef SPHSOLVER_H
 #define SPHSOLVER_H
 
+#include <algorithm>
 #include <array>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <utility>
 
 #include "mesh.h"
 #include "utils/ShaderProgram.h"
 #include "grid.h"
-#include "particle.h"
+#include "Particle.h"
+#include "initialConditions.h"
+#include "boundary.h"
+#include "sdfCollider.h"
+#include "kinematicMotion.h"
+#include "colliderGrid.h"
+#include "rigidBody.h"
+#include "particleSink.h"
+#include "particleEmitter.h"
+#include "utils/Arena.h"
+#include "utils/FunctionRef.h"
+#include "utils/TaskGraph.h"
+
+enum SolverMode {
+    SOLVER_CONTACT,     // gravity plus position-based contact pushes
+    SOLVER_PCISPH,      // predictive-corrective incompressible SPH (Solenthaler and Pajarola 2009)
+    SOLVER_PBF          // position based fluids (Macklin and Müller 2013)
+};
+
+// Where the pages of the per-particle arrays live on a machine with several NUMA nodes
+enum MemoryPlacement {
+    PLACEMENT_FIRST_TOUCH,  // left to the kernel, a page goes to the node of the thread that writes it first
+    PLACEMENT_INTERLEAVED,  // spread round-robin over the nodes
+    PLACEMENT_LOCAL         // every pinned thread's part of the arrays on that thread's node
+};
+
+struct PressureSolverStats {
+    int iterations = 0;
+    float densityError = 0.0f;      // mean relative compression of the last iteration
+    float maxDensityError = 0.0f;
+};
+
+// Density constraint error of a range of particles, summed over the awake ones
+struct ConstraintError {
+    double sum = 0.0;
+    float max = 0.0f;
+    int awake = 0;
+
+    void add(const ConstraintError &other) {
+        sum += other.sum;
+        max = std::max(max, other.max);
+        awake += other.awake;
+    }
+};
 
 class SPHSolver {
 private :
     bool paused = false;
+    bool drawParticles = true;
     std::shared_ptr<std::vector<Particle>> particles;
     RigidPlane Yplane;
     RigidPlane Backplane;
@@ -18,6 +67,8 @@ private :
     RigidPlane Rightplane;
     RigidPlaneInvisible Frontplane;
     std::shared_ptr<ShaderProgram> shaderProgram;
+    Mesh particleMesh;
+    std::vector<glm::vec3> particleOffsets;
     Grid grid;
     unsigned int particleCount = 0;
     float pressureConstant = 0.00001f;
@@ -26,24 +77,338 @@ private :
     float nearGasConstant = 2.15f;
     float collisionDamping = 0.95f;
     float viscosityConstant = 0.00001f;
-    float effectLength = 1.3f * Particle::Radius();
+    float effectLength = 2.0f * Particle::Radius();
+    float particleMass = restDensity * Particle::Radius() * Particle::Radius() * Particle::Radius();
+    float restSpacing = 2.0f * Particle::Radius(); // lattice spacing at rest density, computed in the constructor
+
+    SolverMode solverMode = SOLVER_CONTACT;
+    glm::vec3 gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+
+    // PCISPH: iterate until the mean compression is below densityTolerance and the largest below
+    // maxDensityTolerance, at most maxPressureIterations times
+    int minPressureIterations = 3;
+    int maxPressureIterations = 50;
+    float densityTolerance = 0.01f;
+    float maxDensityTolerance = 0.05f;
+    float minPressureSubstep = 0.0005f;     // a step that doesn't converge is split in halves down to this
+    float pcisphContactFraction = 0.7f;     // of restSpacing, closer pairs are separated after the pressure solve
+    bool warmStartPressure = true;          // start from the previous step's pressure instead of zero
+    float latticeGradientNorm = 1.0f;       // sum of the squared density constraint gradients at rest spacing
+    float pcisphStiffness = 0.0f;           // delta * dt^2, from a full lattice neighbourhood at rest spacing
+    PressureSolverStats pressureStats;
+    BoundaryParticles staticBoundary;       // the floor and the walls of the axes that don't wrap
+    BoundaryParticles bodySamples;          // the rigid bodies' samples at their current pose, sorted every step
+    float boundaryVolumeScale = 1.0f;
+    std::vector<std::shared_ptr<SdfCollider>> colliders;
+    std::vector<KinematicMotion> colliderMotions;
+    std::vector<std::unique_ptr<Mesh>> colliderMeshes;
+    std::vector<glm::mat4> colliderModels;  // pose of every collider at the end of the last step, the meshes get it when drawn
+    std::vector<int> colliderBodies;        // rigid body driving the collider, -1 for scripted motion
+    ColliderGrid colliderGrid;
+    bool collidersMoving = false;
+    float simulationTime = 0.0f;
+    std::vector<ParticleSink> sinks;
+    long long removedParticles = 0;         // by the sinks and the removal calls since the last reset
+    std::vector<ParticleEmitter> emitters;
+    std::vector<std::vector<glm::vec3>> emitterOpenings;    // lattice points of every emitter at the rest spacing
+    std::vector<double> emitterLayers;      // layers due and not emitted yet, the fraction carries over
+    long long emittedParticles = 0;
+    size_t maxParticles = 0;                // emitters stop short of it, 0 for no cap
+
+    // Two-way coupled rigid bodies: every pass that pushes fluid off a body's samples or collider adds the reaction
+    // to the calling thread's slot, bodyImpulses[thread * bodies.size() + body], the slots are summed after the step
+    std::vector<RigidBody> bodies;
+    std::vector<BodyImpulse> bodyImpulses;
+    std::vector<float> bodyPressureTerms;
+    std::vector<float> accumulatedMultipliers;
+
+    // PBF: a fixed number of Jacobi iterations over the density constraints
+    int pbfIterations = 4;
+    float pbfRelaxation = 0.1f;             // epsilon, relative to latticeGradientNorm, softens the constraints
+    float pbfCorrectionStrength = 0.001f;   // artificial pressure k, relative to latticeGradientNorm
+    float pbfCorrectionDistance = 0.2f;     // artificial pressure delta q, relative to h
+    float xsphViscosity = 0.1f;
+
+    // per-step neighbour lists, CSR layout: the neighbours of i are neighbourIds[neighbourOffsets[i], neighbourOffsets[i + 1])
+    std::vector<int> neighbourOffsets;
+    std::vector<int> neighbourIds;
+    std::vector<glm::vec3> currentPositions;
+    std::vector<glm::vec3> predictedPositions;
+    std::vector<glm::vec3> externalAccelerations;
+    std::vector<glm::vec3> pressureAccelerations;
+    std::vector<float> predictedDensities;
+    std::vector<float> constraintMultipliers;
+    std::vector<glm::vec3> positionCorrections;
+    std::vector<glm::vec3> startVelocities;         // contact: the velocities before the step, for the accelerations
+
+    // Sleeping: a grid cell whose particles all stay slower than sleepVelocity and less compressed than
+    // sleepDensityError for sleepSteps steps is frozen, it is skipped by integration, collisions and the
+    // density pass and acts as a static obstacle for its awake neighbours
+    bool sleepingEnabled = true;
+    float sleepVelocity = 0.25f;
+    float sleepDensityError = 0.05f;
+    int sleepSteps = 30;
+    std::vector<int> cellQuietSteps;
+    std::vector<int> cellSleepingCount;     // particle count when the cell fell asleep, -1 while awake
+    std::vector<unsigned char> cellDisturbed;
+
+    // NUMA placement: the particles are sorted by cell every sortInterval steps, so the part of the arrays a
+    // pinned thread works on is a compact slab of the grid, and every array is placed again when its storage moves
+    MemoryPlacement memoryPlacement = PLACEMENT_FIRST_TOUCH;
+    int sortInterval = 50;
+    int stepsSinceSort = 0;
+    std::vector<std::pair<const void *, size_t>> placedArrays;  // storage and capacity of each array when it was last placed
+    std::vector<Particle> sortedParticles;
+
+    // Task graph (PBF only): the step runs as tasks over blocks of whole z-layers of cells, so a block of one pass
+    // waits for the blocks around it in the pass before instead of for all of them
+    bool taskGraphEnabled = false;
+    TaskGraph taskGraph;
+    TaskGraphProfile taskGraphProfile;      // every step since the last reset added up
+    // the graph is built for a block count and kept while that and the passes it runs stay the same, its tasks
+    // read the step's block bounds and timestep from here
+    int graphBlocks = 0;
+    int graphIterations = 0;
+    bool graphBodies = false;
+    bool graphExport = false;
+    std::vector<int> graphStarts;               // first particle of every block, then the particle count
+    std::vector<ConstraintError> graphErrors;   // of every iteration and block
+    float graphDt = 0.0f;
+    std::function<void(const std::vector<Particle> &, int, int)> stepExport;
+    std::function<void(size_t)> stepExportCount;
+    unsigned long long stepAllocations = 0;     // operator new calls during the last step
+
+    // Scratch data of a step (gathered neighbours, collider buckets, boundary sorting, ...) comes from the
+    // calling thread's arena, one per pool thread, all reset at the start of the step
+    std::vector<std::unique_ptr<Arena>> scratchArenas;
+    Arena &scratch() { return *scratchArenas[ThreadPool::instance().threadIndex()]; }
+
+    // The constants setParameter knows, by member name
+    static const std::vector<std::pair<std::string, float SPHSolver::*>> &floatParameters();
+    static const std::vector<std::pair<std::string, int SPHSolver::*>> &intParameters();
+    // Whether a value is known and in range for the parameter
+    bool validParameter(const std::string &name, double value) const;
+    // Stores one valid value, changed tells whether the derived constants need updating
+    void assignParameter(const std::string &name, double value, bool &changed);
 public :
     SPHSolver(std::shared_ptr<std::vector<Particle>> particles, std::shared_ptr<ShaderProgram> shaderProgram);
     
+    // Renders the planes, steps the simulation and draws the particles
     void update(float dt);
+    // Drawing only, no simulation: the walls and the obstacles at the given poses (see getColliderModels). With
+    // the solver stepping on another thread these take a snapshot of its state instead of the live one.
+    void renderBoundaries(const std::vector<glm::mat4> &models);
+    void renderParticles(const std::vector<Particle> &particles);
+    // Advances the simulation only, no GL calls
+    void step(float dt);
+    void stepContact(float dt);
+    void stepPCISPH(float dt);
+    void stepPBF(float dt);
+    // Same step as stepPBF, run as a task graph after sorting the particles by cell
+    void stepPBFGraph(float dt);
+    void buildPBFGraph(int blocks);
+
+    // Gathers the neighbours within radius of every particle from the grid, measured between the predicted
+    // positions instead of the current ones if predicted is set
+    void buildNeighbourLists(float radius, bool predicted = false);
+    // The two passes of buildNeighbourLists over [begin, end): the counts into neighbourOffsets[i + 1], then the
+    // ids once the offsets are summed up
+    void countNeighbours(int begin, int end, float radius, bool predicted = false);
+    void fillNeighbours(int begin, int end, float radius, bool predicted = false);
+    void computePressureAccelerations(const std::vector<glm::vec3> &positions);
+    // Density of particle i at the given positions, including the boundary samples
+    float predictDensity(int i, const std::vector<glm::vec3> &positions) const;
+    // Contribution of the boundary samples around the grid cell at position
+    float boundaryDensity(int cell, const glm::vec3 &position) const;
+    // Particle mass, rest spacing, the lattice constants and the boundary samples, from the current parameters
+    void updateDerivedConstants();
+    // Samples the floor and walls into staticBoundary, leaving out the walls across periodic axes
+    void buildStaticBoundary();
+    // Keeps a position inside the grid, a last resort for particles that pass between boundary samples.
+    // Periodic axes wrap around instead.
+    void clampToDomain(glm::vec3 &position) const;
+    bool isFrozen(const Particle &particle) const { return particle.paused || isAsleep(particle.gridIndex); }
+
+    void computeDensities();
+    void computeDensities(int begin, int end);
+    // Puts quiet cells to sleep and wakes sleeping cells next to disturbed ones or whose particle count changed
+    void updateSleeping();
+    // Reorders the particles cell by cell in grid order, the ids are renumbered and the storage is kept. False if
+    // the grid doesn't hold every particle, they are left as they are then.
+    bool sortParticlesByCell();
+    // Places the arrays whose storage moved since they were last placed, the neighbour ids also right after a sort
+    void placeParticleArrays(bool sorted);
+    // Binds [parts[t], parts[t + 1]) of the array to the node of thread t, the last part up to the capacity.
+    // Interleaved placement, or a pool that isn't pinned, spreads the whole array instead.
+    void placeArray(size_t slot, const void *data, size_t elementSize, size_t capacity, const std::pmr::vector<size_t> &parts, bool force);
+    // PBF passes over the particles [begin, end), stepPBF runs each over all of them before the next
+    void resizePBFArrays(int count);
+    void predictPBF(int begin, int end, float dt);
+    // Constraint multipliers at the predicted positions
+    ConstraintError solveDensityConstraints(int begin, int end);
+    void computePositionCorrections(int begin, int end);
+    void applyPositionCorrections(int begin, int end);
+    // Reaction on the rigid bodies of the pushes of all iterations, over every particle
+    void accumulateBodyPressurePBF(float dt);
+    void updateVelocitiesPBF(int begin, int end, float dt);
+    void computeXsph(int begin, int end);
+    // Applies the XSPH blend and moves the particles to their predicted positions, the grid isn't updated
+    void finishPBF(int begin, int end);
+    // Mean relative deviation from the rest density
+    float densityError() const;
 
     void handleCollisions();
-    void handlePlaneCollision();
-    void handleParticleCollision();
+    // Pushes particles closer than contactDistance to a boundary sample back out
+    void handleBoundaryCollision(float contactDistance);
+    // Poses the obstacles at the given time (rigid bodies at their current state) and rebuilds the coarse grid
+    // they are looked up in
+    void updateColliders(float time);
+    // Sorts the bodies' samples at their current pose into bodySamples and clears the impulse slots
+    void gatherBodySamples();
+    // Calls f(samples, b) for every wall and body sample in the cell and its 26 neighbours
+    template <typename F>
+    void forEachBoundaryNear(int cell, F &&f) const {
+        staticBoundary.forEachNear(grid, cell, [&](int b) { f(staticBoundary, b); });
+        if (!bodySamples.empty()) {
+            bodySamples.forEachNear(grid, cell, [&](int b) { f(bodySamples, b); });
+        }
+    }
+    // Sums the impulse slots and integrates the bodies
+    void integrateRigidBodies(float dt);
+    // The calling thread's impulse slot for a body
+    BodyImpulse &bodyImpulse(int body) { return bodyImpulses[ThreadPool::instance().threadIndex() * bodies.size() + body]; }
+    // Reaction of the pressure push the bodies' samples give the fluid, pressureTerms[i] is p_i / rho0^2 or
+    // its PBF equivalent
+    void accumulateBodyPressure(const std::vector<glm::vec3> &positions, const std::vector<float> &pressureTerms, float dt);
+    // Pushes particles closer than half of contactDistance to an obstacle surface back out, the velocity into
+    // the surface is taken relative to the surface's own
+    void handleColliderCollision(float contactDistance);
+    // Same push on a bare position, for the predicted positions of PBF
+    void projectOutOfColliders(glm::vec3 &position, float radius);
+    // Pushes apart pairs closer than contactDistance
+    void handleParticleCollision(float contactDistance);
 
-    void computeForces(int particleIndex, std::vector<int> &neighbours);
+    void computeForces(int particleIndex, const std::pmr::vector<int> &neighbours, float contactDistance);
 
     void addParticle(Particle particle);
     void spawnParticles();
+    // Removes one particle in O(1): the last particle takes its slot and id, so the order of the particles changes
+    void removeParticle(int id);
+    // Removes every particle remove(particle) is true for and closes the gaps in one pass, the particles left keep
+    // their order and the grid cells are renumbered in place. Returns how many were removed.
+    int removeParticles(FunctionRef<bool(const Particle &)> remove);
+    // Particles inside a sink at the start of a step are removed before it runs, paused ones excepted
+    void addSink(const ParticleSink &sink) { sinks.push_back(sink); }
+    const std::vector<ParticleSink> &getSinks() const { return sinks; }
+    long long getRemovedParticleCount() const { return removedParticles; }
+    // The layers an emitter has due at the start of a step come out before it runs, through the bulk insertion
+    // of emitParticles. A lattice point closer than 0.9 of the rest spacing to fluid already there is skipped, so
+    // fluid backing up into the opening slows the inflow down instead of piling up.
+    void addEmitter(const ParticleEmitter &emitter);
+    const std::vector<ParticleEmitter> &getEmitters() const { return emitters; }
+    long long getEmittedParticleCount() const { return emittedParticles; }
+    void emitInflow(float dt);
+    // Caps the particle count for the emitters and reserves every per-particle array for that many, so a run
+    // with inflow doesn't grow them mid-run. 0 lifts the cap.
+    void setMaxParticles(size_t count);
+
+    // Bulk emission: storage grows once, particles are filled in parallel and inserted in the grid in one pass.
+    // Lattice points are inclusive of min and max.
+    void spawnBox(glm::vec3 min, glm::vec3 max, float spacing, glm::vec3 velocity = glm::vec3(0.0f));
+    void spawnSphere(glm::vec3 center, float radius, float spacing, glm::vec3 velocity = glm::vec3(0.0f));
+    void emitParticles(const std::vector<glm::vec3> &positions, glm::vec3 velocity = glm::vec3(0.0f));
+    void emitParticles(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &velocities);
+    // Leaves out the points that would land inside fluid already there or inside an obstacle
+    void removeOccupied(std::vector<glm::vec3> &positions);
+    // Swaps in a whole new particle set (after a domain decomposition exchange), the ids are renumbered and the
+    // grid is rebuilt in one pass
+    void replaceParticles(std::vector<Particle> &replacement);
+    // Removes every particle and rewinds the clock, the parameters, obstacles and all storage are kept, so one
+    // solver runs scene after scene without reallocating. Rigid bodies aren't rewound.
+    void reset();
+
+    // Fills [min, max] at rest density. With a cache directory the block is relaxed once and the settled
+    // state is stored there, keyed by the scene parameters and the particles already in it, so later runs start
+    // from it directly. The particles already in the scene are held in place while the block settles.
+    void fillBox(glm::vec3 min, glm::vec3 max, PackingMode mode, const std::string &cacheDirectory = "");
+    // Scene setup only: steps with damped velocities until no particle from first on moves faster than
+    // speedTolerance, then zeroes their velocities. The particles before first are paused meanwhile.
+    // Returns the steps taken.
+    int relax(float dt, int maxSteps, float speedTolerance, int first = 0);
+
+    // Preallocates room for count particles in total so later emissions don't reallocate
+    void reserveParticles(size_t count) { particles->reserve(count); }
+
+    // Obstacle, the mesh is voxelised into a distance field at half the rest spacing once and then moved rigidly
+    // by motion (at rest by default)
+    void addCollider(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles,
+                     const KinematicMotion &motion = KinematicMotion());
+    // Loads an OBJ file as an obstacle, false if it can't be read
+    bool addCollider(const std::string &objPath, const KinematicMotion &motion = KinematicMotion());
+    // Rigid body moved by the fluid, density relative to the fluid's rest density
+    void addRigidBody(const std::vector<glm::vec3> &vertices, const std::vector<glm::uvec3> &triangles, float relativeDensity);
+    bool addRigidBody(const std::string &objPath, float relativeDensity);
+    const std::vector<RigidBody> &getRigidBodies() const { return bodies; }
+
 
     void unpause();
     void pause();
 
+    // Particles keep being integrated when they are not drawn (e.g. when the surface is shown instead)
+    void setDrawParticles(bool draw) { drawParticles = draw; }
+
+    const Grid &getGrid() const { return grid; }
+    const std::vector<Particle> &getParticles() const { return *particles; }
+    const std::vector<glm::mat4> &getColliderModels() const { return colliderModels; }
+    // Scene setup: particles leaving through one side of a periodic axis come back on the other and interact
+    // across the seam by the nearest image, the walls across the axis are removed. Obstacles and rigid bodies
+    // don't wrap.
+    void setPeriodicAxes(glm::bvec3 axes);
+    float getSimulationTime() const { return simulationTime; }
+    float getRestSpacing() const { return restSpacing; }
+    float getSmoothingLength() const { return effectLength; }
+
+    void setSolverMode(SolverMode mode) { solverMode = mode; }
+    SolverMode getSolverMode() const { return solverMode; }
+    // Largest dt the current mode runs at without substepping
+    float getMaxStableTimestep() const;
+    void setPressureIterations(int minIterations, int maxIterations) { minPressureIterations = minIterations; maxPressureIterations = maxIterations; }
+    void setDensityTolerance(float meanTolerance, float maxTolerance) { densityTolerance = meanTolerance; maxDensityTolerance = maxTolerance; }
+    void setWarmStartPressure(bool warmStart) { warmStartPressure = warmStart; }
+    void setPbfIterations(int iterations) { pbfIterations = iterations; }
+    // PBF only, the other solvers need every pass finished before the next (convergence checks, Gauss-Seidel pushes)
+    void setTaskGraph(bool enabled) { taskGraphEnabled = enabled; }
+    bool isTaskGraphEnabled() const { return taskGraphEnabled; }
+    const TaskGraphProfile &getTaskGraphProfile() const { return taskGraphProfile; }
+    void resetTaskGraphProfile() { taskGraphProfile = TaskGraphProfile(); }
+    // Called with the particles [first, last) once their positions and densities are final for the step, every block
+    // on its own as soon as it is done when the step runs as a task graph, else all of them at the end of the step
+    void setStepExport(std::function<void(const std::vector<Particle> &particles, int first, int last)> exportRange) { stepExport = exportRange; }
+    // Called once a step with the number of particles it exports, after the sinks and emitters changed the count
+    // and before the first range is exported, so the receiver can size its copy
+    void setStepExportCount(std::function<void(size_t count)> exportCount) { stepExportCount = exportCount; }
+    const PressureSolverStats &getPressureSolverStats() const { return pressureStats; }
+    // Heap allocations made during the last step, by any thread of the process
+    unsigned long long getStepAllocations() const { return stepAllocations; }
+    // Bytes reserved by the scratch arenas of all threads
+    size_t getScratchCapacity() const;
+    // Tunable constants by member name (restDensity, viscosityConstant, pbfIterations, ...), for scene and sweep
+    // files. Set them before adding particles, the mass, rest spacing and boundary samples follow. False for an
+    // unknown name or a value the solver can't run with (negative, or an effectLength longer than a grid cell).
+    bool setParameter(const std::string &name, double value);
+    // Several at once, the derived constants are updated once; the error names the first value refused
+    bool setParameters(const std::vector<std::pair<std::string, double>> &parameters, std::string &error);
+    bool getParameter(const std::string &name, double &value) const;
+    static std::vector<std::string> parameterNames();
+
+    // Interleaved and local placement sort the particles by cell every few steps and bind the arrays' pages
+    // with mbind. Local placement follows ThreadPool::rangeOfThread, so the pool should be pinned first.
+    void setMemoryPlacement(MemoryPlacement placement);
+
+    void setSleepingEnabled(bool enabled);
+    bool isAsleep(int cellIndex) const { return cellSleepingCount[cellIndex] != -1; }
+    int getSleepingParticleCount() const;
+
     float smoothingFunction(float r);
 };
 
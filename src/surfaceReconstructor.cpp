@@ -0,0 +1,402 @@
+#include "surfaceReconstructor.h"
+
+#include "utils/ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+namespace {
+
+// Corner c of a cube sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1).
+// Edges 0-3 run along x, 4-7 along y, 8-11 along z, the first corner is the lower one.
+const int EDGE_CORNERS[12][2] = {
+    {0, 1}, {2, 3}, {4, 5}, {6, 7},
+    {0, 2}, {1, 3}, {4, 6}, {5, 7},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
+const int FACE_CORNERS[6][4] = {
+    {0, 2, 6, 4}, {1, 3, 7, 5},
+    {0, 1, 5, 4}, {2, 3, 7, 6},
+    {0, 1, 3, 2}, {4, 5, 7, 6}
+};
+
+glm::ivec3 cornerOffset(int corner) {
+    return glm::ivec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+}
+
+int edgeBetween(int a, int b) {
+    for (int e = 0; e < 12; e++) {
+        if ((EDGE_CORNERS[e][0] == a && EDGE_CORNERS[e][1] == b) ||
+            (EDGE_CORNERS[e][0] == b && EDGE_CORNERS[e][1] == a)) {
+            return e;
+        }
+    }
+    return -1;
+}
+
+// Builds the marching cubes triangle table instead of hardcoding the usual 256x16 one.
+// On every face the crossed edges are paired so that each run of inside corners is cut off on its
+// own, which only depends on the signs of that face and keeps neighbouring cubes consistent.
+// Walking the face segments gives closed loops around the cube that are fanned into triangles.
+struct CubeTable {
+    std::array<std::vector<int>, 256> triangles;
+
+    CubeTable() {
+        int faces[6][4];
+        for (int f = 0; f < 6; f++) {
+            glm::vec3 p[4];
+            for (int i = 0; i < 4; i++) {
+                faces[f][i] = FACE_CORNERS[f][i];
+                p[i] = glm::vec3(cornerOffset(FACE_CORNERS[f][i]));
+            }
+            glm::vec3 outward = (p[0] + p[1] + p[2] + p[3]) * 0.25f - glm::vec3(0.5f);
+            if (glm::dot(glm::cross(p[1] - p[0], p[2] - p[1]), outward) < 0.0f) {
+                std::swap(faces[f][1], faces[f][3]);
+            }
+        }
+
+        for (int mask = 0; mask < 256; mask++) {
+            int next[12];
+            std::fill(next, next + 12, -1);
+            for (int f = 0; f < 6; f++) {
+                int crossings[4];
+                bool entering[4];
+                int count = 0;
+                for (int i = 0; i < 4; i++) {
+                    int a = faces[f][i];
+                    int b = faces[f][(i + 1) % 4];
+                    bool insideA = (mask >> a) & 1;
+                    bool insideB = (mask >> b) & 1;
+                    if (insideA != insideB) {
+                        crossings[count] = edgeBetween(a, b);
+                        entering[count] = insideB;
+                        count++;
+                    }
+                }
+                for (int i = 0; i < count; i++) {
+                    if (entering[i]) {
+                        next[crossings[i]] = crossings[(i + 1) % count];
+                    }
+                }
+            }
+
+            bool visited[12] = {false};
+            for (int start = 0; start < 12; start++) {
+                if (next[start] < 0 || visited[start]) {
+                    continue;
+                }
+                std::vector<int> loop;
+                for (int e = start; !visited[e]; e = next[e]) {
+                    visited[e] = true;
+                    loop.push_back(e);
+                }
+                for (size_t i = 1; i + 1 < loop.size(); i++) {
+                    triangles[mask].push_back(loop[0]);
+                    triangles[mask].push_back(loop[i]);
+                    triangles[mask].push_back(loop[i + 1]);
+                }
+            }
+        }
+    }
+};
+
+const CubeTable &cubeTable() {
+    static CubeTable table;
+    return table;
+}
+
+int floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+float kernel(float distanceSquared, float hSquared) {
+    if (distanceSquared >= hSquared) {
+        return 0.0f;
+    }
+    float x = 1.0f - distanceSquared / hSquared;
+    return x * x * x;
+}
+
+float millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+}
+
+SurfaceReconstructor::SurfaceReconstructor(int samplesPerCell, float isoValue) :
+    _samplesPerCell(std::max(samplesPerCell, 1)),
+    _isoValue(isoValue) {
+    cubeTable();
+}
+
+void SurfaceReconstructor::reconstruct(const std::vector<Particle> &particles, const Grid &grid) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const int N = _samplesPerCell;
+
+    _cellSize = grid.size;
+    _voxelSize = grid.size / N;
+    _origin = grid.origin;
+    _paddedDims = glm::ivec3(grid.num_cells_x + 2, grid.num_cells_y + 2, grid.num_cells_z + 2);
+    _blockSlots.assign(_paddedDims.x * _paddedDims.y * _paddedDims.z, -1);
+
+    // activate every occupied cell and its neighbours, the kernel never reaches further
+    int activeCount = 0;
+    for (int k = 0; k < grid.num_cells_z; k++) {
+        for (int j = 0; j < grid.num_cells_y; j++) {
+            for (int i = 0; i < grid.num_cells_x; i++) {
+                if (grid.grid[i + j * grid.num_cells_x + k * grid.num_cells_x * grid.num_cells_y].empty()) {
+                    continue;
+                }
+                for (int dz = -1; dz <= 1; dz++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int &slot = _blockSlots[(i + dx + 1) + (j + dy + 1) * _paddedDims.x + (k + dz + 1) * _paddedDims.x * _paddedDims.y];
+                            if (slot < 0) {
+                                slot = activeCount++;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // blocks keep their storage from one frame to the next
+    _blocks.resize(activeCount);
+    for (int z = 0; z < _paddedDims.z; z++) {
+        for (int y = 0; y < _paddedDims.y; y++) {
+            for (int x = 0; x < _paddedDims.x; x++) {
+                int slot = _blockSlots[x + y * _paddedDims.x + z * _paddedDims.x * _paddedDims.y];
+                if (slot >= 0) {
+                    _blocks[slot].coords = glm::ivec3(x - 1, y - 1, z - 1);
+                }
+            }
+        }
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallelFor(0, activeCount, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            splatBlock(_blocks[b], particles, grid);
+        }
+    });
+    _stats.splatMs = millisecondsSince(start);
+
+    auto polygoniseStart = std::chrono::high_resolution_clock::now();
+    pool.parallelFor(0, activeCount, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            makeBlockVertices(_blocks[b]);
+        }
+    });
+
+    unsigned int vertexCount = 0;
+    for (Block &block : _blocks) {
+        block.firstVertex = vertexCount;
+        vertexCount += block.positions.size();
+    }
+
+    pool.parallelFor(0, activeCount, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            makeBlockTriangles(_blocks[b]);
+        }
+    });
+
+    size_t triangleCount = 0;
+    for (const Block &block : _blocks) {
+        triangleCount += block.triangles.size();
+    }
+
+    _stats.polygoniseMs = millisecondsSince(polygoniseStart);
+    _stats.totalMs = millisecondsSince(start);
+    _stats.activeBlocks = activeCount;
+    _stats.vertexCount = vertexCount;
+    _stats.triangleCount = triangleCount;
+}
+
+void SurfaceReconstructor::splatBlock(Block &block, const std::vector<Particle> &particles, const Grid &grid) const {
+    const int N = _samplesPerCell;
+    const float h = _cellSize;
+    const float hSquared = h * h;
+    block.samples.assign(N * N * N, 0.0f);
+    glm::ivec3 firstSample = block.coords * N;
+
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int i = block.coords.x + dx;
+                int j = block.coords.y + dy;
+                int k = block.coords.z + dz;
+                if (i < 0 || i >= grid.num_cells_x || j < 0 || j >= grid.num_cells_y || k < 0 || k >= grid.num_cells_z) {
+                    continue;
+                }
+                const std::pmr::vector<int> &cell = grid.grid[i + j * grid.num_cells_x + k * grid.num_cells_x * grid.num_cells_y];
+                for (int id : cell) {
+                    glm::vec3 p = (particles[id].position - _origin) / _voxelSize;
+                    float reach = h / _voxelSize;
+                    glm::ivec3 lo = glm::max(glm::ivec3(glm::ceil(p - reach)) - firstSample, glm::ivec3(0));
+                    glm::ivec3 hi = glm::min(glm::ivec3(glm::floor(p + reach)) - firstSample, glm::ivec3(N - 1));
+                    for (int z = lo.z; z <= hi.z; z++) {
+                        for (int y = lo.y; y <= hi.y; y++) {
+                            for (int x = lo.x; x <= hi.x; x++) {
+                                glm::vec3 d = (glm::vec3(firstSample + glm::ivec3(x, y, z)) - p) * _voxelSize;
+                                block.samples[x + N * (y + N * z)] += kernel(glm::dot(d, d), hSquared);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SurfaceReconstructor::makeBlockVertices(Block &block) const {
+    const int N = _samplesPerCell;
+    block.edgeVertices.assign(N * N * N * 3, -1);
+    block.positions.clear();
+    block.normals.clear();
+    block.triangles.clear();
+    glm::ivec3 firstSample = block.coords * N;
+
+    for (int z = 0; z < N; z++) {
+        for (int y = 0; y < N; y++) {
+            for (int x = 0; x < N; x++) {
+                glm::ivec3 g = firstSample + glm::ivec3(x, y, z);
+                float a = block.samples[x + N * (y + N * z)];
+                for (int axis = 0; axis < 3; axis++) {
+                    glm::ivec3 other = g;
+                    other[axis]++;
+                    float b = sampleAt(other.x, other.y, other.z);
+                    if ((a > _isoValue) == (b > _isoValue)) {
+                        continue;
+                    }
+                    float t = (_isoValue - a) / (b - a);
+                    glm::vec3 position = glm::vec3(g);
+                    position[axis] += t;
+                    glm::vec3 gradient = glm::mix(gradientAt(g.x, g.y, g.z), gradientAt(other.x, other.y, other.z), t);
+                    float length = glm::length(gradient);
+
+                    block.edgeVertices[(x + N * (y + N * z)) * 3 + axis] = block.positions.size();
+                    block.positions.push_back(latticePosition(position));
+                    block.normals.push_back(length > 0.0f ? -gradient / length : glm::vec3(0.0f, 1.0f, 0.0f));
+                }
+            }
+        }
+    }
+}
+
+void SurfaceReconstructor::makeBlockTriangles(Block &block) const {
+    const int N = _samplesPerCell;
+    const CubeTable &table = cubeTable();
+    glm::ivec3 firstSample = block.coords * N;
+
+    for (int z = 0; z < N; z++) {
+        for (int y = 0; y < N; y++) {
+            for (int x = 0; x < N; x++) {
+                glm::ivec3 g = firstSample + glm::ivec3(x, y, z);
+                int mask = 0;
+                for (int c = 0; c < 8; c++) {
+                    glm::ivec3 corner = g + cornerOffset(c);
+                    if (sampleAt(corner.x, corner.y, corner.z) > _isoValue) {
+                        mask |= 1 << c;
+                    }
+                }
+                const std::vector<int> &edges = table.triangles[mask];
+                for (size_t t = 0; t < edges.size(); t += 3) {
+                    int ids[3];
+                    bool valid = true;
+                    for (int v = 0; v < 3; v++) {
+                        int edge = edges[t + v];
+                        glm::ivec3 lower = g + cornerOffset(EDGE_CORNERS[edge][0]);
+                        ids[v] = edgeVertexId(lower.x, lower.y, lower.z, edge / 4);
+                        valid = valid && ids[v] >= 0;
+                    }
+                    if (valid) {
+                        block.triangles.push_back(glm::uvec3(ids[0], ids[1], ids[2]));
+                    }
+                }
+            }
+        }
+    }
+}
+
+int SurfaceReconstructor::blockSlot(int bx, int by, int bz) const {
+    bx++;
+    by++;
+    bz++;
+    if (bx < 0 || bx >= _paddedDims.x || by < 0 || by >= _paddedDims.y || bz < 0 || bz >= _paddedDims.z) {
+        return -1;
+    }
+    return _blockSlots[bx + by * _paddedDims.x + bz * _paddedDims.x * _paddedDims.y];
+}
+
+float SurfaceReconstructor::sampleAt(int gx, int gy, int gz) const {
+    const int N = _samplesPerCell;
+    int bx = floorDiv(gx, N);
+    int by = floorDiv(gy, N);
+    int bz = floorDiv(gz, N);
+    int slot = blockSlot(bx, by, bz);
+    if (slot < 0) {
+        return 0.0f;
+    }
+    return _blocks[slot].samples[(gx - bx * N) + N * ((gy - by * N) + N * (gz - bz * N))];
+}
+
+glm::vec3 SurfaceReconstructor::gradientAt(int gx, int gy, int gz) const {
+    return glm::vec3(
+        sampleAt(gx + 1, gy, gz) - sampleAt(gx - 1, gy, gz),
+        sampleAt(gx, gy + 1, gz) - sampleAt(gx, gy - 1, gz),
+        sampleAt(gx, gy, gz + 1) - sampleAt(gx, gy, gz - 1)
+    ) / (2.0f * _voxelSize);
+}
+
+int SurfaceReconstructor::edgeVertexId(int gx, int gy, int gz, int axis) const {
+    const int N = _samplesPerCell;
+    int bx = floorDiv(gx, N);
+    int by = floorDiv(gy, N);
+    int bz = floorDiv(gz, N);
+    int slot = blockSlot(bx, by, bz);
+    if (slot < 0) {
+        return -1;
+    }
+    const Block &owner = _blocks[slot];
+    int local = owner.edgeVertices[((gx - bx * N) + N * ((gy - by * N) + N * (gz - bz * N))) * 3 + axis];
+    return local < 0 ? -1 : (int) owner.firstVertex + local;
+}
+
+glm::vec3 SurfaceReconstructor::latticePosition(glm::vec3 g) const {
+    return _origin + g * _voxelSize;
+}
+
+void SurfaceReconstructor::gatherMesh(std::vector<Vertex> &vertices, std::vector<glm::uvec3> &triangles, glm::vec4 color) const {
+    vertices.resize(_stats.vertexCount);
+    triangles.resize(_stats.triangleCount);
+    size_t triangleOffset = 0;
+    for (const Block &block : _blocks) {
+        for (size_t v = 0; v < block.positions.size(); v++) {
+            vertices[block.firstVertex + v] = Vertex(block.positions[v], color, block.normals[v]);
+        }
+        std::copy(block.triangles.begin(), block.triangles.end(), triangles.begin() + triangleOffset);
+        triangleOffset += block.triangles.size();
+    }
+}
+
+void SurfaceReconstructor::writeObj(std::ostream &out) const {
+    out << "# " << _stats.vertexCount << " vertices, " << _stats.triangleCount << " triangles\n";
+    for (const Block &block : _blocks) {
+        for (size_t v = 0; v < block.positions.size(); v++) {
+            const glm::vec3 &p = block.positions[v];
+            const glm::vec3 &n = block.normals[v];
+            out << "v " << p.x << " " << p.y << " " << p.z << "\n";
+            out << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+        }
+    }
+    for (const Block &block : _blocks) {
+        for (const glm::uvec3 &t : block.triangles) {
+            out << "f " << t.x + 1 << "//" << t.x + 1 << " "
+                << t.y + 1 << "//" << t.y + 1 << " "
+                << t.z + 1 << "//" << t.z + 1 << "\n";
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SURFACE_RECONSTRUCTOR_H
+#define SURFACE_RECONSTRUCTOR_H
+
+#include <glm/glm.hpp>
+
+#include <ostream>
+#include <vector>
+
+#include "grid.h"
+
+struct SurfaceStats {
+    float splatMs = 0.0f;
+    float polygoniseMs = 0.0f;
+    float totalMs = 0.0f;
+    size_t activeBlocks = 0;
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+};
+
+// Extracts the fluid surface with marching cubes.
+// Every cell of the neighbour grid that holds particles (plus its 26 neighbours) gets a block of
+// samplesPerCell^3 scalar samples, the rest of the domain is never touched. Blocks are splatted and
+// polygonised in parallel, each block owning the vertices on the edges starting at its samples so
+// vertices are shared between blocks without any locking.
+class SurfaceReconstructor {
+public:
+    SurfaceReconstructor(int samplesPerCell = 4, float isoValue = 0.5f);
+
+    // Rebuilds the surface from the current particle positions
+    void reconstruct(const std::vector<Particle> &particles, const Grid &grid);
+
+    // Copies the surface into flat arrays ready for a Mesh
+    void gatherMesh(std::vector<Vertex> &vertices, std::vector<glm::uvec3> &triangles, glm::vec4 color) const;
+
+    // Writes the surface as a Wavefront OBJ, block after block, without building a merged copy
+    void writeObj(std::ostream &out) const;
+
+    const SurfaceStats &getStats() const { return _stats; }
+
+    void setIsoValue(float isoValue) { _isoValue = isoValue; }
+    float getIsoValue() const { return _isoValue; }
+
+private:
+    struct Block {
+        glm::ivec3 coords;                  // cell coordinates, may lie one cell outside the grid
+        std::vector<float> samples;         // samplesPerCell^3 field values
+        std::vector<int> edgeVertices;      // local vertex id of each owned edge (x, y, z per sample), -1 if none
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::uvec3> triangles;
+        unsigned int firstVertex = 0;       // offset of this block's vertices in the whole surface
+    };
+
+    void splatBlock(Block &block, const std::vector<Particle> &particles, const Grid &grid) const;
+    void makeBlockVertices(Block &block) const;
+    void makeBlockTriangles(Block &block) const;
+
+    int blockSlot(int bx, int by, int bz) const;
+    float sampleAt(int gx, int gy, int gz) const;
+    glm::vec3 gradientAt(int gx, int gy, int gz) const;
+    int edgeVertexId(int gx, int gy, int gz, int axis) const;
+    glm::vec3 latticePosition(glm::vec3 g) const;
+
+    int _samplesPerCell;
+    float _isoValue;
+
+    // padded block lookup, one extra cell on each side of the grid
+    glm::ivec3 _paddedDims = glm::ivec3(0);
+    std::vector<int> _blockSlots;
+    std::vector<Block> _blocks;
+
+    glm::vec3 _origin = glm::vec3(0.0f);
+    float _cellSize = 0.0f;
+    float _voxelSize = 0.0f;
+
+    SurfaceStats _stats;
+};
+
+#endif // SURFACE_RECONSTRUCTOR_H
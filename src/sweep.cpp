@@ -0,0 +1,382 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include "ensemble.h"
+#include "utils/ThreadPool.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct SweepAxis {
+        std::string name;
+        std::vector<double> values;
+    };
+
+    const char *METRICS = "particles,steps,simulated_time,density_error,mean_density_error,max_speed,spread,height,stable,wall_ms";
+    const char *SOLVER_NAMES[] = {"contact", "pcisph", "pbf"};
+
+    bool readVector(const std::string &key, const ConfigValue &value, glm::vec3 &vector, std::string &error) {
+        if (value.type != ConfigValue::ARRAY || value.items.size() != 3) {
+            error = key + " should be an array of 3 numbers";
+            return false;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (value.items[i].type != ConfigValue::NUMBER) {
+                error = key + " should be an array of 3 numbers";
+                return false;
+            }
+            vector[i] = (float) value.items[i].number;
+        }
+        return true;
+    }
+
+    // [values], or { from, to, steps, scale = "linear" | "log" }
+    bool readAxis(const std::string &name, const ConfigValue &value, SweepAxis &axis, std::string &error) {
+        axis.name = name;
+        if (value.type == ConfigValue::ARRAY) {
+            for (const ConfigValue &item : value.items) {
+                if (item.type != ConfigValue::NUMBER) {
+                    error = "the values of " + name + " should be numbers";
+                    return false;
+                }
+                axis.values.push_back(item.number);
+            }
+        } else if (value.type == ConfigValue::TABLE) {
+            const ConfigValue *from = value.field("from");
+            const ConfigValue *to = value.field("to");
+            const ConfigValue *steps = value.field("steps");
+            const ConfigValue *scale = value.field("scale");
+            if (!from || !to || !steps || from->type != ConfigValue::NUMBER || to->type != ConfigValue::NUMBER ||
+                steps->type != ConfigValue::NUMBER || steps->number < 1) {
+                error = "the range of " + name + " needs numbers from, to and steps";
+                return false;
+            }
+            bool logarithmic = scale && scale->type == ConfigValue::STRING && scale->string == "log";
+            if (scale && !logarithmic && (scale->type != ConfigValue::STRING || scale->string != "linear")) {
+                error = "the scale of " + name + " is \"linear\" or \"log\"";
+                return false;
+            }
+            if (logarithmic && (from->number <= 0.0 || to->number <= 0.0)) {
+                error = "a log range of " + name + " has to stay above 0";
+                return false;
+            }
+            int count = (int) steps->number;
+            for (int i = 0; i < count; i++) {
+                double t = count == 1 ? 0.0 : (double) i / (count - 1);
+                axis.values.push_back(logarithmic ? from->number * std::pow(to->number / from->number, t)
+                                                  : from->number + t * (to->number - from->number));
+            }
+        } else {
+            error = name + " should be a list of values or a { from, to, steps } range";
+            return false;
+        }
+        if (axis.values.empty()) {
+            error = name + " has no values";
+            return false;
+        }
+        return true;
+    }
+
+    // As written to the results, the summary groups the jobs by these strings
+    std::string format(double value) {
+        std::ostringstream text;
+        text << value;
+        return text.str();
+    }
+
+    std::vector<std::string> splitFields(const std::string &line) {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ',')) {
+            fields.push_back(field);
+        }
+        return fields;
+    }
+
+    // The parameter values of a results line, as one string
+    std::string valuesKey(const std::vector<std::string> &fields, size_t axisCount) {
+        std::string key;
+        for (size_t a = 0; a < axisCount; a++) {
+            key += (a > 0 ? "," : "") + fields[1 + a];
+        }
+        return key;
+    }
+
+    // Whether every parameter value of a results line is on the axes, lines of values since taken off are left out
+    bool onAxes(const std::vector<std::string> &fields, const std::vector<SweepAxis> &axes) {
+        for (size_t a = 0; a < axes.size(); a++) {
+            const std::vector<double> &values = axes[a].values;
+            if (std::none_of(values.begin(), values.end(), [&](double value) { return format(value) == fields[1 + a]; })) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The values of the jobs already in the results file, existing tells whether it has a header. False if it
+    // belongs to another sweep, one of other axes or of another scene, given by the comment on its first line.
+    bool readFinished(const std::string &path, const std::string &scene, const std::string &header, const std::vector<SweepAxis> &axes,
+                      std::set<std::string> &finished, bool &existing, std::string &error) {
+        std::ifstream file(path);
+        std::string line;
+        existing = file && std::getline(file, line);
+        if (!existing) {
+            return true;
+        }
+        if (line != scene) {
+            error = path + " holds the results of a sweep of another scene, " + line;
+            return false;
+        }
+        if (!std::getline(file, line) || line != header) {
+            error = path + " holds the results of another sweep, its columns are " + line;
+            return false;
+        }
+        size_t columns = splitFields(header).size();
+        while (std::getline(file, line)) {
+            // a line cut short when a run was stopped is run again
+            std::vector<std::string> fields = splitFields(line);
+            if (fields.size() == columns && onAxes(fields, axes)) {
+                finished.insert(valuesKey(fields, axes.size()));
+            }
+        }
+        return true;
+    }
+
+    void printSummary(const std::string &path, const std::vector<SweepAxis> &axes) {
+        std::ifstream file(path);
+        std::string line;
+        // the scene comment, then the columns
+        std::getline(file, line);
+        std::getline(file, line);
+        std::vector<std::string> columns = splitFields(line);
+        auto column = [&](const std::string &name) { return (int) (std::find(columns.begin(), columns.end(), name) - columns.begin()); };
+        int errorColumn = column("mean_density_error");
+        int stableColumn = column("stable");
+        int wallColumn = column("wall_ms");
+
+        struct Totals {
+            int jobs = 0;
+            int stable = 0;
+            double error = 0.0;
+            double wallMs = 0.0;
+        };
+        std::vector<std::vector<Totals>> totals(axes.size());
+        for (size_t a = 0; a < axes.size(); a++) {
+            totals[a].resize(axes[a].values.size());
+        }
+        std::vector<std::string> best;
+        double bestError = 0.0;
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields = splitFields(line);
+            if (fields.size() != columns.size() || !onAxes(fields, axes)) {
+                continue;
+            }
+            double error = std::atof(fields[errorColumn].c_str());
+            bool stable = fields[stableColumn] == "1";
+            for (size_t a = 0; a < axes.size(); a++) {
+                for (size_t v = 0; v < axes[a].values.size(); v++) {
+                    if (format(axes[a].values[v]) == fields[1 + a]) {
+                        Totals &total = totals[a][v];
+                        total.jobs++;
+                        total.stable += stable;
+                        total.error += error;
+                        total.wallMs += std::atof(fields[wallColumn].c_str());
+                    }
+                }
+            }
+            if (stable && (best.empty() || error < bestError)) {
+                best = fields;
+                bestError = error;
+            }
+        }
+
+        char text[160];
+        for (size_t a = 0; a < axes.size(); a++) {
+            std::snprintf(text, sizeof text, "  %-24s %6s %20s %8s %10s\n", axes[a].name.c_str(), "jobs", "mean density error", "stable", "wall ms");
+            std::cout << text;
+            for (size_t v = 0; v < axes[a].values.size(); v++) {
+                const Totals &total = totals[a][v];
+                int jobs = std::max(total.jobs, 1);
+                std::snprintf(text, sizeof text, "  %-24s %6d %20.5f %7.0f%% %10.1f\n", format(axes[a].values[v]).c_str(), total.jobs,
+                              total.error / jobs, 100.0 * total.stable / jobs, total.wallMs / jobs);
+                std::cout << text;
+            }
+        }
+        if (best.empty()) {
+            std::cout << "No job stayed stable" << std::endl;
+            return;
+        }
+        std::cout << "Best stable job " << best[0] << ":";
+        for (size_t a = 0; a < axes.size(); a++) {
+            std::cout << " " << axes[a].name << " = " << best[1 + a];
+        }
+        std::cout << ", mean density error " << bestError << std::endl;
+    }
+}
+
+int runSweep(const HeadlessOptions &options, const ConfigFile &config) {
+    std::vector<SweepAxis> axes;
+    EnsembleScene scene;
+    std::string resultsPath = "sweep.csv";
+    std::string error;
+    std::vector<std::string> names = SPHSolver::parameterNames();
+    for (const auto &entry : config.section("sweep")) {
+        axes.emplace_back();
+        if (std::find(names.begin(), names.end(), entry.first) == names.end()) {
+            error = "unknown solver parameter " + entry.first;
+        } else {
+            readAxis(entry.first, entry.second, axes.back(), error);
+        }
+        if (!error.empty()) {
+            std::cout << "Sweep: " << error << std::endl;
+            return 1;
+        }
+    }
+    for (const auto &entry : config.section("block")) {
+        glm::vec3 *vector = entry.first == "min" ? &scene.min : entry.first == "size" ? &scene.size
+                          : entry.first == "velocity" ? &scene.velocity : nullptr;
+        if (!vector) {
+            error = "unknown block option " + entry.first;
+        } else {
+            readVector(entry.first, entry.second, *vector, error);
+        }
+        if (!error.empty()) {
+            std::cout << "Sweep: " << error << std::endl;
+            return 1;
+        }
+    }
+    for (const auto &entry : config.section("output")) {
+        if (entry.first != "results" || entry.second.type != ConfigValue::STRING) {
+            std::cout << "Sweep: [output] only takes results = \"file.csv\"" << std::endl;
+            return 1;
+        }
+        resultsPath = entry.second.string;
+    }
+    if (axes.empty()) {
+        std::cout << "Sweep: the file has no [sweep] axes" << std::endl;
+        return 1;
+    }
+
+    int jobs = 1;
+    std::string header = "job";
+    for (const SweepAxis &axis : axes) {
+        jobs *= axis.values.size();
+        header += "," + axis.name;
+    }
+    header += ",";
+    header += METRICS;
+    // the fixed part of every job, a results file is only resumed by the same scene
+    std::ostringstream sceneLine;
+    sceneLine << "# block min " << scene.min.x << " " << scene.min.y << " " << scene.min.z << " size " << scene.size.x << " "
+              << scene.size.y << " " << scene.size.z << " velocity " << scene.velocity.x << " " << scene.velocity.y << " "
+              << scene.velocity.z << ", solver " << SOLVER_NAMES[options.solver] << ", frames " << options.frames << ", dt "
+              << options.dt << " min " << options.minDt << " max " << options.maxDt << " cfl " << options.cfl;
+
+    // the values of one job, last axis fastest
+    auto parametersOf = [&](int job) {
+        std::vector<std::pair<std::string, double>> parameters(axes.size());
+        for (size_t a = axes.size(); a > 0; a--) {
+            const SweepAxis &axis = axes[a - 1];
+            parameters[a - 1] = {axis.name, axis.values[job % axis.values.size()]};
+            job /= axis.values.size();
+        }
+        return parameters;
+    };
+
+    // finished jobs are told by their parameter values, the job numbers move when an axis gets other values
+    std::set<std::string> finished;
+    bool resumed = false;
+    if (!readFinished(resultsPath, sceneLine.str(), header, axes, finished, resumed, error)) {
+        std::cout << "Sweep: " << error << std::endl;
+        return 1;
+    }
+    std::vector<int> order;
+    for (int job = 0; job < jobs; job++) {
+        std::string key;
+        for (const auto &parameter : parametersOf(job)) {
+            key += (key.empty() ? "" : ",") + format(parameter.second);
+        }
+        if (!finished.count(key)) {
+            order.push_back(job);
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    EnsembleRunner runner;
+    if (!runner.init(options)) {
+        return 1;
+    }
+    // every value is tried once up front, a sweep shouldn't stop halfway on a value the solver refuses
+    for (const SweepAxis &axis : axes) {
+        for (double value : axis.values) {
+            if (!runner.solver(0).setParameters({{axis.name, value}}, error)) {
+                std::cout << "Sweep: " << error << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    bool cutShort = false;
+    if (resumed) {
+        std::ifstream previous(resultsPath, std::ios::ate);
+        previous.seekg(-1, std::ios::end);
+        cutShort = previous.get() != '\n';
+    }
+    std::ofstream out(resultsPath, std::ios::app);
+    if (!out) {
+        std::cout << "Could not write " << resultsPath << std::endl;
+        return 1;
+    }
+    if (!resumed) {
+        out << sceneLine.str() << "\n" << header << "\n";
+    } else {
+        // the last line was cut short, the next one starts on a line of its own
+        if (cutShort) {
+            out << "\n";
+        }
+        std::cout << "Sweep: " << jobs - order.size() << " of " << jobs << " jobs already in " << resultsPath << std::endl;
+    }
+    out.flush();
+
+    std::mutex outMutex;
+    int done = 0;
+    int reportEvery = std::max((int) order.size() / 10, 1);
+    runner.run(order, [&](SPHSolver &solver, int job) {
+        std::vector<std::pair<std::string, double>> parameters = parametersOf(job);
+        std::string parameterError;
+        solver.setParameters(parameters, parameterError);
+        EnsembleResult result = runEnsembleScene(solver, scene, options);
+
+        std::ostringstream line;
+        line << job;
+        for (const auto &parameter : parameters) {
+            line << "," << format(parameter.second);
+        }
+        line << "," << result.particles << "," << result.steps << "," << result.simulatedTime << "," << result.densityError << ","
+             << result.meanDensityError << "," << result.maxSpeed << "," << result.spread << "," << result.height << ","
+             << result.stable << "," << result.wallMs << "\n";
+        std::lock_guard<std::mutex> lock(outMutex);
+        out << line.str();
+        out.flush();
+        if (++done % reportEvery == 0 || done == (int) order.size()) {
+            std::cout << "Sweep: " << done << " of " << order.size() << " jobs done" << std::endl;
+        }
+    });
+    out.close();
+
+    float seconds = std::chrono::duration<float>(Clock::now() - start).count();
+    std::cout << "Sweep of " << jobs << " jobs on " << ThreadPool::instance().size() << " threads: " << order.size() << " run in "
+              << seconds << " s, results in " << resultsPath << std::endl;
+    printSummary(resultsPath, axes);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "headless.h"
+#include "utils/ConfigFile.h"
+
+// Parameter sweeps (--sweep file.toml). Besides the [scene] and [parameters] of a scene file, already read into
+// options, the file has
+//   [sweep]   one axis per solver parameter, a list of values or a range: viscosityConstant = [0.01, 0.02]
+//             or restDensity = { from = 500, to = 2000, steps = 4, scale = "log" }
+//   [block]   the fluid dropped into the tank, min, size and velocity as [x, y, z]
+//   [output]  results = "sweep.csv"
+// Every combination of the axis values is one job, the last axis changing fastest. The jobs run like the members
+// of an ensemble, one per pool thread at a time, each taking options.frames steps. Every finished job is
+// appended to the results file at once, and a sweep started again with the same file only runs the jobs whose
+// values aren't in it yet. The file starts with a comment giving the block, solver, frames and dt, a sweep of
+// another scene refuses it. At the end the metrics of the jobs on the axes are averaged per axis value.
+int runSweep(const HeadlessOptions &options, const ConfigFile &config);
+
+#endif // SWEEP_H
@@ -0,0 +1,61 @@
+#include "timestepController.h"
+#include "utils/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+TimestepController::TimestepController(float minDt, float maxDt, float cfl, float forceFactor) :
+        _minDt(minDt),
+        _maxDt(maxDt),
+        _cfl(cfl),
+        _forceFactor(forceFactor) {}
+
+float TimestepController::computeTimestep(const std::vector<Particle> &particles, float smoothingLength) {
+    float maxSpeed2 = 0.0f;
+    float maxAcceleration2 = 0.0f;
+    std::mutex mutex;
+    ThreadPool::instance().parallelFor(0, particles.size(), [&](int begin, int end) {
+        float speed2 = 0.0f;
+        float acceleration2 = 0.0f;
+        for (int i = begin; i < end; i++) {
+            speed2 = std::max(speed2, glm::dot(particles[i].velocity, particles[i].velocity));
+            acceleration2 = std::max(acceleration2, glm::dot(particles[i].acceleration, particles[i].acceleration));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        maxSpeed2 = std::max(maxSpeed2, speed2);
+        maxAcceleration2 = std::max(maxAcceleration2, acceleration2);
+    }, 4096);
+
+    float maxSpeed = std::sqrt(maxSpeed2);
+    float maxAcceleration = std::sqrt(maxAcceleration2);
+    if (_reduction) {
+        _reduction(maxSpeed, maxAcceleration);
+    }
+    float dt = _maxDt;
+    if (maxSpeed > 0.0f) {
+        dt = std::min(dt, _cfl * smoothingLength / maxSpeed);
+    }
+    if (maxAcceleration > 0.0f) {
+        dt = std::min(dt, _forceFactor * std::sqrt(smoothingLength / maxAcceleration));
+    }
+    if (_lastDt > 0.0f) {
+        dt = std::min(dt, _lastDt * _maxGrowth);
+    }
+    dt = std::clamp(dt, _minDt, _maxDt);
+
+    _lastDt = dt;
+    _last = {_time, dt, maxSpeed, maxAcceleration};
+    if (_log) {
+        *_log << _last.time << "," << _last.dt << "," << _last.maxSpeed << "," << _last.maxAcceleration << "\n";
+    }
+    _time += dt;
+    return dt;
+}
+
+void TimestepController::setLog(std::ostream *out) {
+    _log = out;
+    if (_log) {
+        *_log << "time,dt,max_speed,max_acceleration\n";
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef TIMESTEP_CONTROLLER_H
+#define TIMESTEP_CONTROLLER_H
+
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "Particle.h"
+
+struct TimestepSample {
+    float time;
+    float dt;
+    float maxSpeed;
+    float maxAcceleration;
+};
+
+// Picks every step's dt from the CFL condition (dt <= cfl * h / vmax) and the force condition
+// (dt <= forceFactor * sqrt(h / amax)), clamped to [minDt, maxDt]. Growth is limited per step so
+// dt doesn't jump back to maxDt the step after a splash.
+class TimestepController {
+public:
+    TimestepController(float minDt = 0.0005f, float maxDt = 0.02f, float cfl = 0.4f, float forceFactor = 0.25f);
+
+    // Reduces the max speed and acceleration over the particles in parallel and returns the next dt
+    float computeTimestep(const std::vector<Particle> &particles, float smoothingLength);
+
+    void setBounds(float minDt, float maxDt) { _minDt = minDt; _maxDt = maxDt; }
+    float getMinDt() const { return _minDt; }
+    // Called with the local max speed and acceleration before dt is picked, a distributed run replaces them
+    // with the maxima over all ranks so every rank takes the same dt
+    void setReduction(std::function<void(float &maxSpeed, float &maxAcceleration)> reduction) { _reduction = reduction; }
+    void setCfl(float cfl) { _cfl = cfl; }
+
+    // Writes the dt series as CSV (time, dt, max speed, max acceleration) to out as the steps are taken, nothing
+    // is kept in memory, so hours of steps don't grow the process. The caller keeps out open.
+    void setLog(std::ostream *out);
+    const TimestepSample &getLastSample() const { return _last; }
+    float getTime() const { return _time; }
+
+private:
+    float _minDt;
+    float _maxDt;
+    float _cfl;
+    float _forceFactor;
+    float _maxGrowth = 1.2f;
+    float _lastDt = 0.0f;
+    float _time = 0.0f;
+    TimestepSample _last = {0.0f, 0.0f, 0.0f, 0.0f};
+    std::ostream *_log = nullptr;
+    std::function<void(float &, float &)> _reduction;
+};
+
+#endif // TIMESTEP_CONTROLLER_H
@@ -0,0 +1,67 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<unsigned long long> allocations(0);
+    thread_local bool ignored = false;
+
+    void *allocate(std::size_t size) {
+        if (!ignored) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        void *data = std::malloc(size == 0 ? 1 : size);
+        if (!data) {
+            throw std::bad_alloc();
+        }
+        return data;
+    }
+
+    void *allocateAligned(std::size_t size, std::align_val_t alignment) {
+        if (!ignored) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::size_t align = static_cast<std::size_t>(alignment);
+        // aligned_alloc wants a multiple of the alignment
+        void *data = std::aligned_alloc(align, (size + align - 1) / align * align);
+        if (!data) {
+            throw std::bad_alloc();
+        }
+        return data;
+    }
+}
+
+unsigned long long AllocationCounter::count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::ignoreThisThread() {
+    ignored = true;
+}
+
+// the array and nothrow forms of the standard library call these
+void *operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void *data) noexcept {
+    std::free(data);
+}
+
+void operator delete(void *data, std::size_t) noexcept {
+    std::free(data);
+}
+
+void operator delete(void *data, std::align_val_t) noexcept {
+    std::free(data);
+}
+
+void operator delete(void *data, std::size_t, std::align_val_t) noexcept {
+    std::free(data);
+}
@@ -0,0 +1,13 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+// Counts the calls to the global operator new, which every std container of the solver goes through, to check
+// that stepping doesn't allocate once it is warmed up. The count is process wide and costs one relaxed atomic
+// increment per allocation.
+namespace AllocationCounter {
+    unsigned long long count();
+    // Leaves the calling thread's allocations out of the count, for threads that run alongside the solver
+    void ignoreThisThread();
+}
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,68 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace {
+    char *alignUp(char *pointer, size_t alignment) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+        return pointer + (alignment - address % alignment) % alignment;
+    }
+}
+
+Arena::Arena(size_t capacity) : _capacity(capacity) {
+    if (_capacity > 0) {
+        _block = static_cast<char *>(::operator new(_capacity));
+    }
+}
+
+Arena::~Arena() {
+    freeOverflow();
+    ::operator delete(_block);
+}
+
+void Arena::freeOverflow() {
+    while (_overflow) {
+        Overflow *next = _overflow->next;
+        ::operator delete(_overflow);
+        _overflow = next;
+    }
+    _overflowNext = nullptr;
+    _overflowEnd = nullptr;
+}
+
+void Arena::reset() {
+    _peak = std::max(_peak, _used + _overflowUsed);
+    if (_overflow) {
+        freeOverflow();
+        // room for everything the last round needed, with some slack for it to grow
+        ::operator delete(_block);
+        _capacity = _peak + _peak / 2;
+        _block = static_cast<char *>(::operator new(_capacity));
+    }
+    _used = 0;
+    _overflowUsed = 0;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+    char *start = alignUp(_block + _used, alignment);
+    if (_block && start + bytes <= _block + _capacity) {
+        _used = start + bytes - _block;
+        return start;
+    }
+    start = alignUp(_overflowNext, alignment);
+    if (!_overflowNext || start + bytes > _overflowEnd) {
+        // each extra block at least twice the size of everything before it, a growing vector chains only a few
+        size_t size = sizeof(Overflow) + alignment + std::max(bytes, 2 * (_capacity + _overflowUsed) + 4096);
+        Overflow *overflow = static_cast<Overflow *>(::operator new(size));
+        overflow->next = _overflow;
+        _overflow = overflow;
+        _overflowNext = reinterpret_cast<char *>(overflow + 1);
+        _overflowEnd = reinterpret_cast<char *>(overflow) + size;
+        start = alignUp(_overflowNext, alignment);
+    }
+    _overflowNext = start + bytes;
+    _overflowUsed += bytes;
+    return start;
+}
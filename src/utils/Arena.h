@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// Bump allocator for data that only lives until the next reset(), e.g. one step. An allocation moves a pointer
+// forward in the current block and deallocation does nothing. A step that needs more than the block gets extra
+// blocks chained to it, and the next reset() swaps them all for one block big enough, so once the scratch
+// data has reached its size nothing is allocated any more. Not thread safe, every thread uses an arena of its own.
+class Arena : public std::pmr::memory_resource {
+public:
+    explicit Arena(size_t capacity = 0);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // Frees everything allocated since the last reset, the containers using the arena must be gone or cleared
+    void reset();
+    size_t capacity() const { return _capacity; }
+    // Most bytes in use at once, over every reset so far
+    size_t getPeak() const { return _peak; }
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+    struct Overflow {
+        Overflow *next;
+    };
+
+    void freeOverflow();
+
+    char *_block = nullptr;
+    size_t _capacity = 0;
+    size_t _used = 0;
+    Overflow *_overflow = nullptr;      // extra blocks since the last reset, newest first
+    char *_overflowNext = nullptr;      // free part of the newest one
+    char *_overflowEnd = nullptr;
+    size_t _overflowUsed = 0;           // bytes handed out from them
+    size_t _peak = 0;
+};
+
+#endif // ARENA_H
@@ -0,0 +1,270 @@
+#include "ConfigFile.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    // Recursive descent over one value, pos is left after it
+    class ValueParser {
+    public:
+        ValueParser(const std::string &text, size_t pos) : _text(text), _pos(pos) {}
+
+        bool parse(ConfigValue &value, std::string &error) {
+            skipSpaces();
+            if (_pos >= _text.size()) {
+                error = "missing value";
+                return false;
+            }
+            char c = _text[_pos];
+            if (c == '"') {
+                return parseString(value, error);
+            }
+            if (c == '[') {
+                return parseArray(value, error);
+            }
+            if (c == '{') {
+                return parseTable(value, error);
+            }
+            if (_text.compare(_pos, 4, "true") == 0 || _text.compare(_pos, 5, "false") == 0) {
+                value.type = ConfigValue::BOOLEAN;
+                value.boolean = c == 't';
+                _pos += value.boolean ? 4 : 5;
+                return true;
+            }
+            const char *begin = _text.c_str() + _pos;
+            char *end = nullptr;
+            value.type = ConfigValue::NUMBER;
+            value.number = std::strtod(begin, &end);
+            if (end == begin) {
+                error = "unexpected '" + std::string(1, c) + "'";
+                return false;
+            }
+            _pos += end - begin;
+            return true;
+        }
+
+        void skipSpaces() {
+            while (_pos < _text.size() && (_text[_pos] == ' ' || _text[_pos] == '\t')) {
+                _pos++;
+            }
+        }
+
+        size_t position() const { return _pos; }
+
+    private:
+        bool parseString(ConfigValue &value, std::string &error) {
+            value.type = ConfigValue::STRING;
+            for (_pos++; _pos < _text.size() && _text[_pos] != '"'; _pos++) {
+                if (_text[_pos] == '\\' && _pos + 1 < _text.size()) {
+                    char escaped = _text[++_pos];
+                    value.string += escaped == 'n' ? '\n' : escaped == 't' ? '\t' : escaped;
+                } else {
+                    value.string += _text[_pos];
+                }
+            }
+            if (_pos >= _text.size()) {
+                error = "unterminated string";
+                return false;
+            }
+            _pos++;
+            return true;
+        }
+
+        bool parseArray(ConfigValue &value, std::string &error) {
+            value.type = ConfigValue::ARRAY;
+            _pos++;
+            while (true) {
+                skipSpaces();
+                if (_pos < _text.size() && _text[_pos] == ']') {
+                    _pos++;
+                    return true;
+                }
+                ConfigValue item;
+                if (!parse(item, error)) {
+                    return false;
+                }
+                value.items.push_back(item);
+                skipSpaces();
+                if (_pos < _text.size() && _text[_pos] == ',') {
+                    _pos++;
+                } else if (_pos >= _text.size() || _text[_pos] != ']') {
+                    error = "expected ',' or ']' in array";
+                    return false;
+                }
+            }
+        }
+
+        bool parseTable(ConfigValue &value, std::string &error) {
+            value.type = ConfigValue::TABLE;
+            _pos++;
+            while (true) {
+                skipSpaces();
+                if (_pos < _text.size() && _text[_pos] == '}') {
+                    _pos++;
+                    return true;
+                }
+                size_t keyStart = _pos;
+                while (_pos < _text.size() && (std::isalnum((unsigned char) _text[_pos]) || _text[_pos] == '_' || _text[_pos] == '-')) {
+                    _pos++;
+                }
+                std::string key = _text.substr(keyStart, _pos - keyStart);
+                skipSpaces();
+                if (key.empty() || _pos >= _text.size() || _text[_pos] != '=') {
+                    error = "expected key = value in inline table";
+                    return false;
+                }
+                _pos++;
+                ConfigValue field;
+                if (!parse(field, error)) {
+                    return false;
+                }
+                value.fields.emplace_back(key, field);
+                skipSpaces();
+                if (_pos < _text.size() && _text[_pos] == ',') {
+                    _pos++;
+                } else if (_pos >= _text.size() || _text[_pos] != '}') {
+                    error = "expected ',' or '}' in inline table";
+                    return false;
+                }
+            }
+        }
+
+        const std::string &_text;
+        size_t _pos;
+    };
+
+    // Drops a # comment, unless it's inside a string
+    std::string stripComment(const std::string &line) {
+        bool inString = false;
+        for (size_t i = 0; i < line.size(); i++) {
+            if (line[i] == '"' && (i == 0 || line[i - 1] != '\\')) {
+                inString = !inString;
+            } else if (line[i] == '#' && !inString) {
+                return line.substr(0, i);
+            }
+        }
+        return line;
+    }
+
+    std::string trim(const std::string &text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        size_t end = text.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+    }
+}
+
+const ConfigValue *ConfigValue::field(const std::string &key) const {
+    for (const auto &entry : fields) {
+        if (entry.first == key) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+const char *ConfigValue::typeName() const {
+    switch (type) {
+    case STRING:
+        return "string";
+    case BOOLEAN:
+        return "boolean";
+    case ARRAY:
+        return "array";
+    case TABLE:
+        return "table";
+    default:
+        return "number";
+    }
+}
+
+bool ConfigFile::load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        _error = "could not read " + path;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    _path = path;
+    return parse(text.str());
+}
+
+bool ConfigFile::parse(const std::string &text) {
+    _sections.clear();
+    _sections.emplace_back("", Section());
+    std::istringstream lines(text);
+    std::string line;
+    int lineNumber = 0;
+    std::string where = _path.empty() ? "line " : _path + ":";
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        // an array or inline table may continue over several lines, up to the bracket that closes it
+        std::string statement = stripComment(line);
+        int depth = 0;
+        for (char c : statement) {
+            depth += (c == '[' || c == '{') - (c == ']' || c == '}');
+        }
+        bool header = trim(statement).rfind("[", 0) == 0;
+        while (!header && depth > 0 && std::getline(lines, line)) {
+            lineNumber++;
+            std::string more = stripComment(line);
+            for (char c : more) {
+                depth += (c == '[' || c == '{') - (c == ']' || c == '}');
+            }
+            statement += " " + more;
+        }
+        statement = trim(statement);
+        if (statement.empty()) {
+            continue;
+        }
+        if (header) {
+            if (statement.back() != ']' || statement.size() < 3) {
+                _error = where + std::to_string(lineNumber) + ": bad section header";
+                return false;
+            }
+            _sections.emplace_back(trim(statement.substr(1, statement.size() - 2)), Section());
+            continue;
+        }
+        size_t equals = statement.find('=');
+        if (equals == std::string::npos || trim(statement.substr(0, equals)).empty()) {
+            _error = where + std::to_string(lineNumber) + ": expected key = value";
+            return false;
+        }
+        std::string key = trim(statement.substr(0, equals));
+        ValueParser parser(statement, equals + 1);
+        ConfigValue value;
+        std::string error;
+        if (!parser.parse(value, error)) {
+            _error = where + std::to_string(lineNumber) + ": " + error;
+            return false;
+        }
+        parser.skipSpaces();
+        if (parser.position() != statement.size()) {
+            _error = where + std::to_string(lineNumber) + ": unexpected text after the value of " + key;
+            return false;
+        }
+        _sections.back().second.emplace_back(key, value);
+    }
+    return true;
+}
+
+bool ConfigFile::hasSection(const std::string &name) const {
+    for (const auto &section : _sections) {
+        if (section.first == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const ConfigFile::Section &ConfigFile::section(const std::string &name) const {
+    static const Section empty;
+    for (const auto &section : _sections) {
+        if (section.first == name) {
+            return section.second;
+        }
+    }
+    return empty;
+}
@@ -0,0 +1,50 @@
+#ifndef CONFIG_FILE_H
+#define CONFIG_FILE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ConfigValue {
+    enum Type {
+        NUMBER,
+        STRING,
+        BOOLEAN,
+        ARRAY,
+        TABLE       // inline table, { key = value, ... }
+    };
+
+    Type type = NUMBER;
+    double number = 0.0;
+    std::string string;
+    bool boolean = false;
+    std::vector<ConfigValue> items;
+    std::vector<std::pair<std::string, ConfigValue>> fields;
+
+    const ConfigValue *field(const std::string &key) const;
+    // "number", "string", ... for error messages
+    const char *typeName() const;
+};
+
+// The subset of TOML the scene, parameter and sweep files use: [section] headers, key = value lines with numbers,
+// "strings", booleans, [arrays] and { inline = tables }, and # comments. Keys keep the order of the file.
+class ConfigFile {
+public:
+    using Section = std::vector<std::pair<std::string, ConfigValue>>;
+
+    // False if the file can't be read or isn't valid, getError() says where
+    bool load(const std::string &path);
+    bool parse(const std::string &text);
+    const std::string &getError() const { return _error; }
+
+    bool hasSection(const std::string &name) const;
+    // Empty for a section the file doesn't have; keys before the first header are in section ""
+    const Section &section(const std::string &name) const;
+
+private:
+    std::vector<std::pair<std::string, Section>> _sections;
+    std::string _path;
+    std::string _error;
+};
+
+#endif // CONFIG_FILE_H
@@ -0,0 +1,253 @@
+#include "FrameRecorder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "AllocationCounter.h"
+#include "util.h"
+
+namespace {
+
+// max frames waiting for the writer before endFrame blocks
+const size_t MAX_QUEUED_FRAMES = 8;
+
+unsigned int crc32(const unsigned char *data, size_t length, unsigned int crc = 0) {
+    static const std::array<unsigned int, 256> table = [] {
+        std::array<unsigned int, 256> t;
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void appendBigEndian(std::vector<unsigned char> &out, unsigned int value) {
+    out.push_back((value >> 24) & 0xFF);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+void appendChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data) {
+    appendBigEndian(out, (unsigned int) data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(out.data() + start, out.size() - start));
+}
+
+// RGB scanlines top to bottom, wrapped in a zlib stream of stored blocks: no compression
+// library needed and the writer thread never becomes the bottleneck.
+std::vector<unsigned char> encodePng(const std::vector<unsigned char> &rgb, int width, int height) {
+    std::vector<unsigned char> scanlines;
+    scanlines.reserve((size_t) (width * 3 + 1) * height);
+    for (int y = 0; y < height; y++) {
+        scanlines.push_back(0);
+        const unsigned char *row = rgb.data() + (size_t) y * width * 3;
+        scanlines.insert(scanlines.end(), row, row + width * 3);
+    }
+
+    std::vector<unsigned char> zlib = {0x78, 0x01};
+    size_t offset = 0;
+    do {
+        size_t blockSize = std::min<size_t>(65535, scanlines.size() - offset);
+        bool last = offset + blockSize == scanlines.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(blockSize & 0xFF);
+        zlib.push_back((blockSize >> 8) & 0xFF);
+        zlib.push_back(~blockSize & 0xFF);
+        zlib.push_back((~blockSize >> 8) & 0xFF);
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < scanlines.size());
+
+    unsigned int a = 1, b = 0;
+    for (unsigned char byte : scanlines) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, no interlacing
+
+    std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", zlib);
+    appendChunk(png, "IEND", {});
+    return png;
+}
+
+}
+
+FrameRecorder::FrameRecorder(int width, int height, const std::string &outputPath, FrameFormat format, int ringSize) :
+    _width(width),
+    _height(height),
+    _outputPath(outputPath),
+    _format(format) {
+    std::filesystem::create_directories(outputPath);
+    if (format == FRAME_RAW) {
+        _raw.open(outputPath + "/frames.rgb", std::ios::binary);
+        if (!_raw) {
+            exitOnCriticalError("Cannot open " + outputPath + "/frames.rgb", "FrameRecorder");
+        }
+    }
+
+    _target.create(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, true);
+
+    ringSize = std::max(ringSize, 1);
+    _pbos.resize(ringSize);
+    _fences.assign(ringSize, nullptr);
+    _slotFrame.assign(ringSize, -1);
+    glGenBuffers(ringSize, _pbos.data());
+    for (GLuint pbo : _pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) width * height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _writer = std::thread(&FrameRecorder::writerLoop, this);
+}
+
+void FrameRecorder::beginFrame() {
+    _target.bind();
+    glViewport(0, 0, _width, _height);
+}
+
+void FrameRecorder::endFrame() {
+    // the slot about to be reused holds the oldest frame, hand it over first
+    if (_inFlight == (int) _pbos.size()) {
+        collect(_head);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[_head]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _fences[_head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _slotFrame[_head] = _frameCount++;
+    _head = (_head + 1) % _pbos.size();
+    _inFlight++;
+    _target.unbind();
+}
+
+void FrameRecorder::collect(int slot) {
+    glClientWaitSync(_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(_fences[slot]);
+    _fences[slot] = nullptr;
+
+    PendingFrame frame;
+    frame.index = _slotFrame[slot];
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _queueChanged.wait(lock, [&] { return _queue.size() < MAX_QUEUED_FRAMES; });
+        if (!_freeBuffers.empty()) {
+            frame.pixels = std::move(_freeBuffers.back());
+            _freeBuffers.pop_back();
+        }
+    }
+    frame.pixels.resize((size_t) _width * _height * 4);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[slot]);
+    void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.pixels.size(), GL_MAP_READ_BIT);
+    if (mapped != nullptr) {
+        std::memcpy(frame.pixels.data(), mapped, frame.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _inFlight--;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(frame));
+    }
+    _queueChanged.notify_all();
+}
+
+void FrameRecorder::finish() {
+    if (_finished) {
+        return;
+    }
+    _finished = true;
+    while (_inFlight > 0) {
+        collect((_head - _inFlight + (int) _pbos.size()) % _pbos.size());
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopWriter = true;
+    }
+    _queueChanged.notify_all();
+    _writer.join();
+    _raw.close();
+}
+
+void FrameRecorder::writerLoop() {
+    // encoding a frame overlaps the next step, which is expected not to allocate
+    AllocationCounter::ignoreThisThread();
+    while (true) {
+        PendingFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _queueChanged.wait(lock, [&] { return _stopWriter || !_queue.empty(); });
+            if (_queue.empty()) {
+                return;
+            }
+            frame = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        _queueChanged.notify_all();
+
+        writeFrame(frame);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _freeBuffers.push_back(std::move(frame.pixels));
+    }
+}
+
+void FrameRecorder::writeFrame(const PendingFrame &frame) {
+    // GL rows start at the bottom, files expect the top row first
+    std::vector<unsigned char> rgb((size_t) _width * _height * 3);
+    for (int y = 0; y < _height; y++) {
+        const unsigned char *src = frame.pixels.data() + (size_t) (_height - 1 - y) * _width * 4;
+        unsigned char *dst = rgb.data() + (size_t) y * _width * 3;
+        for (int x = 0; x < _width; x++) {
+            dst[x * 3] = src[x * 4];
+            dst[x * 3 + 1] = src[x * 4 + 1];
+            dst[x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+
+    if (_format == FRAME_RAW) {
+        _raw.write((const char *) rgb.data(), rgb.size());
+        return;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%05d.png", frame.index);
+    std::ofstream out(_outputPath + name, std::ios::binary);
+    if (!out) {
+        exitOnCriticalError("Cannot write " + _outputPath + name, "FrameRecorder::writeFrame");
+        return;
+    }
+    std::vector<unsigned char> png = encodePng(rgb, _width, _height);
+    out.write((const char *) png.data(), png.size());
+}
+
+FrameRecorder::~FrameRecorder() {
+    finish();
+    glDeleteBuffers((GLsizei) _pbos.size(), _pbos.data());
+}
@@ -0,0 +1,77 @@
+#ifndef FRAME_RECORDER_H
+#define FRAME_RECORDER_H
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer/FBO.h"
+
+enum FrameFormat {
+    FRAME_PNG,  // one frame_<n>.png per frame
+    FRAME_RAW   // every frame appended to frames.rgb (ffmpeg -f rawvideo -pix_fmt rgb24)
+};
+
+// Renders frames into an offscreen framebuffer and saves them to disk.
+// Readback goes through a ring of pixel buffer objects: the pixels of frame N are only mapped once
+// frame N + ringSize - 1 has been submitted, so the copy overlaps with rendering. Encoding and file
+// writes happen on a worker thread.
+class FrameRecorder {
+public:
+    FrameRecorder(int width, int height, const std::string &outputPath, FrameFormat format, int ringSize = 3);
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    // Binds the offscreen framebuffer, everything drawn until endFrame is recorded
+    void beginFrame();
+    void endFrame();
+
+    // Reads back the frames still in flight and waits for the writer
+    void finish();
+
+    int getWidth() const { return _width; }
+    int getHeight() const { return _height; }
+    int getFrameCount() const { return _frameCount; }
+
+private:
+    struct PendingFrame {
+        int index;
+        std::vector<unsigned char> pixels;
+    };
+
+    void collect(int slot);
+    void writerLoop();
+    void writeFrame(const PendingFrame &frame);
+
+    int _width;
+    int _height;
+    std::string _outputPath;
+    FrameFormat _format;
+
+    FBO _target;
+    std::vector<GLuint> _pbos;
+    std::vector<GLsync> _fences;
+    std::vector<int> _slotFrame;
+    int _head = 0;
+    int _inFlight = 0;
+    int _frameCount = 0;
+    bool _finished = false;
+
+    std::thread _writer;
+    std::mutex _mutex;
+    std::condition_variable _queueChanged;
+    std::deque<PendingFrame> _queue;
+    std::vector<std::vector<unsigned char>> _freeBuffers;
+    bool _stopWriter = false;
+    std::ofstream _raw;
+};
+
+#endif // FRAME_RECORDER_H
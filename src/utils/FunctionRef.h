@@ -0,0 +1,30 @@
+#ifndef FUNCTION_REF_H
+#define FUNCTION_REF_H
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class FunctionRef;
+
+// Non-owning reference to a callable, for functions that only call it before they return. Unlike std::function
+// it never allocates, whatever the lambda captures, so the callable has to outlive it.
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+public:
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, FunctionRef>::value>>
+    FunctionRef(F &&f) :
+        _callable((void *) std::addressof(f)),
+        _call([](void *callable, Args... args) -> R {
+            return (*static_cast<std::remove_reference_t<F> *>(callable))(std::forward<Args>(args)...);
+        }) {}
+
+    R operator()(Args... args) const { return _call(_callable, std::forward<Args>(args)...); }
+
+private:
+    void *_callable;
+    R (*_call)(void *, Args...);
+};
+
+#endif // FUNCTION_REF_H
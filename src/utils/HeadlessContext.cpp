@@ -0,0 +1,78 @@
+#include "HeadlessContext.h"
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <iostream>
+
+#include "util.h"
+
+HeadlessContext::HeadlessContext() {}
+
+bool HeadlessContext::init(int majorVersion, int minorVersion) {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        exitOnCriticalError("Failed to initialize EGL", "HeadlessContext::init");
+        return false;
+    }
+    _display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        exitOnCriticalError("EGL does not support desktop OpenGL", "HeadlessContext::init");
+        return false;
+    }
+
+    // no surface is ever created, a config is only needed by drivers without EGL_KHR_no_config_context
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+        EGL_CONTEXT_MINOR_VERSION, minorVersion,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, configCount > 0 ? config : nullptr, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+        exitOnCriticalError("Failed to create EGL context", "HeadlessContext::init");
+        return false;
+    }
+    _context = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        exitOnCriticalError("Failed to make the EGL context current (surfaceless contexts unsupported?)", "HeadlessContext::init");
+        return false;
+    }
+    if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+        exitOnCriticalError("Failed to initialize GLAD", "HeadlessContext::init");
+        return false;
+    }
+    std::cout << "Headless OpenGL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER) << std::endl;
+    return true;
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (_display == nullptr) {
+        return;
+    }
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (_context != nullptr) {
+        eglDestroyContext(_display, _context);
+    }
+    eglTerminate(_display);
+}
@@ -0,0 +1,23 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+// OpenGL context without any window or display server, for render farms.
+// Uses EGL on the Mesa surfaceless platform when available (works with llvmpipe on CPU-only
+// machines), otherwise the default EGL display. Rendering has to go to a framebuffer object.
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    // Creates the context, makes it current and loads the GL functions
+    bool init(int majorVersion = 3, int minorVersion = 3);
+
+private:
+    void *_display = nullptr;
+    void *_context = nullptr;
+};
+
+#endif // HEADLESS_CONTEXT_H
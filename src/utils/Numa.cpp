@@ -0,0 +1,127 @@
+#include "Numa.h"
+
+#ifdef FLUID_NUMA
+#include <algorithm>
+#include <cstdint>
+
+#include <numa.h>
+#include <numaif.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace {
+    const size_t bitsPerLong = 8 * sizeof(unsigned long);
+
+    // the CPUs the process started with, kept before any thread is pinned
+    const cpu_set_t &processCpus() {
+        static cpu_set_t cpus = [] {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            sched_getaffinity(0, sizeof set, &set);
+            return set;
+        }();
+        return cpus;
+    }
+
+    void bind(const void *data, size_t bytes, int mode, const std::vector<unsigned long> &mask) {
+        if (!Numa::available()) {
+            return;
+        }
+        // mbind works on whole pages, the ones straddling the ends are left where they are
+        uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+        uintptr_t begin = ((uintptr_t) data + page - 1) / page * page;
+        uintptr_t end = ((uintptr_t) data + bytes) / page * page;
+        if (end <= begin) {
+            return;
+        }
+        // the kernel reads one bit less than maxnode, like libnuma the mask size is passed plus one
+        mbind((void *) begin, end - begin, mode, mask.data(), mask.size() * bitsPerLong + 1, MPOL_MF_MOVE);
+    }
+
+    std::vector<unsigned long> emptyMask() {
+        return std::vector<unsigned long>(Numa::nodeCount() / bitsPerLong + 1, 0);
+    }
+}
+
+bool Numa::available() {
+    static bool available = numa_available() != -1;
+    return available;
+}
+
+int Numa::nodeCount() {
+    return available() ? numa_max_node() + 1 : 1;
+}
+
+int Numa::nodeOfCpu(int cpu) {
+    return available() ? std::max(numa_node_of_cpu(cpu), 0) : 0;
+}
+
+std::vector<int> Numa::cpusByNode() {
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &processCpus())) {
+            cpus.push_back(cpu);
+        }
+    }
+    std::stable_sort(cpus.begin(), cpus.end(), [](int a, int b) { return nodeOfCpu(a) < nodeOfCpu(b); });
+    return cpus;
+}
+
+bool Numa::pinCurrentThread(int cpu) {
+    processCpus();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0;
+}
+
+void Numa::unpinCurrentThread() {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &processCpus());
+}
+
+void Numa::bindToNode(const void *data, size_t bytes, int node) {
+    std::vector<unsigned long> mask = emptyMask();
+    mask[node / bitsPerLong] |= 1ul << (node % bitsPerLong);
+    bind(data, bytes, MPOL_BIND, mask);
+}
+
+void Numa::interleave(const void *data, size_t bytes) {
+    std::vector<unsigned long> mask = emptyMask();
+    for (int node = 0; node < nodeCount(); node++) {
+        if (numa_bitmask_isbitset(numa_all_nodes_ptr, node)) {
+            mask[node / bitsPerLong] |= 1ul << (node % bitsPerLong);
+        }
+    }
+    bind(data, bytes, MPOL_INTERLEAVE, mask);
+}
+
+#else
+
+bool Numa::available() {
+    return false;
+}
+
+int Numa::nodeCount() {
+    return 1;
+}
+
+int Numa::nodeOfCpu(int) {
+    return 0;
+}
+
+std::vector<int> Numa::cpusByNode() {
+    return {};
+}
+
+bool Numa::pinCurrentThread(int) {
+    return false;
+}
+
+void Numa::unpinCurrentThread() {}
+
+void Numa::bindToNode(const void *, size_t, int) {}
+
+void Numa::interleave(const void *, size_t) {}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+#include <vector>
+
+// Thin layer over libnuma and mbind. Built without libnuma (FLUID_NUMA unset) nothing is available and the
+// placement calls do nothing.
+namespace Numa {
+    // False without libnuma or on a kernel without NUMA support
+    bool available();
+    int nodeCount();
+    int nodeOfCpu(int cpu);
+    // The CPUs this process may run on, node 0's first, so consecutive threads pinned in this order share a node
+    std::vector<int> cpusByNode();
+    // Pins the calling thread to one CPU
+    bool pinCurrentThread(int cpu);
+    // Lets the calling thread run anywhere again
+    void unpinCurrentThread();
+
+    // Puts the whole pages inside [data, data + bytes) on node. Pages already touched are moved, the ones not
+    // touched yet are allocated there on first touch.
+    void bindToNode(const void *data, size_t bytes, int node);
+    // Spreads the whole pages inside [data, data + bytes) round-robin over every node
+    void interleave(const void *data, size_t bytes);
+}
+
+#endif // NUMA_H
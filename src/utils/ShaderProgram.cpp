@@ -6,9 +6,20 @@
 
 #include <exception>
 #include <ios>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <iterator>
+#include <vector>
 
 #include "util.h"
 
+std::string ShaderProgram::_binaryCacheDirectory = "shader_cache";
+int ShaderProgram::_coldLoads = 0;
+int ShaderProgram::_warmLoads = 0;
+float ShaderProgram::_coldMs = 0.0f;
+float ShaderProgram::_warmMs = 0.0f;
+
 // Create a GPU program i.e., a graphics pipeline
 ShaderProgram::ShaderProgram() : _id(glCreateProgram()) {}
 
@@ -50,24 +61,41 @@ void ShaderProgram::loadShader(GLenum type, const char *shaderSource) {
 std::shared_ptr<ShaderProgram> ShaderProgram::genBasicShaderProgram(
   const std::string &vertexShaderFilename,
   const std::string &fragmentShaderFilename) {
-  std::shared_ptr<ShaderProgram> shaderProgramPtr = std::make_shared<ShaderProgram>();
-  shaderProgramPtr->loadShaderFromFile(GL_VERTEX_SHADER, vertexShaderFilename);
-  shaderProgramPtr->loadShaderFromFile(GL_FRAGMENT_SHADER, fragmentShaderFilename);
-  shaderProgramPtr->link();
-  GLint success;
-  glGetProgramiv(shaderProgramPtr->getId(), GL_LINK_STATUS, &success);
-  if (!success) {
-    GLchar infoLog[512];
-    glGetProgramInfoLog(shaderProgramPtr->getId(), 512, NULL, infoLog);
-    exitOnCriticalError("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" + std::string(infoLog), "genBasicShaderProgram");
-  }
-  return shaderProgramPtr;
+  return genBasicShaderProgramFromSource(file2String(vertexShaderFilename), file2String(fragmentShaderFilename));
 }
 
 std::shared_ptr<ShaderProgram> ShaderProgram::genBasicShaderProgramFromSource(
   const std::string &vertexShaderSource,
   const std::string &fragmentShaderSource) {
+  auto start = std::chrono::high_resolution_clock::now();
   std::shared_ptr<ShaderProgram> shaderProgramPtr = std::make_shared<ShaderProgram>();
+
+  // binaries are only valid for the exact same sources and driver
+  bool cacheEnabled = !_binaryCacheDirectory.empty() && glad_glProgramBinary != nullptr && glad_glGetProgramBinary != nullptr;
+  std::string cachePath;
+  if (cacheEnabled) {
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    cacheEnabled = formatCount > 0;
+  }
+  if (cacheEnabled) {
+    std::string key = vertexShaderSource + '\0' + fragmentShaderSource + '\0' +
+      (const char *) glGetString(GL_VENDOR) + '\0' +
+      (const char *) glGetString(GL_RENDERER) + '\0' +
+      (const char *) glGetString(GL_VERSION);
+    std::ostringstream name;
+    name << _binaryCacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << hashString(key) << ".bin";
+    cachePath = name.str();
+    if (shaderProgramPtr->loadBinary(cachePath)) {
+      _warmLoads++;
+      _warmMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+      return shaderProgramPtr;
+    }
+    // a rejected binary leaves the program unusable, start over from the sources
+    shaderProgramPtr->recreate();
+    glProgramParameteri(shaderProgramPtr->getId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
   shaderProgramPtr->loadShaderFromSource(GL_VERTEX_SHADER, vertexShaderSource);
   shaderProgramPtr->loadShaderFromSource(GL_FRAGMENT_SHADER, fragmentShaderSource);
   shaderProgramPtr->link();
@@ -77,6 +105,59 @@ std::shared_ptr<ShaderProgram> ShaderProgram::genBasicShaderProgramFromSource(
     GLchar infoLog[512];
     glGetProgramInfoLog(shaderProgramPtr->getId(), 512, NULL, infoLog);
     exitOnCriticalError("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" + std::string(infoLog), "genBasicShaderProgramFromSource");
+  } else if (cacheEnabled) {
+    shaderProgramPtr->saveBinary(cachePath);
   }
+  _coldLoads++;
+  _coldMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
   return shaderProgramPtr;
 }
+
+bool ShaderProgram::loadBinary(const std::string &path) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    return false;
+  }
+  GLenum format;
+  if (!input.read((char *) &format, sizeof(format))) {
+    return false;
+  }
+  std::vector<char> binary((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  if (binary.empty()) {
+    return false;
+  }
+  glProgramBinary(_id, format, binary.data(), (GLsizei) binary.size());
+  GLint success;
+  glGetProgramiv(_id, GL_LINK_STATUS, &success);
+  return success;
+}
+
+void ShaderProgram::saveBinary(const std::string &path) {
+  GLint length = 0;
+  glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(_id, length, &length, &format, binary.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(_binaryCacheDirectory, error);
+  std::ofstream output(path, std::ios::binary);
+  if (!output) {
+    return;
+  }
+  output.write((const char *) &format, sizeof(format));
+  output.write(binary.data(), length);
+}
+
+void ShaderProgram::recreate() {
+  glDeleteProgram(_id);
+  _id = glCreateProgram();
+}
+
+void ShaderProgram::printLoadStats() {
+  std::cout << "Shader programs: " << _coldLoads << " compiled from source in " << _coldMs << " ms (cold), "
+            << _warmLoads << " loaded from the binary cache in " << _warmMs << " ms (warm)" << std::endl;
+}
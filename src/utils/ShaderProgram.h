@@ -21,6 +21,14 @@ public:
     const std::string &vertexShaderFilename,
     const std::string &fragmentShaderFilename);
 
+  // Linked programs are saved with glGetProgramBinary and reloaded on the next launch, keyed by a
+  // hash of the sources and the driver strings. Rejected binaries fall back to compiling the sources.
+  // An empty directory disables the cache.
+  static void setBinaryCacheDirectory(const std::string &directory) { _binaryCacheDirectory = directory; }
+
+  // Prints how long the programs took to build, from source (cold) and from the cache (warm)
+  static void printLoadStats();
+
 
   // OpenGL identifier of the program
   GLuint getId() const { return _id; }
@@ -80,7 +88,17 @@ public:
   }
   
 private:
+  bool loadBinary(const std::string &path);
+  void saveBinary(const std::string &path);
+  void recreate();
+
   GLuint _id = 0;
+
+  static std::string _binaryCacheDirectory;
+  static int _coldLoads;
+  static int _warmLoads;
+  static float _coldMs;
+  static float _warmMs;
 };
 
 #endif  // SHADER_PROGRAM_H
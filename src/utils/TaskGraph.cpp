@@ -0,0 +1,202 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+
+void TaskGraphProfile::add(const TaskGraphProfile &other) {
+    if (stages.empty()) {
+        stages = other.stages;
+        stageMs.assign(stages.size(), 0.0);
+        stageCriticalMs.assign(stages.size(), 0.0);
+    }
+    runs += other.runs;
+    threads = other.threads;
+    tasks += other.tasks;
+    wallMs += other.wallMs;
+    busyMs += other.busyMs;
+    criticalPathMs += other.criticalPathMs;
+    // stages are matched by position, the runs added up are expected to be built the same way
+    for (size_t s = 0; s < stages.size() && s < other.stages.size(); s++) {
+        stageMs[s] += other.stageMs[s];
+        stageCriticalMs[s] += other.stageCriticalMs[s];
+    }
+    criticalPath = other.criticalPath;
+}
+
+void TaskGraphProfile::print(std::ostream &out) const {
+    if (runs == 0) {
+        return;
+    }
+    char line[160];
+    double wall = wallMs / runs;
+    std::snprintf(line, sizeof line,
+                  "Task graph: %d tasks on %d threads, %.2f ms per run, critical path %.2f ms (%.0f%%), idle %.0f%%\n",
+                  tasks / runs, threads, wall, criticalPathMs / runs, 100.0 * criticalPathMs / wallMs,
+                  100.0 * idleMs() / (wallMs * threads));
+    out << line;
+    std::snprintf(line, sizeof line, "  %-20s %10s %16s\n", "stage", "ms/run", "critical ms/run");
+    out << line;
+    for (size_t s = 0; s < stages.size(); s++) {
+        std::snprintf(line, sizeof line, "  %-20s %10.3f %16.3f\n", stages[s].c_str(), stageMs[s] / runs,
+                      stageCriticalMs[s] / runs);
+        out << line;
+    }
+    out << "  critical path: " << criticalPath << "\n";
+}
+
+int TaskGraph::addStage(const std::string &name) {
+    _stages.push_back(name);
+    return (int) _stages.size() - 1;
+}
+
+int TaskGraph::add(int stage, std::function<void()> fn, const std::vector<int> &dependencies) {
+    int id = (int) _tasks.size();
+    Task task;
+    task.stage = stage;
+    task.fn = std::move(fn);
+    task.dependencies = dependencies;
+    _tasks.push_back(std::move(task));
+    for (int dependency : dependencies) {
+        _tasks[dependency].successors.push_back(id);
+    }
+    return id;
+}
+
+void TaskGraph::clear() {
+    _stages.clear();
+    _tasks.clear();
+}
+
+void TaskGraph::run(ThreadPool &pool) {
+    using Clock = std::chrono::steady_clock;
+    int count = (int) _tasks.size();
+
+    // priority: the most tasks still to run one after the other behind a task, dependencies always come first
+    _height.assign(count, 1);
+    for (int t = count - 1; t >= 0; t--) {
+        for (int successor : _tasks[t].successors) {
+            _height[t] = std::max(_height[t], _height[successor] + 1);
+        }
+    }
+    auto lower = [&](int a, int b) { return _height[a] != _height[b] ? _height[a] < _height[b] : a > b; };
+    _ready.clear();
+    _ready.reserve(count);
+    _waitingFor.resize(count);
+    for (int t = 0; t < count; t++) {
+        _waitingFor[t] = (int) _tasks[t].dependencies.size();
+        if (_waitingFor[t] == 0) {
+            _ready.push_back(t);
+            std::push_heap(_ready.begin(), _ready.end(), lower);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    int finished = 0;
+    Clock::time_point start = Clock::now();
+    auto msSinceStart = [&]() { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+    pool.runOnEveryThread([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return !_ready.empty() || finished == count; });
+            if (_ready.empty()) {
+                return;
+            }
+            std::pop_heap(_ready.begin(), _ready.end(), lower);
+            int t = _ready.back();
+            _ready.pop_back();
+            lock.unlock();
+
+            Task &task = _tasks[t];
+            task.startMs = msSinceStart();
+            task.fn();
+            task.endMs = msSinceStart();
+
+            lock.lock();
+            finished++;
+            int released = 0;
+            for (int successor : task.successors) {
+                if (--_waitingFor[successor] == 0) {
+                    _ready.push_back(successor);
+                    std::push_heap(_ready.begin(), _ready.end(), lower);
+                    released++;
+                }
+            }
+            // this thread takes one of the released tasks itself
+            if (finished == count) {
+                wake.notify_all();
+            } else if (released > 1) {
+                released == 2 ? wake.notify_one() : wake.notify_all();
+            }
+        }
+    });
+
+    measure((int) pool.size(), msSinceStart());
+}
+
+void TaskGraph::measure(int threads, double wallMs) {
+    int count = (int) _tasks.size();
+    // assigned field by field, the vectors and strings keep their storage
+    _profile.runs = 1;
+    _profile.threads = threads;
+    _profile.tasks = count;
+    _profile.wallMs = wallMs;
+    _profile.busyMs = 0.0;
+    _profile.criticalPathMs = 0.0;
+    _profile.stages = _stages;
+    _profile.stageMs.assign(_stages.size(), 0.0);
+    _profile.stageCriticalMs.assign(_stages.size(), 0.0);
+    _profile.criticalPath.clear();
+
+    // longest chain ending at each task, counting only the time spent in the tasks
+    _chainMs.assign(count, 0.0);
+    _previous.assign(count, -1);
+    int last = -1;
+    for (int t = 0; t < count; t++) {
+        const Task &task = _tasks[t];
+        double duration = task.endMs - task.startMs;
+        _profile.busyMs += duration;
+        _profile.stageMs[task.stage] += duration;
+        double before = 0.0;
+        for (int dependency : task.dependencies) {
+            if (_chainMs[dependency] > before) {
+                before = _chainMs[dependency];
+                _previous[t] = dependency;
+            }
+        }
+        _chainMs[t] = before + duration;
+        if (last == -1 || _chainMs[t] > _chainMs[last]) {
+            last = t;
+        }
+    }
+    if (last == -1) {
+        return;
+    }
+
+    _profile.criticalPathMs = _chainMs[last];
+    _path.clear();
+    for (int t = last; t != -1; t = _previous[t]) {
+        _path.push_back(t);
+        _profile.stageCriticalMs[_tasks[t].stage] += _tasks[t].endMs - _tasks[t].startMs;
+    }
+    // stage names along the path, a run of tasks in the same stage shown once with its length
+    for (size_t i = _path.size(); i > 0;) {
+        int stage = _tasks[_path[i - 1]].stage;
+        int repeats = 0;
+        while (i > 0 && _tasks[_path[i - 1]].stage == stage) {
+            repeats++;
+            i--;
+        }
+        if (!_profile.criticalPath.empty()) {
+            _profile.criticalPath += " > ";
+        }
+        _profile.criticalPath += _stages[stage];
+        if (repeats > 1) {
+            _profile.criticalPath += " x" + std::to_string(repeats);
+        }
+    }
+}
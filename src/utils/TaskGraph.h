@@ -0,0 +1,72 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Timings of a task graph run, or of several added up
+struct TaskGraphProfile {
+    int runs = 0;
+    int threads = 0;
+    int tasks = 0;
+    double wallMs = 0.0;
+    double busyMs = 0.0;                    // time spent in tasks, summed over the threads
+    double criticalPathMs = 0.0;            // longest chain of dependent tasks by their measured times
+    std::vector<std::string> stages;
+    std::vector<double> stageMs;
+    std::vector<double> stageCriticalMs;    // share of the critical path in each stage
+    std::string criticalPath;               // stages along the last run's critical path
+
+    // Time the threads spent waiting for a task to become ready
+    double idleMs() const { return wallMs * threads - busyMs; }
+    void add(const TaskGraphProfile &other);
+    // Per run averages, the stages and the critical path
+    void print(std::ostream &out) const;
+};
+
+// Tasks with dependencies, run on a thread pool. Every thread takes ready tasks until none are left, the one
+// with the longest chain of work waiting behind it first, so independent work overlaps whatever order the tasks
+// were added in. Each task is timed for the profile. Running the same graph again doesn't allocate.
+class TaskGraph {
+public:
+    // Groups tasks under a name in the profile
+    int addStage(const std::string &name);
+    // fn runs once every dependency has finished, the dependencies are tasks added earlier
+    int add(int stage, std::function<void()> fn, const std::vector<int> &dependencies = {});
+    size_t size() const { return _tasks.size(); }
+    // Removes the tasks and the stages
+    void clear();
+
+    void run(ThreadPool &pool);
+    const TaskGraphProfile &getProfile() const { return _profile; }
+
+private:
+    struct Task {
+        int stage;
+        std::function<void()> fn;
+        std::vector<int> dependencies;
+        std::vector<int> successors;
+        double startMs = 0.0;
+        double endMs = 0.0;
+    };
+
+    void measure(int threads, double wallMs);
+
+    std::vector<std::string> _stages;
+    std::vector<Task> _tasks;
+    TaskGraphProfile _profile;
+
+    // bookkeeping of a run, kept from one run to the next
+    std::vector<int> _height;
+    std::vector<int> _waitingFor;
+    std::vector<int> _ready;            // heap by height
+    std::vector<double> _chainMs;
+    std::vector<int> _previous;
+    std::vector<int> _path;
+};
+
+#endif // TASK_GRAPH_H
@@ -0,0 +1,142 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#include "Numa.h"
+
+namespace {
+    thread_local bool insideJob = false;
+    thread_local int workerIndex = -1;
+    unsigned int instanceThreadCount = std::thread::hardware_concurrency();
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    for (unsigned int i = 1; i < threadCount; i++) {
+        _workers.emplace_back([this, i]() {
+            workerIndex = i - 1;
+            workerLoop();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (std::thread &worker : _workers) {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool(instanceThreadCount);
+    return pool;
+}
+
+void ThreadPool::setInstanceThreadCount(unsigned int threadCount) {
+    instanceThreadCount = threadCount;
+}
+
+int ThreadPool::threadIndex() const {
+    return workerIndex == -1 ? (int) _workers.size() : workerIndex;
+}
+
+void ThreadPool::workerLoop() {
+    unsigned long long seen = 0;
+    while (true) {
+        const FunctionRef<void()> *job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop) {
+                return;
+            }
+            seen = _generation;
+            job = _job;
+        }
+        insideJob = true;
+        (*job)();
+        insideJob = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _finished++;
+        }
+        _done.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(int begin, int end, FunctionRef<void(int, int)> fn, int grain) {
+    if (end <= begin) {
+        return;
+    }
+    int count = end - begin;
+    grain = std::max(grain, 1);
+    if (_workers.empty() || insideJob || count <= grain) {
+        fn(begin, end);
+        return;
+    }
+
+    if (isPinned()) {
+        runOnEveryThread([&]() {
+            int partBegin;
+            int partEnd;
+            rangeOfThread(begin, end, threadIndex(), partBegin, partEnd);
+            if (partBegin < partEnd) {
+                fn(partBegin, partEnd);
+            }
+        });
+        return;
+    }
+
+    // a few chunks per thread so uneven chunks even out
+    int chunkSize = std::max(grain, count / (int) (size() * 4));
+    int chunkCount = (count + chunkSize - 1) / chunkSize;
+    std::atomic<int> nextChunk(0);
+    runOnEveryThread([&]() {
+        int chunk;
+        while ((chunk = nextChunk.fetch_add(1)) < chunkCount) {
+            int chunkBegin = begin + chunk * chunkSize;
+            fn(chunkBegin, std::min(chunkBegin + chunkSize, end));
+        }
+    });
+}
+
+void ThreadPool::rangeOfThread(int begin, int end, int thread, int &partBegin, int &partEnd) const {
+    long long count = end - begin;
+    partBegin = begin + (int) (count * thread / size());
+    partEnd = begin + (int) (count * (thread + 1) / size());
+}
+
+void ThreadPool::pinThreads(const std::vector<int> &cpus) {
+    if (cpus.empty()) {
+        _cpus.clear();
+        runOnEveryThread([]() { Numa::unpinCurrentThread(); });
+        return;
+    }
+    _cpus = cpus;
+    runOnEveryThread([this]() { Numa::pinCurrentThread(cpuOfThread(threadIndex())); });
+}
+
+void ThreadPool::runOnEveryThread(FunctionRef<void()> job) {
+    std::lock_guard<std::mutex> submitLock(_submitMutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &job;
+        _finished = 0;
+        _generation++;
+    }
+    _wake.notify_all();
+
+    insideJob = true;
+    job();
+    insideJob = false;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [&] { return _finished == _workers.size(); });
+    _job = nullptr;
+}
@@ -0,0 +1,66 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FunctionRef.h"
+
+class ThreadPool {
+public:
+    // Spawns threadCount - 1 workers, the calling thread is the last one.
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Shared pool used by the solver and the surface reconstruction
+    static ThreadPool &instance();
+    // Thread count of the shared pool, only effective before its first use. Processes sharing a machine
+    // (e.g. the ranks of a distributed run) split the cores instead of each taking all of them.
+    static void setInstanceThreadCount(unsigned int threadCount);
+
+    // Splits [begin, end) into chunks of at least grain items and runs fn(chunkBegin, chunkEnd)
+    // on every thread of the pool. Returns once all chunks are done. fn is only referenced, nothing is allocated.
+    // Calls made from inside a running job are executed serially on the current thread.
+    // While pinned every thread gets one contiguous part instead, the same one on every call (see rangeOfThread).
+    void parallelFor(int begin, int end, FunctionRef<void(int, int)> fn, int grain = 1);
+
+    // NUMA mode: pins thread t to cpus[t % cpus.size()] and makes the parts of parallelFor sticky, so a
+    // thread keeps working on the memory placed on its node from one call to the next. Empty cpus unpins.
+    void pinThreads(const std::vector<int> &cpus);
+    bool isPinned() const { return !_cpus.empty(); }
+    int cpuOfThread(int thread) const { return _cpus[thread % _cpus.size()]; }
+    // Part of [begin, end) thread gets from parallelFor while pinned
+    void rangeOfThread(int begin, int end, int thread, int &partBegin, int &partEnd) const;
+
+    // Runs job once on every thread of the pool, the caller included, and returns when all are done. Jobs that
+    // hand out their own work (e.g. TaskGraph) use it to get every thread at once.
+    void runOnEveryThread(FunctionRef<void()> job);
+
+    unsigned int size() const { return (unsigned int) _workers.size() + 1; }
+
+    // Index of the calling thread in [0, size()), the thread that called parallelFor is the last one.
+    // Jobs use it to write to per-thread slots instead of sharing a lock.
+    int threadIndex() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> _workers;
+    std::mutex _submitMutex; // one parallelFor at a time when several threads share the pool
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const FunctionRef<void()> *_job = nullptr;   // the caller's, valid until every thread is done with it
+    unsigned long long _generation = 0;
+    unsigned int _finished = 0;
+    bool _stop = false;
+    std::vector<int> _cpus;
+};
+
+#endif // THREAD_POOL_H
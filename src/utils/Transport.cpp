@@ -0,0 +1,374 @@
+#include "Transport.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    const size_t readChunk = 64 * 1024;
+
+    void lostPeer(int peer, const std::string &where) {
+        exitOnCriticalError("Lost the connection to rank " + std::to_string(peer), where);
+        std::exit(1);
+    }
+
+    // "unix:/path" or "host:port", false if the address doesn't resolve
+    bool resolve(const std::string &address, sockaddr_storage &storage, socklen_t &length, int &family) {
+        std::memset(&storage, 0, sizeof storage);
+        if (address.compare(0, 5, "unix:") == 0) {
+            sockaddr_un *unixAddress = (sockaddr_un *) &storage;
+            std::string path = address.substr(5);
+            if (path.size() >= sizeof unixAddress->sun_path) {
+                return false;
+            }
+            unixAddress->sun_family = AF_UNIX;
+            std::strcpy(unixAddress->sun_path, path.c_str());
+            length = sizeof(sockaddr_un);
+            family = AF_UNIX;
+            return true;
+        }
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &result) != 0 || !result) {
+            return false;
+        }
+        std::memcpy(&storage, result->ai_addr, result->ai_addrlen);
+        length = result->ai_addrlen;
+        family = result->ai_family;
+        freeaddrinfo(result);
+        return true;
+    }
+
+    bool writeAll(int socket, const char *data, size_t length) {
+        while (length > 0) {
+            ssize_t written = ::send(socket, data, length, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    bool readAll(int socket, char *data, size_t length) {
+        while (length > 0) {
+            ssize_t received = ::recv(socket, data, length, 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            data += received;
+            length -= received;
+        }
+        return true;
+    }
+}
+
+Transport::Transport(int rank, int size) :
+        _rank(rank),
+        _size(size),
+        _inbox(size),
+        _inboxRead(size, 0) {}
+
+void Transport::send(int peer, const std::vector<char> &message) {
+    unsigned long long length = message.size();
+    const char *parts[2] = {(const char *) &length, message.data()};
+    size_t sizes[2] = {sizeof length, message.size()};
+    for (int part = 0; part < 2; part++) {
+        size_t done = 0;
+        while (done < sizes[part]) {
+            size_t moved = writeSome(peer, parts[part] + done, sizes[part] - done);
+            done += moved;
+            if (moved == 0 && !drainIncoming()) {
+                waitForProgress(peer);
+            }
+        }
+    }
+}
+
+void Transport::receive(int peer, std::vector<char> &message) {
+    std::vector<char> &inbox = _inbox[peer];
+    while (true) {
+        size_t available = inbox.size() - _inboxRead[peer];
+        unsigned long long length = 0;
+        if (available >= sizeof length) {
+            std::memcpy(&length, inbox.data() + _inboxRead[peer], sizeof length);
+            if (available >= sizeof length + length) {
+                const char *body = inbox.data() + _inboxRead[peer] + sizeof length;
+                message.assign(body, body + length);
+                _inboxRead[peer] += sizeof length + length;
+                // keep the inbox from growing, consumed bytes are dropped once they are the larger part
+                if (_inboxRead[peer] * 2 >= inbox.size()) {
+                    inbox.erase(inbox.begin(), inbox.begin() + _inboxRead[peer]);
+                    _inboxRead[peer] = 0;
+                }
+                return;
+            }
+        }
+        if (!drainIncoming()) {
+            if (!isConnected(peer)) {
+                lostPeer(peer, "Transport::receive");
+            }
+            waitForProgress(-1);
+        }
+    }
+}
+
+bool Transport::drainIncoming() {
+    bool any = false;
+    for (int peer = 0; peer < _size; peer++) {
+        if (peer == _rank) {
+            continue;
+        }
+        std::vector<char> &inbox = _inbox[peer];
+        while (true) {
+            size_t used = inbox.size();
+            inbox.resize(used + readChunk);
+            size_t moved = readSome(peer, inbox.data() + used, readChunk);
+            inbox.resize(used + moved);
+            any = any || moved > 0;
+            if (moved < readChunk) {
+                break;
+            }
+        }
+    }
+    return any;
+}
+
+size_t SharedMemoryTransport::regionSize(int size, size_t capacity) {
+    return (size_t) size * size * (sizeof(Ring) + capacity);
+}
+
+void *SharedMemoryTransport::createRegion(int size, size_t capacity) {
+    void *region = mmap(nullptr, regionSize(size, capacity), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return nullptr;
+    }
+    for (int pair = 0; pair < size * size; pair++) {
+        Ring *ring = new ((char *) region + pair * (sizeof(Ring) + capacity)) Ring();
+        ring->written.store(0);
+        ring->read.store(0);
+    }
+    return region;
+}
+
+void SharedMemoryTransport::destroyRegion(void *region, int size, size_t capacity) {
+    munmap(region, regionSize(size, capacity));
+}
+
+SharedMemoryTransport::SharedMemoryTransport(int rank, int size, void *region, size_t capacity) :
+        Transport(rank, size),
+        _region((char *) region),
+        _capacity(capacity) {}
+
+SharedMemoryTransport::Ring *SharedMemoryTransport::ring(int from, int to) const {
+    return (Ring *) (_region + (from * size() + to) * (sizeof(Ring) + _capacity));
+}
+
+char *SharedMemoryTransport::ringData(int from, int to) const {
+    return (char *) ring(from, to) + sizeof(Ring);
+}
+
+size_t SharedMemoryTransport::writeSome(int peer, const char *data, size_t length) {
+    Ring *r = ring(rank(), peer);
+    unsigned long long written = r->written.load(std::memory_order_relaxed);
+    unsigned long long read = r->read.load(std::memory_order_acquire);
+    size_t count = std::min<size_t>(length, _capacity - (written - read));
+    size_t start = written % _capacity;
+    size_t first = std::min(count, _capacity - start);
+    std::memcpy(ringData(rank(), peer) + start, data, first);
+    std::memcpy(ringData(rank(), peer), data + first, count - first);
+    r->written.store(written + count, std::memory_order_release);
+    if (count > 0) {
+        _idleWaits = 0;
+    }
+    return count;
+}
+
+size_t SharedMemoryTransport::readSome(int peer, char *data, size_t length) {
+    Ring *r = ring(peer, rank());
+    unsigned long long written = r->written.load(std::memory_order_acquire);
+    unsigned long long read = r->read.load(std::memory_order_relaxed);
+    size_t count = std::min<size_t>(length, written - read);
+    size_t start = read % _capacity;
+    size_t first = std::min(count, _capacity - start);
+    std::memcpy(data, ringData(peer, rank()) + start, first);
+    std::memcpy(data + first, ringData(peer, rank()), count - first);
+    r->read.store(read + count, std::memory_order_release);
+    if (count > 0) {
+        _idleWaits = 0;
+    }
+    return count;
+}
+
+void SharedMemoryTransport::waitForProgress(int) {
+    // yielding keeps the latency low when the peer is about to answer, a longer wait backs off to sleeps of
+    // up to a millisecond so it doesn't take the core from a rank that is still computing
+    if (++_idleWaits < 64) {
+        sched_yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(std::min(_idleWaits - 64, 1000)));
+    }
+}
+
+SocketTransport::SocketTransport(int rank, const std::vector<std::string> &addresses) :
+        Transport(rank, addresses.size()),
+        _addresses(addresses),
+        _sockets(addresses.size(), -1) {}
+
+SocketTransport::~SocketTransport() {
+    for (int socket : _sockets) {
+        if (socket != -1) {
+            close(socket);
+        }
+    }
+    if (_listener != -1) {
+        close(_listener);
+        if (_addresses[rank()].compare(0, 5, "unix:") == 0) {
+            unlink(_addresses[rank()].substr(5).c_str());
+        }
+    }
+}
+
+bool SocketTransport::connect(float timeoutSeconds) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(timeoutSeconds);
+    sockaddr_storage address;
+    socklen_t length;
+    int family;
+    if (!resolve(_addresses[rank()], address, length, family)) {
+        exitOnCriticalError("Can't resolve " + _addresses[rank()], "SocketTransport::connect");
+        return false;
+    }
+    if (family == AF_UNIX) {
+        unlink(((sockaddr_un *) &address)->sun_path);
+    }
+    _listener = socket(family, SOCK_STREAM, 0);
+    int on = 1;
+    if (_listener == -1 || setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on) != 0 ||
+        bind(_listener, (sockaddr *) &address, length) != 0 || listen(_listener, size()) != 0) {
+        exitOnCriticalError("Can't listen on " + _addresses[rank()], "SocketTransport::connect");
+        return false;
+    }
+
+    // the lower ranks may not be listening yet, connecting is retried until the deadline
+    for (int peer = 0; peer < rank(); peer++) {
+        if (!resolve(_addresses[peer], address, length, family)) {
+            exitOnCriticalError("Can't resolve " + _addresses[peer], "SocketTransport::connect");
+            return false;
+        }
+        while (_sockets[peer] == -1) {
+            int s = socket(family, SOCK_STREAM, 0);
+            if (::connect(s, (sockaddr *) &address, length) == 0) {
+                _sockets[peer] = s;
+                break;
+            }
+            close(s);
+            if (std::chrono::steady_clock::now() > deadline) {
+                exitOnCriticalError("Can't connect to rank " + std::to_string(peer) + " at " + _addresses[peer], "SocketTransport::connect");
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        int self = rank();
+        if (!writeAll(_sockets[peer], (const char *) &self, sizeof self)) {
+            return false;
+        }
+    }
+    for (int accepted = rank() + 1; accepted < size(); accepted++) {
+        pollfd listening = {_listener, POLLIN, 0};
+        int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0 || poll(&listening, 1, remaining) <= 0) {
+            exitOnCriticalError("Timed out waiting for the higher ranks", "SocketTransport::connect");
+            return false;
+        }
+        int s = accept(_listener, nullptr, nullptr);
+        int peer = -1;
+        if (s == -1 || !readAll(s, (char *) &peer, sizeof peer) || peer <= rank() || peer >= size() || _sockets[peer] != -1) {
+            exitOnCriticalError("Unexpected connection on " + _addresses[rank()], "SocketTransport::connect");
+            return false;
+        }
+        _sockets[peer] = s;
+    }
+
+    for (int peer = 0; peer < size(); peer++) {
+        if (_sockets[peer] == -1) {
+            continue;
+        }
+        fcntl(_sockets[peer], F_SETFL, fcntl(_sockets[peer], F_GETFL) | O_NONBLOCK);
+        if (_addresses[peer].compare(0, 5, "unix:") != 0) {
+            setsockopt(_sockets[peer], IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+        }
+    }
+    return true;
+}
+
+size_t SocketTransport::writeSome(int peer, const char *data, size_t length) {
+    if (_sockets[peer] == -1) {
+        lostPeer(peer, "SocketTransport::writeSome");
+    }
+    ssize_t written = ::send(_sockets[peer], data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        lostPeer(peer, "SocketTransport::writeSome");
+    }
+    return written;
+}
+
+size_t SocketTransport::readSome(int peer, char *data, size_t length) {
+    if (_sockets[peer] == -1) {
+        return 0;
+    }
+    ssize_t received = ::recv(_sockets[peer], data, length, MSG_DONTWAIT);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        lostPeer(peer, "SocketTransport::readSome");
+    }
+    if (received == 0) {
+        // a peer that finished closes its end, everything it sent has been read by now
+        close(_sockets[peer]);
+        _sockets[peer] = -1;
+    }
+    return received;
+}
+
+void SocketTransport::waitForProgress(int writingPeer) {
+    std::vector<pollfd> fds;
+    for (int peer = 0; peer < size(); peer++) {
+        if (_sockets[peer] != -1) {
+            fds.push_back({_sockets[peer], (short) (POLLIN | (peer == writingPeer ? POLLOUT : 0)), 0});
+        }
+    }
+    poll(fds.data(), fds.size(), 100);
+}
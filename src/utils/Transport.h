@@ -0,0 +1,100 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Ordered, reliable messages between the ranks of a distributed run. The backends only move bytes without
+// blocking, the framing and the waiting live here: a rank blocked on a full channel keeps draining its own
+// incoming channels into per-peer inboxes, so two ranks sending to each other at once can't deadlock.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    Transport(const Transport &) = delete;
+    Transport &operator=(const Transport &) = delete;
+
+    int rank() const { return _rank; }
+    int size() const { return _size; }
+
+    // Returns once the whole message is in the channel, messages to one peer arrive in the order they were sent
+    void send(int peer, const std::vector<char> &message);
+    // Blocks until the next message from peer is complete
+    void receive(int peer, std::vector<char> &message);
+
+protected:
+    Transport(int rank, int size);
+
+    // Non-blocking, the number of bytes moved, 0 when the channel is full or empty
+    virtual size_t writeSome(int peer, const char *data, size_t length) = 0;
+    virtual size_t readSome(int peer, char *data, size_t length) = 0;
+    // Waits a little for any channel to make progress, writingPeer is the one a send is stuck on or -1
+    virtual void waitForProgress(int writingPeer) = 0;
+    // False once the peer has gone away, nothing more will arrive from it
+    virtual bool isConnected(int) const { return true; }
+
+private:
+    // Moves everything that has arrived into the inboxes, true if anything did
+    bool drainIncoming();
+
+    int _rank;
+    int _size;
+    std::vector<std::vector<char>> _inbox;  // received bytes per peer, consumed from _inboxRead on
+    std::vector<size_t> _inboxRead;
+};
+
+// One single-producer single-consumer byte ring per ordered pair of ranks in memory shared by processes
+// on the same machine. The region is mapped before the ranks are forked.
+class SharedMemoryTransport : public Transport {
+public:
+    struct Ring {
+        alignas(64) std::atomic<unsigned long long> written;
+        alignas(64) std::atomic<unsigned long long> read;
+    };
+
+    // Maps the rings of size ranks, capacity bytes each, nullptr if the mapping fails
+    static void *createRegion(int size, size_t capacity);
+    static void destroyRegion(void *region, int size, size_t capacity);
+
+    SharedMemoryTransport(int rank, int size, void *region, size_t capacity);
+
+protected:
+    size_t writeSome(int peer, const char *data, size_t length) override;
+    size_t readSome(int peer, char *data, size_t length) override;
+    void waitForProgress(int writingPeer) override;
+
+private:
+    static size_t regionSize(int size, size_t capacity);
+    Ring *ring(int from, int to) const;
+    char *ringData(int from, int to) const;
+
+    char *_region;
+    size_t _capacity;
+    int _idleWaits = 0;
+};
+
+// Stream sockets between every pair of ranks, Unix domain ("unix:/path") on one machine or TCP ("host:port")
+// across machines. Every rank listens on its own address, connects to the lower ranks and accepts the higher.
+class SocketTransport : public Transport {
+public:
+    SocketTransport(int rank, const std::vector<std::string> &addresses);
+    ~SocketTransport() override;
+
+    // Sets up all the connections, false if a peer couldn't be reached within timeoutSeconds
+    bool connect(float timeoutSeconds = 30.0f);
+
+protected:
+    size_t writeSome(int peer, const char *data, size_t length) override;
+    size_t readSome(int peer, char *data, size_t length) override;
+    void waitForProgress(int writingPeer) override;
+    bool isConnected(int peer) const override { return _sockets[peer] != -1; }
+
+private:
+    std::vector<std::string> _addresses;
+    std::vector<int> _sockets;
+    int _listener = -1;
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,41 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+
+// Hands the newest value from one writer thread to one reader thread without locks or waiting. The writer fills
+// its own slot and publishes it, the reader picks up the latest published slot; the third slot sits between them,
+// so neither ever blocks and values the reader didn't get to in time are simply skipped.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer: the slot to fill, it still holds what was written there two publishes ago
+    T &writeBuffer() { return _slots[_write]; }
+    // Writer: makes the filled slot the newest one and takes back the slot in the middle
+    void publish() {
+        _write = _middle.exchange(_write | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Reader: switches to the newest published slot, false if nothing was published since the last call
+    bool update() {
+        if (!(_middle.load(std::memory_order_relaxed) & freshBit)) {
+            return false;
+        }
+        _read = _middle.exchange(_read, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+    // Reader: the slot picked by the last update, untouched by the writer until the next one
+    const T &readBuffer() const { return _slots[_read]; }
+
+private:
+    static constexpr int indexMask = 3;
+    static constexpr int freshBit = 4;      // set in _middle while the slot there hasn't been read
+
+    std::array<T, 3> _slots;
+    int _write = 0;
+    std::atomic<int> _middle{1};
+    int _read = 2;
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,62 @@
+#include "FBO.h"
+
+#include "../util.h"
+
+FBO::FBO() {
+    glGenFramebuffers(1, &_id);
+}
+
+void FBO::create(int width, int height, GLenum internalFormat, GLenum format, GLenum type, bool withDepth) {
+    release();
+    GLint previousFramebuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    _width = width;
+    _height = height;
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    bind();
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _texture, 0);
+    if (withDepth) {
+        glGenRenderbuffers(1, &_depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, _depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depth);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        exitOnCriticalError("Framebuffer is not complete", "FBO::create");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+void FBO::bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, _id);
+}
+
+void FBO::unbind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FBO::release() {
+    if (_texture != 0) {
+        glDeleteTextures(1, &_texture);
+        _texture = 0;
+    }
+    if (_depth != 0) {
+        glDeleteRenderbuffers(1, &_depth);
+        _depth = 0;
+    }
+}
+
+FBO::~FBO() {
+    release();
+    glDeleteFramebuffers(1, &_id);
+}
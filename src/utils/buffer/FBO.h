@@ -0,0 +1,34 @@
+#ifndef FBO_H
+#define FBO_H
+
+#include <glad/glad.h>
+
+class FBO {
+
+public:
+    FBO();
+    ~FBO();
+
+    FBO(const FBO &) = delete;
+    FBO &operator=(const FBO &) = delete;
+
+    // (Re)allocates the color texture and, if asked, a depth buffer of the given size
+    void create(int width, int height, GLenum internalFormat = GL_R32F, GLenum format = GL_RED, GLenum type = GL_FLOAT, bool withDepth = false);
+    void bind();
+    void unbind();
+
+    GLuint getTexture() const { return _texture; }
+    int getWidth() const { return _width; }
+    int getHeight() const { return _height; }
+
+private:
+    void release();
+
+    GLuint _id = 0;
+    GLuint _texture = 0;
+    GLuint _depth = 0;
+    int _width = 0;
+    int _height = 0;
+};
+
+#endif // FBO_H
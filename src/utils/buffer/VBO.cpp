@@ -12,6 +12,10 @@ void VBO::setBuffer(std::vector<Vertex> vertices, GLenum usage) {
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), usage);
 }
 
+void VBO::setBuffer(const std::vector<glm::vec3> &positions, GLenum usage) {
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), usage);
+}
+
 void VBO::unbind() {
     glBindBuffer(GL_ARRAY_BUFFER, 0); 
 }
@@ -27,6 +27,7 @@ public:
 
     void bind();
     void setBuffer(std::vector<Vertex> vertices, GLenum usage = GL_STATIC_DRAW);
+    void setBuffer(const std::vector<glm::vec3> &positions, GLenum usage = GL_STATIC_DRAW);
     void unbind();
 
 private:
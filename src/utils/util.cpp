@@ -5,6 +5,7 @@
 #include <sstream>
 #include <string>
 #include <cstring>
+#include <unistd.h>
 
 void exitOnCriticalError(const std::string &errorMessage, const std::string &errorPlace) {
     std::cerr << "Error: " << errorMessage << std::endl;
@@ -31,4 +32,23 @@ char* file2CharArray(const std::string &filename) {
     char* cstr = new char[str.length() + 1];
     strcpy(cstr, str.c_str());
     return cstr;
-}
\ No newline at end of file
+}
+
+unsigned long long hashString(const std::string &value) {
+    unsigned long long hash = 1469598103934665603ull;
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t residentMemoryBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if (!(statm >> pages >> resident)) {
+        return 0;
+    }
+    return resident * (size_t) sysconf(_SC_PAGESIZE);
+}
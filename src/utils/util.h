@@ -10,5 +10,9 @@
 void exitOnCriticalError(const std::string &errorMessage, const std::string &errorPlace);
 std::string file2String(const std::string &filename);
 char* file2CharArray(const std::string &filename);
+// FNV-1a, used to name cache files
+unsigned long long hashString(const std::string &value);
+// Resident set size of the process from /proc/self/statm, 0 where that isn't available
+size_t residentMemoryBytes();
 
 #endif // UTIL_H
\ No newline at end of file